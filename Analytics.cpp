@@ -0,0 +1,349 @@
+#include "Analytics.h"
+#include "VMContext.h"
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <string>
+
+/**
+ * a uniform hash of the page (the splitmix64 finalizer), reduced to ANALYTICS_HASH_BITS bits.
+ **/
+static inline uint64_t hashOf(uint64_t page)
+{
+    page += 0x9E3779B97F4A7C15ULL;
+    page = (page ^ (page >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    page = (page ^ (page >> 27)) * 0x94D049BB133111EBULL;
+    return (page ^ (page >> 31)) >> (64 - ANALYTICS_HASH_BITS);
+}
+
+AccessAnalyzer::AccessAnalyzer(const AnalyticsConfig &config) : config_(config)
+{
+    assert(config.samplingRate > 0 && config.samplingRate <= 1 && config.maxSamples != 0);
+    assert(config.maxFrames != 0 && config.curvePoints != 0);
+    bucketFrames_ = std::max<uint64_t>(1, (config.maxFrames + config.curvePoints - 1) / config.curvePoints);
+    reset();
+}
+
+void AccessAnalyzer::reset()
+{
+    accesses_ = 0;
+    faults_ = 0;
+
+    uint64_t range = 1ULL << ANALYTICS_HASH_BITS;
+    threshold_ = std::min<uint64_t>(range, std::max<uint64_t>(1, (uint64_t)(config_.samplingRate * range)));
+    samples_.clear();
+    byHash_.clear();
+
+    /* slots for twice the samples: a renumbering frees at least half of them */
+    tree_.assign(2 * config_.maxSamples + 3, 0);
+    now_ = 0;
+    distances_.assign(config_.curvePoints + 1, 0);
+    coldReferences_ = 0;
+
+    window_ = 0;
+    windowAccesses_ = 0;
+    windowSampled_ = 0;
+    windowFaults_ = 0;
+    windows_.clear();
+    windowsClosed_ = 0;
+
+    hot_.clear();
+    hotIndex_.clear();
+}
+
+/* ===================================================================== */
+/*                            REUSE DISTANCES                            */
+/* ===================================================================== */
+
+void AccessAnalyzer::mark(uint64_t time, int64_t delta)
+{
+    for (uint64_t i = time + 1; i < tree_.size(); i += i & (~i + 1)) tree_[i] += delta;
+}
+
+uint64_t AccessAnalyzer::marksUpTo(uint64_t time) const
+{
+    int64_t marks = 0;
+    for (uint64_t i = time + 1; i != 0; i -= i & (~i + 1)) marks += tree_[i];
+    return (uint64_t)marks;
+}
+
+/**
+ * renumbers the last accesses of the samples 0, 1, ... in their order, which keeps every distance.
+ **/
+void AccessAnalyzer::compact()
+{
+    std::vector<std::pair<uint64_t, Sample *>> order;
+    order.reserve(samples_.size());
+    for (auto &entry : samples_) order.emplace_back(entry.second.time, &entry.second);
+    std::sort(order.begin(), order.end(),
+              [](const std::pair<uint64_t, Sample *> &a, const std::pair<uint64_t, Sample *> &b) { return a.first < b.first; });
+
+    std::fill(tree_.begin(), tree_.end(), 0);
+    now_ = 0;
+    for (auto &entry : order)
+    {
+        if (entry.second->count == 0) continue; // inserted by the access being counted, not marked yet
+        entry.second->time = now_;
+        mark(now_++, 1);
+    }
+}
+
+/**
+ * the reference to a sampled page: its distance is the number of sampled pages accessed since its
+ * previous access, scaled by the rate to a number of pages.
+ **/
+void AccessAnalyzer::sampledAccess(Sample &sample, bool known)
+{
+    if (now_ + 1 >= tree_.size()) compact();
+
+    if (known)
+    {
+        uint64_t newer = samples_.size() - marksUpTo(sample.time);
+        mark(sample.time, -1);
+        uint64_t pages = (uint64_t)((double)newer / samplingRate());
+        distances_[std::min<uint64_t>(pages / bucketFrames_, config_.curvePoints)] += 1;
+    }
+    else
+    {
+        coldReferences_ += 1;
+    }
+    sample.time = now_;
+    mark(now_++, 1);
+    sample.count++;
+
+    if (sample.window != window_)
+    {
+        sample.window = window_;
+        windowSampled_++;
+    }
+}
+
+/**
+ * fixed-size SHARDS: drops the pages with the largest hashes until maxSamples remain, and takes the
+ * largest hash dropped as the new threshold. the counts so far are rescaled to the new rate.
+ **/
+void AccessAnalyzer::lowerRate()
+{
+    while (samples_.size() > config_.maxSamples)
+    {
+        uint64_t threshold = byHash_.rbegin()->first;
+        while (!byHash_.empty() && byHash_.rbegin()->first >= threshold)
+        {
+            auto last = std::prev(byHash_.end());
+            auto sample = samples_.find(last->second);
+            if (sample->second.count != 0) mark(sample->second.time, -1);
+            samples_.erase(sample);
+            byHash_.erase(last);
+        }
+
+        double scale = (double)threshold / threshold_;
+        for (double &count : distances_) count *= scale;
+        coldReferences_ *= scale;
+        threshold_ = threshold;
+    }
+}
+
+/* ===================================================================== */
+/*                               STREAM                                  */
+/* ===================================================================== */
+
+/**
+ * Space-Saving: a page not tracked takes the counter of the least accessed tracked page, and
+ * inherits its count as the error.
+ **/
+void AccessAnalyzer::countHot(uint64_t page, uint64_t count)
+{
+    if (config_.hotPages == 0) return;
+
+    auto it = hotIndex_.find(page);
+    if (it != hotIndex_.end())
+    {
+        hot_[it->second].accesses += count;
+        return;
+    }
+    if (hot_.size() < config_.hotPages)
+    {
+        hotIndex_.emplace(page, hot_.size());
+        hot_.push_back(HotPage{page, count, 0});
+        return;
+    }
+
+    size_t least = 0;
+    for (size_t i = 1; i < hot_.size(); ++i)
+        if (hot_[i].accesses < hot_[least].accesses) least = i;
+    HotPage &victim = hot_[least];
+    hotIndex_.erase(victim.page);
+    hotIndex_.emplace(page, least);
+    victim.page = page;
+    victim.error = victim.accesses;
+    victim.accesses += count;
+}
+
+void AccessAnalyzer::closeWindow()
+{
+    Window window{windowAccesses_, (uint64_t)((double)windowSampled_ / samplingRate() + 0.5), windowFaults_};
+    if (windows_.size() < ANALYTICS_WINDOWS) windows_.push_back(window);
+    else windows_[windowsClosed_ % ANALYTICS_WINDOWS] = window;
+    windowsClosed_++;
+
+    window_++;
+    windowAccesses_ = 0;
+    windowSampled_ = 0;
+    windowFaults_ = 0;
+}
+
+void AccessAnalyzer::access(uint64_t page)
+{
+    accesses_++;
+    windowAccesses_++;
+    countHot(page, 1);
+
+    uint64_t hash = hashOf(page);
+    if (hash < threshold_)
+    {
+        auto sample = samples_.find(page);
+        bool known = sample != samples_.end();
+        if (!known)
+        {
+            sample = samples_.emplace(page, Sample{hash, 0, 0, UINT64_MAX}).first;
+            byHash_.emplace(hash, page);
+        }
+        sampledAccess(sample->second, known);
+        if (samples_.size() > config_.maxSamples) lowerRate();
+    }
+
+    if (config_.windowAccesses != 0 && windowAccesses_ >= config_.windowAccesses) closeWindow();
+}
+
+void AccessAnalyzer::repeat(uint64_t page, uint64_t count)
+{
+    if (count == 0) return;
+    accesses_ += count;
+    windowAccesses_ += count;
+    countHot(page, count);
+
+    if (hashOf(page) < threshold_)
+    {
+        auto sample = samples_.find(page);
+        if (sample != samples_.end())
+        {
+            distances_[0] += (double)count;
+            sample->second.count += count;
+        }
+    }
+
+    if (config_.windowAccesses != 0 && windowAccesses_ >= config_.windowAccesses) closeWindow();
+}
+
+void AccessAnalyzer::fault()
+{
+    faults_++;
+    windowFaults_++;
+}
+
+/* ===================================================================== */
+/*                               REPORTS                                 */
+/* ===================================================================== */
+
+/**
+ * SHARDS_adj: the sample should hold accesses * rate references; what it lacks (or has too many,
+ * from rescaling) goes to the smallest distances, where the error matters least.
+ **/
+std::vector<AccessAnalyzer::CurvePoint> AccessAnalyzer::missRatioCurve() const
+{
+    std::vector<CurvePoint> curve;
+    if (accesses_ == 0) return curve;
+
+    double expected = (double)accesses_ * samplingRate();
+    double measured = coldReferences_;
+    for (double count : distances_) measured += count;
+
+    double hits = expected - measured;
+    for (uint64_t point = 1; point <= config_.curvePoints; ++point)
+    {
+        hits += distances_[point - 1];
+        double missRatio = std::min(1.0, std::max(0.0, 1 - hits / expected));
+        curve.push_back(CurvePoint{point * bucketFrames_, missRatio});
+    }
+    return curve;
+}
+
+std::vector<AccessAnalyzer::Window> AccessAnalyzer::windows() const
+{
+    if (windows_.size() < ANALYTICS_WINDOWS) return windows_;
+
+    size_t oldest = windowsClosed_ % ANALYTICS_WINDOWS;
+    std::vector<Window> ordered(windows_.begin() + oldest, windows_.end());
+    ordered.insert(ordered.end(), windows_.begin(), windows_.begin() + oldest);
+    return ordered;
+}
+
+std::vector<AccessAnalyzer::HotPage> AccessAnalyzer::hotPages() const
+{
+    std::vector<HotPage> pages = hot_;
+    std::sort(pages.begin(), pages.end(), [](const HotPage &a, const HotPage &b) {
+        return a.accesses != b.accesses ? a.accesses > b.accesses : a.page < b.page;
+    });
+    return pages;
+}
+
+std::vector<uint64_t> AccessAnalyzer::frequencyHistogram() const
+{
+    std::vector<double> pages;
+    for (const auto &entry : samples_)
+    {
+        uint64_t bucket = 63 - __builtin_clzll(entry.second.count);
+        if (pages.size() <= bucket) pages.resize(bucket + 1, 0);
+        pages[bucket] += 1 / samplingRate();
+    }
+
+    std::vector<uint64_t> histogram;
+    for (double count : pages) histogram.push_back((uint64_t)(count + 0.5));
+    return histogram;
+}
+
+void printAnalytics(std::ostream &out, const AccessAnalyzer &analyzer)
+{
+    out << "accesses " << analyzer.accesses() << ", faults " << analyzer.faults() << ", sampling rate "
+        << std::setprecision(6) << analyzer.samplingRate() << '\n';
+
+    out << '\n' << std::setw(12) << "frames" << std::setw(14) << "lru-miss" << '\n';
+    for (const AccessAnalyzer::CurvePoint &point : analyzer.missRatioCurve())
+    {
+        out << std::setw(12) << point.frames << std::setw(14) << std::fixed << std::setprecision(6)
+            << point.missRatio << '\n';
+    }
+
+    out << '\n' << std::setw(12) << "window" << std::setw(14) << "accesses" << std::setw(14) << "working-set"
+        << std::setw(14) << "faults" << '\n';
+    uint64_t index = 0;
+    for (const AccessAnalyzer::Window &window : analyzer.windows())
+    {
+        out << std::setw(12) << index++ << std::setw(14) << window.accesses << std::setw(14) << window.workingSet
+            << std::setw(14) << window.faults << '\n';
+    }
+
+    out << '\n' << std::setw(12) << "hot-page" << std::setw(14) << "accesses" << std::setw(14) << "error" << '\n';
+    for (const AccessAnalyzer::HotPage &page : analyzer.hotPages())
+        out << std::setw(12) << page.page << std::setw(14) << page.accesses << std::setw(14) << page.error << '\n';
+
+    out << '\n' << std::setw(12) << "accessed" << std::setw(14) << "pages" << '\n';
+    std::vector<uint64_t> histogram = analyzer.frequencyHistogram();
+    for (size_t bucket = 0; bucket < histogram.size(); ++bucket)
+    {
+        std::string range = std::to_string(1ULL << bucket);
+        if (bucket != 0) range += "-" + std::to_string((2ULL << bucket) - 1);
+        out << std::setw(12) << range << std::setw(14) << histogram[bucket] << '\n';
+    }
+    out.flush();
+}
+
+void VManalyze(VMContext &context, AccessAnalyzer *analyzer)
+{
+    context.analyzer = analyzer;
+}
+
+void VManalyze(AccessAnalyzer *analyzer)
+{
+    VManalyze(VMdefaultContext(), analyzer);
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include <cstdint>
+#include <ostream>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// defaults of AnalyticsConfig
+#define ANALYTICS_SAMPLING_RATE 0.1
+#define ANALYTICS_MAX_SAMPLES 8192
+#define ANALYTICS_CURVE_POINTS 64
+#define ANALYTICS_WINDOW_ACCESSES (1 << 16)
+#define ANALYTICS_HOT_PAGES 32
+// working-set windows kept (the most recent ones)
+#define ANALYTICS_WINDOWS 1024
+// page hashes are compared against the sampling threshold in [0, 2^ANALYTICS_HASH_BITS]
+#define ANALYTICS_HASH_BITS 24
+
+/*
+ * Tunables of an AccessAnalyzer. Its memory is bounded by maxSamples, curvePoints and hotPages,
+ * whatever the length of the stream.
+ */
+struct AnalyticsConfig
+{
+    // the fraction of pages whose reuse distances are measured (1 = every page: exact Mattson stacks)
+    double samplingRate = ANALYTICS_SAMPLING_RATE;
+
+    // sampled pages remembered at most: past it the rate is lowered to keep this many (fixed-size SHARDS)
+    uint64_t maxSamples = ANALYTICS_MAX_SAMPLES;
+
+    // the miss-ratio curve spans 1 .. maxFrames data-page frames in curvePoints steps
+    uint64_t maxFrames = 4 * NUM_FRAMES;
+    uint64_t curvePoints = ANALYTICS_CURVE_POINTS;
+
+    // accesses per working-set window (0: no windows)
+    uint64_t windowAccesses = ANALYTICS_WINDOW_ACCESSES;
+
+    // most accessed pages tracked
+    uint64_t hotPages = ANALYTICS_HOT_PAGES;
+};
+
+/*
+ * Single-pass analytics of a page-access stream. Attach one to a context with VManalyze() to feed it
+ * every access of VMread/VMwrite (and bulk/range) and every demand fault of walk(), or call access()
+ * and fault() directly.
+ *
+ *   - the miss-ratio curve: the misses of an LRU memory of c frames, for each c at once, from the
+ *     reuse (stack) distances of a spatially hashed sample of the pages (SHARDS). one replay gives
+ *     what a sweep over NUM_FRAMES would only approximate with one replay per size (the simulator's
+ *     own eviction rule is not LRU, which is what fault() is there to compare against).
+ *   - the working set per window of accesses: the distinct pages it touched, estimated from the sample.
+ *   - the hot pages (Space-Saving counters over every access) and how many pages were accessed
+ *     1, 2-3, 4-7, ... times (from the sample).
+ *
+ * pages are the keys the simulator passes: the address space number above the page number.
+ */
+class AccessAnalyzer
+{
+public:
+    explicit AccessAnalyzer(const AnalyticsConfig &config = AnalyticsConfig());
+
+    /* forgets everything seen */
+    void reset();
+
+    /* one reference to 'page', then 'count' more right after it (reuse distance 0) */
+    void access(uint64_t page);
+    void repeat(uint64_t page, uint64_t count);
+
+    /* the simulator mapped a page on demand */
+    void fault();
+
+    uint64_t accesses() const { return accesses_; }
+    uint64_t faults() const { return faults_; }
+
+    /* the rate the sample is taken at now (at most AnalyticsConfig::samplingRate) */
+    double samplingRate() const { return (double)threshold_ / (1ULL << ANALYTICS_HASH_BITS); }
+
+    struct CurvePoint
+    {
+        uint64_t frames;
+        double missRatio; // misses per access of an LRU memory of that many frames
+    };
+
+    struct Window
+    {
+        uint64_t accesses;
+        uint64_t workingSet; // distinct pages, estimated
+        uint64_t faults;     // of the simulator
+    };
+
+    struct HotPage
+    {
+        uint64_t page;
+        uint64_t accesses; // an upper bound, at most 'error' above the real count
+        uint64_t error;
+    };
+
+    std::vector<CurvePoint> missRatioCurve() const;
+
+    /* the complete windows, oldest first (the last ANALYTICS_WINDOWS of them) */
+    std::vector<Window> windows() const;
+
+    /* most accessed first */
+    std::vector<HotPage> hotPages() const;
+
+    /* entry i: pages accessed 2^i .. 2^(i+1) - 1 times, estimated */
+    std::vector<uint64_t> frequencyHistogram() const;
+
+private:
+    struct Sample
+    {
+        uint64_t hash;
+        uint64_t time;   // slot of its last access in the distance tree
+        uint64_t count;  // accesses
+        uint64_t window; // the last window it was counted in
+    };
+
+    void sampledAccess(Sample &sample, bool known);
+    void lowerRate();
+    void compact();
+    void mark(uint64_t time, int64_t delta);
+    uint64_t marksUpTo(uint64_t time) const;
+    void countHot(uint64_t page, uint64_t count);
+    void closeWindow();
+
+    AnalyticsConfig config_;
+    uint64_t bucketFrames_;
+
+    uint64_t accesses_ = 0;
+    uint64_t faults_ = 0;
+
+    /* SHARDS: pages whose hash is below the threshold, and their hashes in order (largest evicted first) */
+    uint64_t threshold_;
+    std::unordered_map<uint64_t, Sample> samples_;
+    std::set<std::pair<uint64_t, uint64_t>> byHash_;
+
+    /* Mattson: a Fenwick tree over access slots, one mark per sampled page at its last access, so the
+     * reuse distance is the number of marks after the previous access. renumbered when slots run out */
+    std::vector<int64_t> tree_;
+    uint64_t now_ = 0;
+
+    /* sampled references per distance bucket (curvePoints of them, then the ones beyond), and first
+     * references; rescaled each time the rate drops, so they always count at the current rate */
+    std::vector<double> distances_;
+    double coldReferences_ = 0;
+
+    uint64_t window_ = 0;
+    uint64_t windowAccesses_ = 0;
+    uint64_t windowSampled_ = 0;
+    uint64_t windowFaults_ = 0;
+    std::vector<Window> windows_; // a ring once full
+    uint64_t windowsClosed_ = 0;
+
+    std::vector<HotPage> hot_;
+    std::unordered_map<uint64_t, uint64_t> hotIndex_;
+};
+
+struct VMContext; // VMContext.h
+
+/*
+ * starts (or, with nullptr, stops) analyzing the accesses made through the given context (the
+ * default one without it). the analyzer must outlive the analysis. accesses from the threads of a
+ * concurrent context (VMConfig::concurrent) are not analyzed.
+ */
+void VManalyze(VMContext &context, AccessAnalyzer *analyzer);
+void VManalyze(AccessAnalyzer *analyzer);
+
+/*
+ * prints the curve, the windows, the hot pages and the frequency histogram as aligned tables.
+ */
+void printAnalytics(std::ostream &out, const AccessAnalyzer &analyzer);
@@ -0,0 +1,353 @@
+#include "Checkpoint.h"
+#include "VMContext.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the counters are saved as the raw words of the struct
+static_assert(sizeof(VMStats) % sizeof(uint64_t) == 0, "VMStats must be made of whole words");
+#define STATS_WORDS (sizeof(VMStats) / sizeof(uint64_t))
+
+// the magic and the header words
+#define IMAGE_HEADER_BYTES (IMAGE_MAGIC_SIZE + IMAGE_HEADER_WORDS * sizeof(uint64_t))
+
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+}
+
+static bool isPowerOf2(uint64_t n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+/**
+ * appends the elements of an unordered set sorted, so the same simulation always gives the same image.
+ **/
+static void saveSet(ImageWords &words, const std::unordered_set<uint64_t> &set)
+{
+    std::vector<uint64_t> sorted(set.begin(), set.end());
+    std::sort(sorted.begin(), sorted.end());
+    words.push_back(sorted.size());
+    words.insert(words.end(), sorted.begin(), sorted.end());
+}
+
+static void loadSet(ImageReader &words, std::unordered_set<uint64_t> &set)
+{
+    set.clear();
+    for (uint64_t n = words.count(); n != 0; --n) set.insert(words.next());
+}
+
+/* ===================================================================== */
+/*                              STATE WORDS                              */
+/* ===================================================================== */
+
+/**
+ * the layout and the tunables come first: restore needs them to rebuild the simulation the rest fits.
+ **/
+static void saveConfig(ImageWords &words, const VMContext &ctx)
+{
+    const Geometry &layout = ctx.geometry;
+    const VMConfig &config = ctx.config;
+    for (uint64_t word : {layout.offsetWidth, layout.physicalAddressWidth, layout.virtualAddressWidth,
+                          config.tlbSets, config.tlbWays, config.walkCacheEntries, (uint64_t)config.allocator,
+                          (uint64_t)config.lazyReads, (uint64_t)config.eviction, config.hugeOrder,
+                          config.addressSpaces, (uint64_t)config.evictionScope, config.prefetchWindow,
+                          config.swapWorkers, (uint64_t)config.concurrent})
+    {
+        words.push_back(word);
+    }
+}
+
+/**
+ * reads what saveConfig wrote. returns false unless it is a layout and a configuration VMinitialize
+ * accepts (so that restoring a corrupt image asserts nowhere).
+ **/
+static bool loadConfig(ImageReader &words, Geometry &layout, VMConfig &config)
+{
+    uint64_t offsetWidth = words.next();
+    uint64_t physicalWidth = words.next();
+    uint64_t virtualWidth = words.next();
+    if (words.failed() || offsetWidth == 0 || physicalWidth <= offsetWidth || virtualWidth <= offsetWidth ||
+        virtualWidth >= 64 || physicalWidth - offsetWidth >= WORD_WIDTH - 1)
+    {
+        return false;
+    }
+    layout = Geometry(offsetWidth, physicalWidth, virtualWidth);
+
+    config = VMConfig();
+    config.tlbSets = words.next();
+    config.tlbWays = words.next();
+    config.walkCacheEntries = words.next();
+    uint64_t allocator = words.next();
+    config.lazyReads = words.next() != 0;
+    uint64_t eviction = words.next();
+    config.hugeOrder = words.next();
+    config.addressSpaces = words.next();
+    uint64_t scope = words.next();
+    config.prefetchWindow = words.next();
+    config.swapWorkers = words.next();
+    config.concurrent = words.next() != 0;
+    if (words.failed() || allocator > ALLOCATOR_CHECKED || eviction > EVICT_WEIGHTED || scope > EVICT_LOCAL ||
+        config.swapWorkers > SWAP_MAX_WORKERS)
+    {
+        return false;
+    }
+    config.allocator = (AllocatorMode)allocator;
+    config.eviction = (EvictionPolicyKind)eviction;
+    config.evictionScope = (EvictionScope)scope;
+
+    uint64_t spaceBits = 0;
+    while ((1ULL << spaceBits) < config.addressSpaces) spaceBits++;
+    bool sound = (config.tlbWays == 0 || isPowerOf2(config.tlbSets)) &&
+                 (config.walkCacheEntries == 0 || isPowerOf2(config.walkCacheEntries)) &&
+                 config.addressSpaces >= 1 && config.addressSpaces < layout.numFrames && virtualWidth + spaceBits < 64 &&
+                 config.hugeOrder < layout.tablesDepth;
+    if (sound && config.hugeOrder != 0)
+    {
+        sound = config.allocator == ALLOCATOR_INCREMENTAL && config.eviction == EVICT_CYCLIC &&
+                config.addressSpaces == 1 && (1ULL << (offsetWidth * config.hugeOrder)) < layout.numFrames;
+    }
+    if (sound && config.concurrent)
+    {
+        sound = config.eviction == EVICT_CYCLIC && config.addressSpaces == 1 && config.hugeOrder == 0 &&
+                config.prefetchWindow == 0;
+    }
+    return sound;
+}
+
+/**
+ * the counters and dirty bits of the physical memory (its RAM and swap are sections of their own).
+ **/
+static void saveMemory(ImageWords &words, const PhysicalMemory &memory)
+{
+    words.push_back(memory.evictions());
+    words.push_back(memory.writeBacks());
+
+    uint64_t frames = memory.layout().numFrames;
+    words.push_back(frames);
+    for (uint64_t first = 0; first < frames; first += 64)
+    {
+        uint64_t bits = 0;
+        for (uint64_t frame = first; frame < std::min(first + 64, frames); ++frame)
+            bits |= (uint64_t)memory.isDirty(frame) << (frame - first);
+        words.push_back(bits);
+    }
+}
+
+static bool loadMemory(ImageReader &words, const Geometry &layout, uint64_t &evictions, uint64_t &writeBacks,
+                       std::vector<uint8_t> &dirty)
+{
+    evictions = words.next();
+    writeBacks = words.next();
+    words.expect(layout.numFrames);
+    if (words.failed()) return false;
+
+    dirty.assign(layout.numFrames, 0);
+    for (uint64_t first = 0; first < layout.numFrames; first += 64)
+    {
+        uint64_t bits = words.next();
+        for (uint64_t frame = first; frame < std::min(first + 64, layout.numFrames); ++frame)
+            dirty[frame] = (bits >> (frame - first)) & 1;
+    }
+    return !words.failed();
+}
+
+/**
+ * everything else of the context, in the order loadState reads it. returns false if a policy
+ * cannot be saved.
+ **/
+static bool saveState(ImageWords &words, const VMContext &ctx)
+{
+    words.push_back(ctx.asid);
+    words.push_back(ctx.forked);
+    words.push_back(ctx.pageFaults);
+    uint64_t stats[STATS_WORDS];
+    std::memcpy(stats, &ctx.stats, sizeof(VMStats));
+    words.insert(words.end(), stats, stats + STATS_WORDS);
+
+    for (const SwapLineage &lineage : ctx.lineage)
+    {
+        words.push_back(lineage.origin);
+        saveSet(words, lineage.own);
+    }
+    saveSet(words, ctx.hugeRegions);
+
+    ctx.frameTable.save(words);
+    for (const std::unique_ptr<EvictionPolicy> &policy : ctx.policies)
+    {
+        if (!policy->save(words)) return false;
+    }
+    ctx.prefetcher.save(words);
+    return true;
+}
+
+/**
+ * reads what saveState wrote into a context VMresetState just configured. returns false if the
+ * words do not fit that configuration, or do not end with it.
+ **/
+static bool loadState(VMContext &ctx, ImageReader &words)
+{
+    uint64_t spaces = ctx.config.addressSpaces;
+    uint64_t asid = words.next();
+    if (asid >= spaces) return false;
+    ctx.asid = asid;
+    ctx.spaceBase = asid << ctx.pageBits;
+    ctx.forked = words.next() != 0;
+    ctx.pageFaults = words.next();
+
+    /* the counters, but this build's flags saying what it counts */
+    uint64_t stats[STATS_WORDS];
+    for (uint64_t &word : stats) word = words.next();
+    bool counting = ctx.stats.counting;
+    bool timing = ctx.stats.timing;
+    std::memcpy(&ctx.stats, stats, sizeof(VMStats));
+    ctx.stats.counting = counting;
+    ctx.stats.timing = timing;
+
+    for (uint64_t space = 0; space < spaces; ++space)
+    {
+        SwapLineage &lineage = ctx.lineage[space];
+        lineage.origin = words.next();
+        if (lineage.origin == space || (lineage.origin >= spaces && lineage.origin != UINT64_MAX)) return false;
+        loadSet(words, lineage.own);
+    }
+    loadSet(words, ctx.hugeRegions);
+    if (words.failed() || !ctx.frameTable.load(words)) return false;
+
+    for (std::unique_ptr<EvictionPolicy> &policy : ctx.policies)
+    {
+        if (!policy->load(words)) return false;
+    }
+    return ctx.prefetcher.load(words) && !words.failed() && words.atEnd();
+}
+
+/* ===================================================================== */
+/*                           CHECKPOINT / RESTORE                        */
+/* ===================================================================== */
+
+bool VMcheckpoint(const VMContext &ctx, const std::string &path)
+{
+    if (ctx.config.customEviction) return false;
+
+    const PhysicalMemory &memory = *ctx.memory;
+    ImageWords words;
+    saveConfig(words, ctx);
+    saveMemory(words, memory);
+    if (!saveState(words, ctx)) return false;
+
+    uint64_t ramOffset = alignUp(IMAGE_HEADER_BYTES + words.size() * sizeof(uint64_t));
+    uint64_t ramBytes = ctx.geometry.ramSize * sizeof(word_t);
+    uint64_t swapOffset = alignUp(ramOffset + ramBytes);
+    uint64_t swapBytes = MappedSwapStore::imageBytes(memory.swapLayout());
+    uint64_t header[IMAGE_HEADER_WORDS] = {IMAGE_VERSION, sizeof(word_t), words.size(), ramOffset, ramBytes,
+                                           swapOffset, swapBytes};
+
+    /* written beside 'path' and renamed over it, so an image the simulation was restored from is never
+     * truncated: its inode lives on behind the private mapping of the swap */
+    std::string temporary = path + ".tmp";
+    std::FILE *file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    /* the sections in file order; the gaps before the RAM and the swap stay holes */
+    bool written = std::fwrite(IMAGE_MAGIC, 1, IMAGE_MAGIC_SIZE, file) == IMAGE_MAGIC_SIZE &&
+                   std::fwrite(header, sizeof(uint64_t), IMAGE_HEADER_WORDS, file) == IMAGE_HEADER_WORDS &&
+                   std::fwrite(words.data(), sizeof(uint64_t), words.size(), file) == words.size() &&
+                   std::fseek(file, (long)ramOffset, SEEK_SET) == 0 &&
+                   std::fwrite(memory.ram(), 1, ramBytes, file) == ramBytes && std::fflush(file) == 0 &&
+                   MappedSwapStore::writeImage(fileno(file), swapOffset, memory.swapLayout(), memory.swap());
+    if (std::fclose(file) != 0) written = false;
+    if (written && std::rename(temporary.c_str(), path.c_str()) == 0) return true;
+    std::remove(temporary.c_str());
+    return false;
+}
+
+bool VMrestore(VMContext &ctx, const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    /* the header must describe sections that lie, aligned and in order, inside the file */
+    char magic[IMAGE_MAGIC_SIZE];
+    uint64_t header[IMAGE_HEADER_WORDS] = {};
+    struct stat info;
+    bool sound = fstat(fd, &info) == 0 && pread(fd, magic, IMAGE_MAGIC_SIZE, 0) == IMAGE_MAGIC_SIZE &&
+                 pread(fd, header, sizeof(header), IMAGE_MAGIC_SIZE) == (ssize_t)sizeof(header) &&
+                 std::memcmp(magic, IMAGE_MAGIC, IMAGE_MAGIC_SIZE) == 0;
+    uint64_t stateWords = header[2], ramOffset = header[3], ramBytes = header[4];
+    uint64_t swapOffset = header[5], swapBytes = header[6];
+    sound = sound && header[0] == IMAGE_VERSION && header[1] == sizeof(word_t) &&
+            ramOffset % IMAGE_ALIGNMENT == 0 && swapOffset % IMAGE_ALIGNMENT == 0 &&
+            ramOffset >= IMAGE_HEADER_BYTES && stateWords <= (ramOffset - IMAGE_HEADER_BYTES) / sizeof(uint64_t) &&
+            swapOffset >= ramOffset && ramBytes <= swapOffset - ramOffset &&
+            swapOffset <= (uint64_t)info.st_size && swapBytes <= (uint64_t)info.st_size - swapOffset;
+    if (!sound)
+    {
+        close(fd);
+        return false;
+    }
+
+    /* the state words and the RAM are read through one mapping; the swap gets its own below */
+    void *mapping = mmap(nullptr, swapOffset, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    const char *image = static_cast<const char *>(mapping);
+    ImageReader words(reinterpret_cast<const uint64_t *>(image + IMAGE_HEADER_BYTES), stateWords);
+
+    Geometry layout;
+    VMConfig config;
+    uint64_t evictions = 0, writeBacks = 0;
+    std::vector<uint8_t> dirty;
+    sound = loadConfig(words, layout, config) && loadMemory(words, layout, evictions, writeBacks, dirty);
+    Geometry swapLayout = sound ? PhysicalMemory::swapLayoutFor(layout, config.addressSpaces) : layout;
+    sound = sound && ramBytes == layout.ramSize * sizeof(word_t) &&
+            swapBytes == MappedSwapStore::imageBytes(swapLayout);
+
+    /* a dry run on a scratch context (whose small memory it never touches), so that a bad image
+     * leaves 'ctx' as it was */
+    config.swap = SWAP_MAPPED;
+    if (sound)
+    {
+        VMContext scratch;
+        VMresetState(scratch, layout, config);
+        ImageReader check = words;
+        sound = loadState(scratch, check);
+    }
+    if (!sound)
+    {
+        munmap(mapping, swapOffset);
+        close(fd);
+        return false;
+    }
+
+    /* the swap VMinitialize would build is replaced right away: start from the one that costs nothing */
+    ctx.memory->initialize(layout, SWAP_MAP, "", config.addressSpaces, config.swapWorkers);
+    ctx.memory->adopt(reinterpret_cast<const word_t *>(image + ramOffset), dirty, evictions, writeBacks,
+                      std::unique_ptr<SwapStore>(new MappedSwapStore(swapLayout, fd, swapOffset)));
+    VMresetState(ctx, layout, config);
+    bool loaded = loadState(ctx, words);
+    assert(loaded);
+    (void)loaded;
+
+    munmap(mapping, swapOffset);
+    close(fd); // the swap store holds a descriptor of its own
+    return true;
+}
+
+bool VMcheckpoint(const std::string &path)
+{
+    return VMcheckpoint(VMdefaultContext(), path);
+}
+
+bool VMrestore(const std::string &path)
+{
+    return VMrestore(VMdefaultContext(), path);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct VMContext; // VMContext.h
+
+/*
+ * Simulator images: everything a VMContext holds (RAM, swap, page tables, frame table, eviction
+ * policies, read-ahead state and counters) in one flat file, so a warmed-up simulation can be saved
+ * once and restored for every experiment instead of replaying its warm-up.
+ *
+ * File layout (native byte order and word_t: an image restores on the platform that wrote it):
+ *     the 8-byte magic "VMIMAGE1", then uint64 header words
+ *         version, sizeof(word_t), state words, RAM offset, RAM bytes, swap offset, swap bytes
+ *     the state words, right after the header
+ *     the RAM, at an IMAGE_ALIGNMENT boundary
+ *     the swap, at an IMAGE_ALIGNMENT boundary, in the layout of a SWAP_MAPPED store (sparse)
+ * Restoring maps the swap region copy-on-write instead of rebuilding the store page by page.
+ */
+#define IMAGE_MAGIC "VMIMAGE1"
+#define IMAGE_MAGIC_SIZE 8
+#define IMAGE_VERSION 3
+#define IMAGE_HEADER_WORDS 7
+// sections start on this boundary, so the swap region can be mapped wherever OS pages are up to this size
+#define IMAGE_ALIGNMENT (64 * 1024)
+
+/*
+ * The state words of an image. Every component appends its own with save() and reads them back with
+ * load(), in the same order, right after it was reset to the same layout.
+ */
+typedef std::vector<uint64_t> ImageWords;
+
+class ImageReader
+{
+public:
+    ImageReader(const uint64_t *words, size_t count) : cursor_(words), end_(words + count) {}
+
+    /*
+     * the next word, or 0 once the words ran out (which fails the reader).
+     */
+    uint64_t next()
+    {
+        if (cursor_ == end_)
+        {
+            failed_ = true;
+            return 0;
+        }
+        return *cursor_++;
+    }
+
+    /*
+     * the next word as the number of items of 'width' words that follow it. fails the reader (and
+     * returns 0) if they cannot all fit in the words left, so a corrupt count never allocates.
+     */
+    uint64_t count(uint64_t width = 1)
+    {
+        uint64_t n = next();
+        if (width != 0 && n > (uint64_t)(end_ - cursor_) / width)
+        {
+            failed_ = true;
+            return 0;
+        }
+        return n;
+    }
+
+    /*
+     * checks a word that must hold 'expected' (a layout the component was reset to).
+     */
+    void expect(uint64_t expected)
+    {
+        if (next() != expected) failed_ = true;
+    }
+
+    void fail() { failed_ = true; }
+    bool failed() const { return failed_; }
+    bool atEnd() const { return cursor_ == end_; }
+
+private:
+    const uint64_t *cursor_;
+    const uint64_t *end_;
+    bool failed_ = false;
+};
+
+/*
+ * writes an image of the simulation (the default one without a context) to 'path', replacing it
+ * only once the whole image is written ('path' may be the image the simulation was restored from:
+ * its swap keeps reading the old one). the image is first written to 'path' + ".tmp".
+ * returns false if the file cannot be written, or the simulation uses a custom eviction policy
+ * (VMConfig::customEviction), whose state the image cannot hold.
+ */
+bool VMcheckpoint(const VMContext &context, const std::string &path);
+bool VMcheckpoint(const std::string &path);
+
+/*
+ * replaces the simulation (the default one without a context) by the one saved in 'path': afterwards
+ * every access behaves exactly as it would have in the simulation that was saved. the swap becomes a
+ * private mapping of the image (config.swap reads SWAP_MAPPED): pages are read from the file on demand,
+ * and what the simulation writes to swap never reaches it, so one image serves any number of restores.
+ * the TLB and the paging-structure cache start cold; a recorder (VMrecord) stays attached.
+ * returns false, leaving the simulation as it was, if the file cannot be mapped or is not a sound image.
+ */
+bool VMrestore(VMContext &context, const std::string &path);
+bool VMrestore(const std::string &path);
@@ -0,0 +1,166 @@
+#include "Compression.h"
+#include <cstring>
+
+// LZ4 block format constants: shortest match, literals that must end a block, and the distance from
+// the end of the block within which no match may start
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+// match finder: positions remembered per 4-byte prefix hash, in a table of 1 << bits entries that
+// grows with the input between these bounds
+#define LZ4_MIN_HASH_BITS 6
+#define LZ4_HASH_BITS 12
+
+/* ===================================================================== */
+/*                             LZ4 BLOCKS                                */
+/* ===================================================================== */
+
+/*
+ * A block is a list of sequences: a token byte (literal count in the high nibble, match length - 4
+ * in the low one, 15 meaning more length bytes follow), the literals, then a 2-byte little-endian
+ * match offset and the match length bytes. The last sequence is literals only.
+ */
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash32(uint32_t sequence, unsigned bits)
+{
+    return (sequence * 2654435761U) >> (32 - bits);
+}
+
+/**
+ * the bytes a length of 'length' takes beyond its nibble (15 and above spill into 255-valued bytes).
+ **/
+static inline size_t lengthBytes(size_t length)
+{
+    return length < 15 ? 0 : (length - 15) / 255 + 1;
+}
+
+static inline uint8_t *putLength(uint8_t *out, size_t length)
+{
+    if (length < 15) return out;
+    for (length -= 15; length >= 255; length -= 255) *out++ = 255;
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+/**
+ * appends a sequence: 'literals' bytes from 'from', then (if matchLength != 0) a match.
+ * @return the new end of the output, or nullptr if it would pass 'end'.
+ **/
+static uint8_t *putSequence(uint8_t *out, uint8_t *end, const uint8_t *from, size_t literals,
+                            size_t offset, size_t matchLength)
+{
+    size_t needed = 1 + lengthBytes(literals) + literals;
+    if (matchLength != 0) needed += 2 + lengthBytes(matchLength - LZ4_MIN_MATCH);
+    if ((size_t)(end - out) < needed) return nullptr;
+
+    uint8_t *token = out++;
+    *token = (uint8_t)((literals < 15 ? literals : 15) << 4);
+    out = putLength(out, literals);
+    if (literals != 0) std::memcpy(out, from, literals);
+    out += literals;
+    if (matchLength == 0) return out;
+
+    *out++ = (uint8_t)offset;
+    *out++ = (uint8_t)(offset >> 8);
+    size_t extra = matchLength - LZ4_MIN_MATCH;
+    *token |= (uint8_t)(extra < 15 ? extra : 15);
+    return putLength(out, extra);
+}
+
+size_t lz4Compress(const uint8_t *in, size_t size, uint8_t *out, size_t capacity)
+{
+    uint8_t *cursor = out;
+    uint8_t *end = out + capacity;
+    size_t anchor = 0; // first byte not covered by a sequence yet
+
+    if (size > LZ4_MATCH_LIMIT)
+    {
+        /* the position + 1 of the last prefix with each hash (0: none yet); a small page clears a small table */
+        unsigned bits = LZ4_MIN_HASH_BITS;
+        while (bits < LZ4_HASH_BITS && ((size_t)1 << bits) < size) bits++;
+        uint32_t positions[1 << LZ4_HASH_BITS];
+        std::memset(positions, 0, sizeof(uint32_t) << bits);
+
+        size_t position = 0;
+        while (position + LZ4_MATCH_LIMIT <= size)
+        {
+            uint32_t sequence = read32(in + position);
+            uint32_t &slot = positions[hash32(sequence, bits)];
+            size_t candidate = slot;
+            slot = (uint32_t)(position + 1);
+            if (candidate == 0 || position - (candidate - 1) > LZ4_MAX_OFFSET || read32(in + candidate - 1) != sequence)
+            {
+                position++;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = LZ4_MIN_MATCH;
+            while (position + length < size - LZ4_LAST_LITERALS && in[match + length] == in[position + length]) length++;
+
+            cursor = putSequence(cursor, end, in + anchor, position - anchor, position - match, length);
+            if (cursor == nullptr) return 0;
+            position += length;
+            anchor = position;
+        }
+    }
+
+    cursor = putSequence(cursor, end, in + anchor, size - anchor, 0, 0);
+    return cursor == nullptr ? 0 : (size_t)(cursor - out);
+}
+
+/**
+ * reads the bytes of a length beyond its nibble. false if the input ends inside it.
+ **/
+static inline bool getLength(const uint8_t *&in, const uint8_t *end, size_t &length)
+{
+    if (length != 15) return true;
+    uint8_t byte;
+    do
+    {
+        if (in == end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz4Decompress(const uint8_t *in, size_t size, uint8_t *out, size_t outSize)
+{
+    const uint8_t *end = in + size;
+    size_t written = 0;
+    while (in < end)
+    {
+        uint8_t token = *in++;
+
+        size_t literals = token >> 4;
+        if (!getLength(in, end, literals) || literals > (size_t)(end - in) || literals > outSize - written) return false;
+        if (literals != 0) std::memcpy(out + written, in, literals);
+        in += literals;
+        written += literals;
+        if (in == end) break; // the last sequence has no match
+
+        if (end - in < 2) return false;
+        size_t offset = in[0] | (size_t)in[1] << 8;
+        in += 2;
+        size_t length = token & 15;
+        if (!getLength(in, end, length)) return false;
+        length += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > written || length > outSize - written) return false;
+
+        /* the match may overlap the bytes it produces (offset < length repeats a pattern) */
+        const uint8_t *from = out + written - offset;
+        if (offset >= length) std::memcpy(out + written, from, length);
+        else for (size_t i = 0; i < length; ++i) out[written + i] = from[i];
+        written += length;
+    }
+    return written == outSize;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * The LZ4 block codec of the SWAP_COMPRESSED store (its same-value pages are found by PageKernels).
+ * It writes and reads the standard LZ4 block format (no frame header), built in so the simulator
+ * needs no external library.
+ */
+
+/*
+ * compresses the 'size' bytes at 'in' into at most 'capacity' bytes at 'out'.
+ * returns the compressed size, or 0 if it does not fit in 'capacity'.
+ */
+size_t lz4Compress(const uint8_t *in, size_t size, uint8_t *out, size_t capacity);
+
+/*
+ * decompresses the 'size' bytes of one block at 'in' into exactly 'outSize' bytes at 'out'.
+ * returns false, leaving 'out' undefined, if the block is malformed or does not expand to 'outSize'.
+ */
+bool lz4Decompress(const uint8_t *in, size_t size, uint8_t *out, size_t outSize);
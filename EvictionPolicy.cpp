@@ -0,0 +1,389 @@
+#include "EvictionPolicy.h"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+std::unique_ptr<EvictionPolicy> makeEvictionPolicy(EvictionPolicyKind kind)
+{
+    switch (kind)
+    {
+        case EVICT_CYCLIC:
+            return nullptr;
+        case EVICT_CLOCK:
+            return std::unique_ptr<EvictionPolicy>(new ClockPolicy());
+        case EVICT_LRU:
+            return std::unique_ptr<EvictionPolicy>(new LruPolicy());
+        case EVICT_ARC:
+            return std::unique_ptr<EvictionPolicy>(new ArcPolicy());
+        case EVICT_WEIGHTED:
+            return std::unique_ptr<EvictionPolicy>(new WeightedPolicy());
+    }
+    assert(false);
+    return nullptr;
+}
+
+/* ===================================================================== */
+/*                                 CLOCK                                 */
+/* ===================================================================== */
+
+void ClockPolicy::reset(const Geometry &layout, const FrameTable &frames)
+{
+    (void)frames;
+    resident_.assign(layout.numFrames, false);
+    referenced_.assign(layout.numFrames, false);
+    residentCount_ = 0;
+    hand_ = 1; // frame 0 is the root
+}
+
+void ClockPolicy::onMap(uint64_t page, uint64_t frame)
+{
+    (void)page;
+    assert(!resident_[frame]);
+    resident_[frame] = true;
+    referenced_[frame] = false; // the faulting access sets it
+    residentCount_++;
+}
+
+void ClockPolicy::onUnmap(uint64_t page, uint64_t frame)
+{
+    (void)page;
+    assert(resident_[frame]);
+    resident_[frame] = false;
+    referenced_[frame] = false;
+    residentCount_--;
+}
+
+uint64_t ClockPolicy::selectVictim(uint64_t targetPage)
+{
+    (void)targetPage;
+    if (residentCount_ == 0) return UINT64_MAX;
+
+    /* at most one full turn clears every reference bit, so the second turn always stops */
+    for (;;)
+    {
+        uint64_t frame = hand_;
+        hand_ = (hand_ + 1 < resident_.size()) ? hand_ + 1 : 1;
+        if (!resident_[frame]) continue;
+        if (!referenced_[frame]) return frame;
+        referenced_[frame] = false;
+    }
+}
+
+bool ClockPolicy::save(ImageWords &words) const
+{
+    words.push_back(hand_);
+    words.push_back(resident_.size());
+    for (uint64_t frame = 0; frame < resident_.size(); ++frame)
+        words.push_back((uint64_t)resident_[frame] | (uint64_t)referenced_[frame] << 1);
+    return true;
+}
+
+bool ClockPolicy::load(ImageReader &words)
+{
+    uint64_t hand = words.next();
+    if (hand == 0 || hand >= resident_.size() || words.count() != resident_.size()) return false;
+
+    hand_ = hand;
+    residentCount_ = 0;
+    for (uint64_t frame = 0; frame < resident_.size(); ++frame)
+    {
+        uint64_t bits = words.next();
+        resident_[frame] = bits & 1;
+        referenced_[frame] = bits & 2;
+        residentCount_ += bits & 1;
+    }
+    return !words.failed();
+}
+
+/* ===================================================================== */
+/*                                  LRU                                  */
+/* ===================================================================== */
+
+void LruPolicy::reset(const Geometry &layout, const FrameTable &frames)
+{
+    (void)frames;
+    prev_.assign(layout.numFrames, UINT64_MAX);
+    next_.assign(layout.numFrames, UINT64_MAX);
+    prev_[0] = next_[0] = 0; // empty circular list around the sentinel
+}
+
+void LruPolicy::unlinkNode(uint64_t frame)
+{
+    next_[prev_[frame]] = next_[frame];
+    prev_[next_[frame]] = prev_[frame];
+}
+
+void LruPolicy::pushFront(uint64_t frame)
+{
+    prev_[frame] = 0;
+    next_[frame] = next_[0];
+    prev_[next_[0]] = frame;
+    next_[0] = frame;
+}
+
+void LruPolicy::onAccess(uint64_t page, uint64_t frame)
+{
+    (void)page;
+    if (next_[0] == frame) return; // already the most recent, the common case
+    unlinkNode(frame);
+    pushFront(frame);
+}
+
+void LruPolicy::onMap(uint64_t page, uint64_t frame)
+{
+    (void)page;
+    assert(next_[frame] == UINT64_MAX);
+    pushFront(frame);
+}
+
+void LruPolicy::onUnmap(uint64_t page, uint64_t frame)
+{
+    (void)page;
+    unlinkNode(frame);
+    prev_[frame] = next_[frame] = UINT64_MAX;
+}
+
+uint64_t LruPolicy::selectVictim(uint64_t targetPage)
+{
+    (void)targetPage;
+    return prev_[0] == 0 ? UINT64_MAX : prev_[0];
+}
+
+bool LruPolicy::save(ImageWords &words) const
+{
+    words.push_back(prev_.size());
+    words.insert(words.end(), prev_.begin(), prev_.end());
+    words.insert(words.end(), next_.begin(), next_.end());
+    return true;
+}
+
+bool LruPolicy::load(ImageReader &words)
+{
+    if (words.count(2) != prev_.size()) return false;
+
+    for (uint64_t &link : prev_) link = words.next();
+    for (uint64_t &link : next_) link = words.next();
+    for (uint64_t frame = 0; frame < prev_.size(); ++frame)
+    {
+        if ((prev_[frame] == UINT64_MAX) != (next_[frame] == UINT64_MAX)) return false;
+        if (prev_[frame] != UINT64_MAX && (prev_[frame] >= prev_.size() || next_[frame] >= next_.size())) return false;
+    }
+    return !words.failed();
+}
+
+/* ===================================================================== */
+/*                                  ARC                                  */
+/* ===================================================================== */
+
+void ArcPolicy::reset(const Geometry &layout, const FrameTable &frames)
+{
+    (void)frames;
+    capacity_ = layout.numFrames - 1; // every frame but the root can end up holding a page
+    target_ = 0;
+    for (std::list<uint64_t> &list : lists_) list.clear();
+    entries_.clear();
+}
+
+void ArcPolicy::moveToFront(Entry &entry, ListId list)
+{
+    lists_[list].splice(lists_[list].begin(), lists_[entry.list], entry.position);
+    entry.list = list;
+    entry.position = lists_[list].begin();
+}
+
+void ArcPolicy::dropLru(ListId list)
+{
+    entries_.erase(lists_[list].back());
+    lists_[list].pop_back();
+}
+
+uint64_t ArcPolicy::adaptedTarget(uint64_t page) const
+{
+    auto it = entries_.find(page);
+    if (it == entries_.end()) return target_;
+
+    uint64_t b1 = lists_[B1].size();
+    uint64_t b2 = lists_[B2].size();
+    if (it->second.list == B1)
+    {
+        uint64_t delta = std::max<uint64_t>(1, b2 / b1);
+        return std::min(capacity_, target_ + delta);
+    }
+    if (it->second.list == B2)
+    {
+        uint64_t delta = std::max<uint64_t>(1, b1 / b2);
+        return target_ > delta ? target_ - delta : 0;
+    }
+    return target_;
+}
+
+void ArcPolicy::onAccess(uint64_t page, uint64_t frame)
+{
+    (void)frame;
+    Entry &entry = entries_.find(page)->second;
+    if (entry.fresh)
+    {
+        entry.fresh = false;
+        return;
+    }
+    moveToFront(entry, T2); // a hit: T1 -> T2, or refresh in T2
+}
+
+void ArcPolicy::onMap(uint64_t page, uint64_t frame)
+{
+    auto it = entries_.find(page);
+    if (it != entries_.end())
+    {
+        /* a ghost hit: the page was evicted recently, so it has been seen at least twice */
+        assert(it->second.list == B1 || it->second.list == B2);
+        target_ = adaptedTarget(page);
+        moveToFront(it->second, T2);
+        it->second.frame = frame;
+        it->second.fresh = true;
+        return;
+    }
+
+    /* a page never seen (or long forgotten): keep the directory within 2c pages */
+    if (lists_[T1].size() + lists_[B1].size() >= capacity_ && !lists_[B1].empty())
+    {
+        dropLru(B1);
+    }
+    else if (entries_.size() >= 2 * capacity_ && !lists_[B2].empty())
+    {
+        dropLru(B2);
+    }
+
+    lists_[T1].push_front(page);
+    entries_.emplace(page, Entry{T1, lists_[T1].begin(), frame, true});
+}
+
+void ArcPolicy::onUnmap(uint64_t page, uint64_t frame)
+{
+    (void)frame;
+    Entry &entry = entries_.find(page)->second;
+    assert(entry.list == T1 || entry.list == T2);
+    moveToFront(entry, entry.list == T1 ? B1 : B2);
+    entry.frame = UINT64_MAX;
+    entry.fresh = false;
+}
+
+uint64_t ArcPolicy::selectVictim(uint64_t targetPage)
+{
+    if (lists_[T1].empty() && lists_[T2].empty()) return UINT64_MAX;
+
+    uint64_t p = adaptedTarget(targetPage);
+    auto it = entries_.find(targetPage);
+    bool inB2 = it != entries_.end() && it->second.list == B2;
+    uint64_t t1 = lists_[T1].size();
+
+    bool fromT1 = t1 > 0 && (t1 > p || (inB2 && t1 == p) || lists_[T2].empty());
+    uint64_t page = lists_[fromT1 ? T1 : T2].back();
+    return entries_.find(page)->second.frame;
+}
+
+bool ArcPolicy::save(ImageWords &words) const
+{
+    words.push_back(capacity_);
+    words.push_back(target_);
+    for (const std::list<uint64_t> &list : lists_)
+    {
+        words.push_back(list.size());
+        for (uint64_t page : list)
+        {
+            const Entry &entry = entries_.find(page)->second;
+            words.insert(words.end(), {page, entry.frame, (uint64_t)entry.fresh});
+        }
+    }
+    return true;
+}
+
+bool ArcPolicy::load(ImageReader &words)
+{
+    words.expect(capacity_);
+    uint64_t target = words.next();
+    if (words.failed() || target > capacity_) return false;
+
+    target_ = target;
+    for (int list = T1; list < LISTS; ++list)
+    {
+        for (uint64_t n = words.count(3); n != 0; --n)
+        {
+            uint64_t page = words.next();
+            uint64_t frame = words.next();
+            bool fresh = words.next() != 0;
+            bool ghost = (list == B1 || list == B2);
+            if (ghost != (frame == UINT64_MAX) || (!ghost && frame > capacity_) || entries_.count(page) != 0)
+                words.fail();
+            if (words.failed()) break;
+
+            lists_[list].push_back(page);
+            entries_.emplace(page, Entry{(ListId)list, std::prev(lists_[list].end()), frame, fresh});
+        }
+    }
+    return !words.failed();
+}
+
+/* ===================================================================== */
+/*                                WEIGHTED                               */
+/* ===================================================================== */
+
+void WeightedPolicy::reset(const Geometry &layout, const FrameTable &frames)
+{
+    frames_ = &frames;
+    weightOf_.assign(layout.numFrames, 0);
+    byWeight_.clear();
+    frameOf_.clear();
+}
+
+void WeightedPolicy::onMap(uint64_t page, uint64_t frame)
+{
+    /* the path is final once the page is linked, and no table on it moves while the page is resident */
+    uint64_t weight = 0;
+    for (uint64_t node = frame; frames_->depthOf(node) != 0; node = frames_->parentOf(node))
+    {
+        weight += (node % 2 == 0) ? WEIGHT_EVEN : WEIGHT_ODD;
+    }
+    weightOf_[frame] = weight;
+    byWeight_.insert({-(int64_t)weight, page});
+    frameOf_[page] = frame;
+}
+
+void WeightedPolicy::onUnmap(uint64_t page, uint64_t frame)
+{
+    byWeight_.erase({-(int64_t)weightOf_[frame], page});
+    frameOf_.erase(page);
+}
+
+uint64_t WeightedPolicy::selectVictim(uint64_t targetPage)
+{
+    (void)targetPage;
+    if (byWeight_.empty()) return UINT64_MAX;
+    return frameOf_.find(byWeight_.begin()->second)->second;
+}
+
+bool WeightedPolicy::save(ImageWords &words) const
+{
+    /* by weight, so the same simulation always gives the same image */
+    words.push_back(byWeight_.size());
+    for (const auto &entry : byWeight_)
+    {
+        uint64_t frame = frameOf_.find(entry.second)->second;
+        words.insert(words.end(), {entry.second, frame, weightOf_[frame]});
+    }
+    return true;
+}
+
+bool WeightedPolicy::load(ImageReader &words)
+{
+    for (uint64_t n = words.count(3); n != 0; --n)
+    {
+        uint64_t page = words.next();
+        uint64_t frame = words.next();
+        uint64_t weight = words.next();
+        if (frame >= weightOf_.size() || !frameOf_.emplace(page, frame).second) return false;
+
+        weightOf_[frame] = weight;
+        byWeight_.insert({-(int64_t)weight, page});
+    }
+    return !words.failed();
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include "Geometry.h"
+#include "FrameTable.h"
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Built-in choices for priority #3 of allocateFrame().
+ */
+enum EvictionPolicyKind
+{
+    EVICT_CYCLIC,   // max cyclic distance to the faulting page (the original rule, no policy object)
+    EVICT_CLOCK,    // second chance over the frames
+    EVICT_LRU,      // least recently accessed page
+    EVICT_ARC,      // adaptive replacement cache (recency + frequency, with ghost lists)
+    EVICT_WEIGHTED  // heaviest root-to-page path by WEIGHT_EVEN / WEIGHT_ODD
+};
+
+/*
+ * Decides which resident data page to evict when no empty table and no unused frame is left.
+ * The simulator reports every change of residency, and every access when tracksAccesses() is true.
+ * A policy only ever sees data pages; table frames are not its business.
+ * With several address spaces a page number carries its space above the virtual page bits
+ * (space << (virtualAddressWidth - offsetWidth) | page), so pages of different spaces never collide.
+ */
+class EvictionPolicy
+{
+public:
+    virtual ~EvictionPolicy() = default;
+
+    /*
+     * forget everything; called by VMinitialize. 'frames' stays valid for the life of the policy
+     * and describes the tree (parents, rows, prefixes) at the time of every callback.
+     */
+    virtual void reset(const Geometry &layout, const FrameTable &frames) = 0;
+
+    /*
+     * true if onAccess must be called for every word read or written, including TLB hits.
+     * the access that faults a page in is reported too, right after its onMap.
+     */
+    virtual bool tracksAccesses() const { return false; }
+
+    virtual void onAccess(uint64_t page, uint64_t frame) { (void)page; (void)frame; }
+
+    /*
+     * 'page' became resident in 'frame' (after a fault, already linked into the tree).
+     */
+    virtual void onMap(uint64_t page, uint64_t frame) = 0;
+
+    /*
+     * 'page' left 'frame' (it was evicted).
+     */
+    virtual void onUnmap(uint64_t page, uint64_t frame) = 0;
+
+    /*
+     * the frame of the resident page to evict so 'targetPage' can come in, or UINT64_MAX if none is resident.
+     * the chosen page stays tracked until the onUnmap that follows; a policy may still update its
+     * own bookkeeping here (CLOCK moves its hand).
+     */
+    virtual uint64_t selectVictim(uint64_t targetPage) = 0;
+
+    /*
+     * appends the policy's state to an image, and reads it back right after a reset() to the same
+     * layout and frame table. save returns false if the policy cannot be checkpointed (the default);
+     * load returns false if the words are not the state of this policy on this layout.
+     */
+    virtual bool save(ImageWords &words) const { (void)words; return false; }
+    virtual bool load(ImageReader &words) { (void)words; return false; }
+};
+
+/*
+ * builds a policy of a user-defined kind, one per simulation (one per address space under EVICT_LOCAL).
+ */
+typedef std::function<std::unique_ptr<EvictionPolicy>()> EvictionPolicyFactory;
+
+/*
+ * the built-in policy of the given kind, nullptr for EVICT_CYCLIC (handled by the allocator itself).
+ */
+std::unique_ptr<EvictionPolicy> makeEvictionPolicy(EvictionPolicyKind kind);
+
+/* ===================================================================== */
+/*                          BUILT-IN POLICIES                            */
+/* ===================================================================== */
+
+/*
+ * A hand sweeps the frames; a page accessed since the hand last passed gets a second chance.
+ * O(1) per access, amortized O(1) per eviction, no tree traversal.
+ */
+class ClockPolicy : public EvictionPolicy
+{
+public:
+    void reset(const Geometry &layout, const FrameTable &frames) override;
+    bool tracksAccesses() const override { return true; }
+    void onAccess(uint64_t page, uint64_t frame) override { (void)page; referenced_[frame] = true; }
+    void onMap(uint64_t page, uint64_t frame) override;
+    void onUnmap(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t targetPage) override;
+    bool save(ImageWords &words) const override;
+    bool load(ImageReader &words) override;
+
+private:
+    std::vector<bool> resident_;
+    std::vector<bool> referenced_;
+    uint64_t residentCount_ = 0;
+    uint64_t hand_ = 0;
+};
+
+/*
+ * Exact LRU: an intrusive doubly-linked list over frames, most recently used at the head.
+ */
+class LruPolicy : public EvictionPolicy
+{
+public:
+    void reset(const Geometry &layout, const FrameTable &frames) override;
+    bool tracksAccesses() const override { return true; }
+    void onAccess(uint64_t page, uint64_t frame) override;
+    void onMap(uint64_t page, uint64_t frame) override;
+    void onUnmap(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t targetPage) override;
+    bool save(ImageWords &words) const override;
+    bool load(ImageReader &words) override;
+
+private:
+    void unlinkNode(uint64_t frame);
+    void pushFront(uint64_t frame);
+
+    // node 0 is the sentinel: frame 0 is the root table and never holds a page
+    std::vector<uint64_t> prev_;
+    std::vector<uint64_t> next_;
+};
+
+/*
+ * ARC (Megiddo & Modha): resident pages seen once (T1) or more (T2), plus ghost lists of recently
+ * evicted pages (B1, B2) that steer the target size p of T1. The cache size is the number of frames
+ * that can hold data pages.
+ */
+class ArcPolicy : public EvictionPolicy
+{
+public:
+    void reset(const Geometry &layout, const FrameTable &frames) override;
+    bool tracksAccesses() const override { return true; }
+    void onAccess(uint64_t page, uint64_t frame) override;
+    void onMap(uint64_t page, uint64_t frame) override;
+    void onUnmap(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t targetPage) override;
+    bool save(ImageWords &words) const override;
+    bool load(ImageReader &words) override;
+
+private:
+    enum ListId { T1, T2, B1, B2, LISTS };
+
+    struct Entry
+    {
+        ListId list;
+        std::list<uint64_t>::iterator position;
+        uint64_t frame;
+        bool fresh; // mapped but its faulting access not seen yet, which must not count as a hit
+    };
+
+    void moveToFront(Entry &entry, ListId list);
+    void dropLru(ListId list);
+    /* p after a miss on 'page', which grows it on a B1 hit and shrinks it on a B2 hit */
+    uint64_t adaptedTarget(uint64_t page) const;
+
+    uint64_t capacity_ = 0;
+    uint64_t target_ = 0; // p: desired size of T1
+    std::list<uint64_t> lists_[LISTS]; // pages, most recent at the front
+    std::unordered_map<uint64_t, Entry> entries_;
+};
+
+/*
+ * The weighted evacuation rule of MemoryConstants.h: the weight of a resident page is the sum, over
+ * every frame on its path below the root (its tables and its own frame), of WEIGHT_EVEN for an even
+ * frame index and WEIGHT_ODD for an odd one. The heaviest page is evicted, ties go to the lower page.
+ * Weights are fixed while a page is resident, so they are computed once at map time.
+ */
+class WeightedPolicy : public EvictionPolicy
+{
+public:
+    void reset(const Geometry &layout, const FrameTable &frames) override;
+    void onMap(uint64_t page, uint64_t frame) override;
+    void onUnmap(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t targetPage) override;
+    bool save(ImageWords &words) const override;
+    bool load(ImageReader &words) override;
+
+private:
+    const FrameTable *frames_ = nullptr;
+    std::vector<uint64_t> weightOf_; // by frame
+    // (-weight, page) so the heaviest, lowest page comes first
+    std::set<std::pair<int64_t, uint64_t>> byWeight_;
+    std::unordered_map<uint64_t, uint64_t> frameOf_; // page -> frame
+};
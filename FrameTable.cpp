@@ -0,0 +1,337 @@
+#include "FrameTable.h"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+// a record's words in an image: parent, row, prefix, depth, space, children, run, tail | shared << 1
+#define RECORD_WORDS 8
+
+void FrameTable::reset(uint64_t numFrames, uint64_t offsetWidth, uint64_t tablesDepth, uint64_t spaces,
+                       bool indexed, bool trackFree)
+{
+    assert(spaces >= 1 && spaces < numFrames);
+    offsetWidth_ = offsetWidth;
+    tablesDepth_ = tablesDepth;
+    maxFrame_ = spaces - 1;
+    records_.assign(numFrames, Record());
+    for (uint64_t root = 0; root < spaces; ++root)
+    {
+        records_[root].parent = root; // a root is its own owner so it never looks unreferenced
+        records_[root].space = root;
+    }
+    emptyTables_.clear();
+    resident_.assign(spaces, std::map<uint64_t, uint64_t>());
+    indexed_ = indexed;
+    trackFree_ = trackFree;
+    free_.clear();
+    sharers_.clear();
+}
+
+void FrameTable::link(uint64_t parent, uint64_t row, uint64_t child, bool isLeaf)
+{
+    assert(child != 0 && child < records_.size());
+    assert(records_[child].parent == UINT64_MAX);
+
+    Record &owner = records_[parent];
+    if (owner.children++ == 0 && owner.depth != 0 && indexed_)
+        emptyTables_.erase({owner.space, dfsKey(owner), parent});
+
+    Record &record = records_[child];
+    record.parent = parent;
+    record.row = row;
+    record.prefix = (owner.prefix << offsetWidth_) | row;
+    record.depth = owner.depth + 1;
+    record.space = owner.space;
+    record.children = 0;
+
+    if (indexed_)
+    {
+        if (isLeaf) resident_[record.space].emplace(record.prefix, child);
+        else emptyTables_.insert({record.space, dfsKey(record), child});
+    }
+
+    if (trackFree_) free_.erase(child);
+    maxFrame_ = std::max(maxFrame_, child);
+}
+
+void FrameTable::linkRun(uint64_t parent, uint64_t row, uint64_t head, uint64_t frames)
+{
+    assert(head != 0 && frames > 1 && head + frames <= records_.size());
+
+    Record &owner = records_[parent];
+    if (owner.children++ == 0 && owner.depth != 0 && indexed_)
+        emptyTables_.erase({owner.space, dfsKey(owner), parent});
+
+    Record &record = records_[head];
+    assert(record.parent == UINT64_MAX);
+    record.parent = parent;
+    record.row = row;
+    record.prefix = (owner.prefix << offsetWidth_) | row;
+    record.depth = owner.depth + 1;
+    record.space = owner.space;
+    record.children = 0;
+    record.run = frames;
+    if (indexed_) resident_[record.space].emplace(pageOf(head), head);
+
+    for (uint64_t i = 1; i < frames; ++i)
+    {
+        Record &tail = records_[head + i];
+        assert(tail.parent == UINT64_MAX);
+        tail.parent = head;
+        tail.row = i;
+        tail.tail = true;
+    }
+
+    /* the run may start above the old high-water mark: the frames it skipped become free */
+    if (trackFree_)
+    {
+        for (uint64_t frame = maxFrame_ + 1; frame < head; ++frame) free_.insert(frame);
+        for (uint64_t i = 0; i < frames; ++i) free_.erase(head + i);
+    }
+    maxFrame_ = std::max(maxFrame_, head + frames - 1);
+}
+
+void FrameTable::release(uint64_t frame)
+{
+    records_[frame].parent = UINT64_MAX;
+    if (trackFree_) free_.insert(frame);
+}
+
+void FrameTable::unlink(uint64_t child)
+{
+    Record &record = records_[child];
+    assert(record.parent != UINT64_MAX && record.depth != 0); // roots are never unlinked
+
+    if (isLeaf(record))
+    {
+        assert(!record.shared);
+        if (indexed_) resident_[record.space].erase(pageOf(child));
+        for (uint64_t i = 1; i < record.run; ++i)
+        {
+            records_[child + i].tail = false;
+            release(child + i);
+        }
+        record.run = 0;
+    }
+    else
+    {
+        assert(record.children == 0); // only empty tables are ever unlinked
+        if (indexed_) emptyTables_.erase({record.space, dfsKey(record), child});
+    }
+
+    Record &owner = records_[record.parent];
+    if (--owner.children == 0 && owner.depth != 0 && indexed_)
+        emptyTables_.insert({owner.space, dfsKey(owner), record.parent});
+
+    release(child);
+}
+
+void FrameTable::share(uint64_t parent, uint64_t row, uint64_t frame)
+{
+    Record &record = records_[frame];
+    Record &owner = records_[parent];
+    assert(isLeaf(record) && record.run == 0 && record.depth == owner.depth + 1);
+    assert(row == record.row && ((owner.prefix << offsetWidth_) | row) == record.prefix);
+    assert(ownerIn(frame, owner.space) == UINT64_MAX);
+    (void)row;
+
+    if (owner.children++ == 0 && owner.depth != 0 && indexed_)
+        emptyTables_.erase({owner.space, dfsKey(owner), parent});
+
+    sharers_[frame].push_back(parent);
+    record.shared = true;
+    if (indexed_) resident_[owner.space].emplace(record.prefix, frame);
+}
+
+void FrameTable::unshare(uint64_t parent, uint64_t frame)
+{
+    Record &record = records_[frame];
+    assert(record.shared);
+
+    std::vector<uint64_t> &sharers = sharers_[frame];
+    if (parent == record.parent) // the primary owner leaves: the last other one takes over
+    {
+        record.parent = sharers.back();
+        record.space = records_[record.parent].space;
+        sharers.pop_back();
+    }
+    else
+    {
+        auto it = std::find(sharers.begin(), sharers.end(), parent);
+        assert(it != sharers.end());
+        sharers.erase(it);
+    }
+    if (sharers.empty())
+    {
+        sharers_.erase(frame);
+        record.shared = false;
+    }
+
+    Record &owner = records_[parent];
+    if (indexed_) resident_[owner.space].erase(record.prefix);
+    if (--owner.children == 0 && owner.depth != 0 && indexed_)
+        emptyTables_.insert({owner.space, dfsKey(owner), parent});
+}
+
+uint64_t FrameTable::ownerIn(uint64_t frame, uint64_t space) const
+{
+    const Record &record = records_[frame];
+    if (record.space == space) return record.parent;
+    if (!record.shared) return UINT64_MAX;
+    for (uint64_t table : sharers_.at(frame))
+    {
+        if (records_[table].space == space) return table;
+    }
+    return UINT64_MAX;
+}
+
+uint64_t FrameTable::firstEmptyTable(uint64_t excluded) const
+{
+    for (const auto &entry : emptyTables_)
+    {
+        if (std::get<2>(entry) != excluded) return std::get<2>(entry);
+    }
+    return UINT64_MAX;
+}
+
+uint64_t FrameTable::cheapestWindow(uint64_t frames, uint64_t excluded) const
+{
+    uint64_t best = UINT64_MAX;
+    uint64_t bestCost = UINT64_MAX;
+
+    /* window 0 holds the root */
+    for (uint64_t start = frames; start + frames <= records_.size(); start += frames)
+    {
+        uint64_t cost = 0;
+        bool usable = true;
+        for (uint64_t frame = start; frame < start + frames && usable; ++frame)
+        {
+            const Record &record = records_[frame];
+            if (record.parent == UINT64_MAX || record.tail) continue; // free, or paid for by its head
+            if (frame == excluded) usable = false;
+            else if (record.run != 0) cost += record.run;
+            else if (record.depth == tablesDepth_) cost++;
+            else if (record.children != 0) usable = false;
+        }
+        if (usable && cost < bestCost)
+        {
+            best = start;
+            bestCost = cost;
+            if (cost == 0) break;
+        }
+    }
+    return best;
+}
+
+bool FrameTable::cyclicNeighbours(uint64_t space, uint64_t page, uint64_t &atOrAfter, uint64_t &before) const
+{
+    const std::map<uint64_t, uint64_t> &resident = resident_[space];
+    if (resident.empty()) return false;
+
+    auto next = resident.lower_bound(page);
+    atOrAfter = (next == resident.end() ? resident.begin() : next)->second;
+    before = std::prev(next == resident.begin() ? resident.end() : next)->second;
+    return true;
+}
+
+void FrameTable::save(ImageWords &words) const
+{
+    words.push_back(records_.size());
+    for (const Record &record : records_)
+    {
+        words.insert(words.end(), {record.parent, record.row, record.prefix, record.depth, record.space,
+                                   record.children, record.run,
+                                   (uint64_t)record.tail | (uint64_t)record.shared << 1});
+    }
+    words.push_back(maxFrame_);
+
+    /* ordered by frame, so the same simulation always gives the same image */
+    std::map<uint64_t, const std::vector<uint64_t> *> sharers;
+    for (const auto &entry : sharers_) sharers.emplace(entry.first, &entry.second);
+    words.push_back(sharers.size());
+    for (const auto &entry : sharers)
+    {
+        words.push_back(entry.first);
+        words.push_back(entry.second->size());
+        words.insert(words.end(), entry.second->begin(), entry.second->end());
+    }
+}
+
+bool FrameTable::load(ImageReader &words)
+{
+    uint64_t numFrames = records_.size();
+    uint64_t spaces = resident_.size();
+    if (words.count(RECORD_WORDS) != numFrames) return false;
+
+    uint64_t rows = std::max<uint64_t>(numFrames, 1ULL << offsetWidth_); // a table's rows, or a run's frames
+    std::vector<Record> records(numFrames);
+    for (Record &record : records)
+    {
+        record.parent = words.next();
+        record.row = words.next();
+        record.prefix = words.next();
+        record.depth = words.next();
+        record.space = words.next();
+        record.children = words.next();
+        record.run = words.next();
+        uint64_t flags = words.next();
+        record.tail = flags & 1;
+        record.shared = flags & 2;
+
+        bool sound = (record.parent < numFrames || record.parent == UINT64_MAX) && record.row < rows &&
+                     record.depth <= tablesDepth_ && record.space < spaces && record.run <= numFrames;
+        if (!sound) words.fail();
+    }
+    uint64_t maxFrame = words.next();
+    if (maxFrame >= numFrames) words.fail();
+
+    std::unordered_map<uint64_t, std::vector<uint64_t>> sharers;
+    for (uint64_t n = words.count(2); n != 0 && !words.failed(); --n)
+    {
+        uint64_t frame = words.next();
+        std::vector<uint64_t> &owners = sharers[frame];
+        owners.resize(words.count());
+        for (uint64_t &owner : owners)
+        {
+            owner = words.next();
+            if (owner >= numFrames || records[owner].space >= spaces) words.fail();
+        }
+        if (frame >= numFrames || !records[frame].shared || owners.empty()) words.fail();
+    }
+    uint64_t shared = std::count_if(records.begin(), records.end(), [](const Record &record) { return record.shared; });
+    if (words.failed() || shared != sharers.size()) return false;
+
+    for (uint64_t root = 0; root < spaces; ++root)
+    {
+        if (records[root].parent != root || records[root].depth != 0) return false;
+    }
+    records_.swap(records);
+    maxFrame_ = maxFrame;
+    sharers_.swap(sharers);
+
+    /* the indexes follow from the records */
+    for (uint64_t frame = spaces; frame < numFrames; ++frame)
+    {
+        const Record &record = records_[frame];
+        if (record.parent == UINT64_MAX)
+        {
+            if (trackFree_ && frame <= maxFrame_) free_.insert(frame);
+            continue;
+        }
+        if (!indexed_ || record.tail) continue;
+
+        if (isLeaf(record))
+        {
+            resident_[record.space].emplace(pageOf(frame), frame);
+            if (record.shared)
+            {
+                for (uint64_t owner : sharers_[frame]) resident_[records_[owner].space].emplace(record.prefix, frame);
+            }
+        }
+        else if (record.children == 0)
+        {
+            emptyTables_.insert({record.space, dfsKey(record), frame});
+        }
+    }
+    return true;
+}
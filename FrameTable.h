@@ -0,0 +1,215 @@
+#pragma once
+
+#include "Checkpoint.h"
+#include <cstdint>
+#include <map>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Inverted page table: one record per frame (its owner table and row, the page or page-number prefix
+ * it serves, table or leaf), kept up to date on every link/unlink in every allocator mode, so
+ * unlinking a frame never has to search the tree for the row that points to it.
+ *
+ * When indexed, it also keeps the ordered indexes the incremental allocator and the eviction
+ * policies use to answer the questions scan() answers by a full DFS:
+ *   - the empty (non-root) tables in DFS order, each with its parent frame and row,
+ *   - the highest frame referenced by the tree,
+ *   - the resident data pages with their frame, parent frame and row, ordered by virtual page number.
+ * Huge mappings (a contiguous run of frames linked from a table above the last level) count as one
+ * resident page, keyed by the first page they cover.
+ * With several address spaces, frame s is the root of space s; every record knows its space, the
+ * empty tables are ordered by space first, and resident pages are indexed per space.
+ * The roots are always referenced.
+ * After a VMfork a data page can be shared by the trees of several spaces: its record names one owner
+ * (the primary, whose space it reports), the others are listed apart, and the page is indexed as
+ * resident in every owner's space.
+ */
+class FrameTable
+{
+public:
+    /*
+     * forget everything: only the (empty) roots in frames 0..spaces-1 are referenced.
+     * without 'indexed' only the per-frame records and maxFrame() are kept: firstEmptyTable and
+     * cyclicNeighbours must not be used. trackFree also keeps the set of unreferenced frames below
+     * maxFrame(), which only exist once huge mappings are evicted or address spaces are discarded.
+     */
+    void reset(uint64_t numFrames, uint64_t offsetWidth, uint64_t tablesDepth, uint64_t spaces = 1,
+               bool indexed = true, bool trackFree = false);
+
+    /*
+     * records that row 'row' of table 'parent' now points to 'child'.
+     * isLeaf is true when child holds a data page.
+     */
+    void link(uint64_t parent, uint64_t row, uint64_t child, bool isLeaf);
+
+    /*
+     * records that row 'row' of table 'parent' now maps the huge page held by frames
+     * head..head+frames-1.
+     */
+    void linkRun(uint64_t parent, uint64_t row, uint64_t head, uint64_t frames);
+
+    /*
+     * records that the row pointing to 'child' was zeroed (for a huge mapping, its whole run is released).
+     * a shared page must be unshared down to its last owner first.
+     */
+    void unlink(uint64_t child);
+
+    /*
+     * records that row 'row' of table 'parent', in a space that does not map the page yet, now points to
+     * the data page held by 'frame' too. the row must be the one the page has in every tree.
+     */
+    void share(uint64_t parent, uint64_t row, uint64_t frame);
+
+    /*
+     * records that the row of table 'parent' pointing to the shared 'frame' was zeroed. the frame stays
+     * referenced by its other owners; if 'parent' was the primary one, another owner takes its place.
+     */
+    void unshare(uint64_t parent, uint64_t frame);
+
+    /*
+     * the first empty table in DFS order that is not 'excluded', or UINT64_MAX if there is none.
+     */
+    uint64_t firstEmptyTable(uint64_t excluded) const;
+
+    /*
+     * the highest frame referenced by the trees (spaces - 1 if only the roots exist).
+     */
+    uint64_t maxFrame() const { return maxFrame_; }
+
+    /*
+     * the lowest unreferenced frame below maxFrame(), or UINT64_MAX if there is none (or it is not tracked).
+     */
+    uint64_t firstFree() const { return free_.empty() ? UINT64_MAX : *free_.begin(); }
+
+    /*
+     * the start of the cheapest 'frames'-aligned window of 'frames' frames that can be emptied for a
+     * huge mapping, or UINT64_MAX if none can. a window cannot hold the root, 'excluded' or a table
+     * that still has children; its cost is the number of resident pages it holds (ties go to the lowest).
+     */
+    uint64_t cheapestWindow(uint64_t frames, uint64_t excluded) const;
+
+    /*
+     * the frames of the resident pages of address space 'space' closest to 'page' on the page-number
+     * circle: 'atOrAfter' holds the first resident page >= page (wrapping to the lowest one),
+     * 'before' the last resident page < page (wrapping to the highest one).
+     * returns false if no data page of that space is resident. O(log n).
+     */
+    bool cyclicNeighbours(uint64_t space, uint64_t page, uint64_t &atOrAfter, uint64_t &before) const;
+
+    uint64_t parentOf(uint64_t frame) const { return records_[frame].parent; }
+    uint64_t rowOf(uint64_t frame) const { return records_[frame].row; }
+
+    bool referenced(uint64_t frame) const { return records_[frame].parent != UINT64_MAX; }
+    bool isTail(uint64_t frame) const { return records_[frame].tail; }
+    bool isLeaf(uint64_t frame) const { return isLeaf(records_[frame]); }
+
+    /*
+     * the number of frames of the huge mapping whose first frame this is, 0 for any other frame.
+     */
+    uint64_t runOf(uint64_t frame) const { return records_[frame].run; }
+
+    /*
+     * the (first) virtual page number held by a leaf frame.
+     */
+    uint64_t pageOf(uint64_t frame) const
+    {
+        const Record &record = records_[frame];
+        return record.prefix << (offsetWidth_ * (tablesDepth_ - record.depth));
+    }
+
+    /*
+     * the virtual page number held by a leaf frame, or the page-number prefix of a table frame.
+     */
+    uint64_t prefixOf(uint64_t frame) const { return records_[frame].prefix; }
+
+    /*
+     * the address space whose tree references the frame.
+     */
+    uint64_t spaceOf(uint64_t frame) const { return records_[frame].space; }
+
+    /*
+     * the table depth of a referenced frame (0 = root, tablesDepth = data page; a huge mapping's
+     * first frame has the depth of the table row that maps it plus one)
+     */
+    uint64_t depthOf(uint64_t frame) const { return records_[frame].depth; }
+
+    /*
+     * the number of non-zero rows of a table frame.
+     */
+    uint64_t childrenOf(uint64_t frame) const { return records_[frame].children; }
+
+    uint64_t numFrames() const { return records_.size(); }
+
+    /*
+     * true if more than one row points to this data page.
+     */
+    bool isShared(uint64_t frame) const { return records_[frame].shared; }
+
+    /*
+     * the number of rows pointing to a referenced frame (its reference count).
+     */
+    uint64_t ownerCount(uint64_t frame) const
+    {
+        return records_[frame].shared ? 1 + sharers_.at(frame).size() : 1;
+    }
+
+    /*
+     * the table of the i-th owner of a data page, i < ownerCount(frame); owner 0 is parentOf(frame).
+     */
+    uint64_t ownerAt(uint64_t frame, uint64_t i) const
+    {
+        return i == 0 ? records_[frame].parent : sharers_.at(frame)[i - 1];
+    }
+
+    /*
+     * the table of address space 'space' that points to the data page, or UINT64_MAX if it has none.
+     */
+    uint64_t ownerIn(uint64_t frame, uint64_t space) const;
+
+    /*
+     * appends the records and the other owners of shared pages to an image, and reads them back
+     * right after a reset() to the same layout, rebuilding the indexes. load returns false, and
+     * leaves the table as reset() left it, if the words do not describe frames of this layout.
+     */
+    void save(ImageWords &words) const;
+    bool load(ImageReader &words);
+
+private:
+    struct Record
+    {
+        uint64_t parent = UINT64_MAX;   // UINT64_MAX while the frame is not referenced
+        uint64_t row = 0;
+        uint64_t prefix = 0;
+        uint64_t depth = 0;             // 0 = root, tablesDepth = data page
+        uint64_t space = 0;             // address space (= root frame) of the tree
+        uint64_t children = 0;          // non-zero rows, tables only
+        uint64_t run = 0;               // frames of a huge mapping, on its first frame
+        bool tail = false;              // a later frame of a huge mapping (parent = its first frame)
+        bool shared = false;            // a data page with owners in sharers_ too
+    };
+
+    bool isLeaf(const Record &record) const { return record.depth == tablesDepth_ || record.run != 0; }
+
+    void release(uint64_t frame);
+
+    /* position of an empty table in DFS order: its prefix padded to a full page number */
+    uint64_t dfsKey(const Record &record) const
+    {
+        return record.prefix << (offsetWidth_ * (tablesDepth_ - record.depth));
+    }
+
+    uint64_t offsetWidth_ = 0;
+    uint64_t tablesDepth_ = 0;
+    uint64_t maxFrame_ = 0;
+    std::vector<Record> records_;
+    bool indexed_ = true;
+    std::set<std::tuple<uint64_t, uint64_t, uint64_t>> emptyTables_; // (space, dfsKey, frame)
+    std::vector<std::map<uint64_t, uint64_t>> resident_;            // per space: virtual page -> frame
+    bool trackFree_ = false;
+    std::set<uint64_t> free_;                             // unreferenced frames in 1..maxFrame_
+    std::unordered_map<uint64_t, std::vector<uint64_t>> sharers_; // shared page -> tables of its other owners
+};
@@ -0,0 +1,22 @@
+#include "Geometry.h"
+#include <cassert>
+
+Geometry::Geometry() : Geometry(OFFSET_WIDTH, PHYSICAL_ADDRESS_WIDTH, VIRTUAL_ADDRESS_WIDTH)
+{
+}
+
+Geometry::Geometry(uint64_t offsetWidth, uint64_t physicalAddressWidth, uint64_t virtualAddressWidth)
+    : offsetWidth(offsetWidth), physicalAddressWidth(physicalAddressWidth), virtualAddressWidth(virtualAddressWidth)
+{
+    assert(offsetWidth > 0 && physicalAddressWidth > offsetWidth && virtualAddressWidth > offsetWidth);
+    assert(virtualAddressWidth < 64);
+    // table entries hold frame numbers, so every frame index must fit in a word
+    assert(physicalAddressWidth - offsetWidth < WORD_WIDTH - 1);
+
+    pageSize = 1ULL << offsetWidth;
+    ramSize = 1ULL << physicalAddressWidth;
+    virtualMemorySize = 1ULL << virtualAddressWidth;
+    numFrames = ramSize / pageSize;
+    numPages = virtualMemorySize / pageSize;
+    tablesDepth = tablesDepthOf(offsetWidth, virtualAddressWidth);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "MemoryConstants.h"
+
+/*
+ * number of table levels needed to translate a virtual page number: ceil((virt - offset) / offset).
+ */
+constexpr uint64_t tablesDepthOf(uint64_t offsetWidth, uint64_t virtualAddressWidth)
+{
+    return (virtualAddressWidth - offsetWidth + offsetWidth - 1) / offsetWidth;
+}
+
+/*
+ * The memory layout of a simulation, chosen at runtime.
+ * Holds the same quantities MemoryConstants.h derives from its three widths.
+ */
+struct Geometry
+{
+    uint64_t offsetWidth;
+    uint64_t physicalAddressWidth;
+    uint64_t virtualAddressWidth;
+
+    uint64_t pageSize;          // words per page/frame, also entries per table
+    uint64_t ramSize;           // words of RAM
+    uint64_t virtualMemorySize; // words of virtual memory
+    uint64_t numFrames;
+    uint64_t numPages;
+    uint64_t tablesDepth;
+
+    // the hot path loops over the levels of a runtime layout and unrolls them for a FixedGeometry
+    static constexpr bool fixed = false;
+
+    /*
+     * how far a virtual address is shifted right to bring the row of table depth 'level' into the
+     * low offsetWidth bits (level 0 = root)
+     */
+    uint64_t shiftAtLevel(uint64_t level) const { return offsetWidth * (tablesDepth - level); }
+
+    /*
+     * the layout compiled into MemoryConstants.h
+     */
+    Geometry();
+
+    Geometry(uint64_t offsetWidth, uint64_t physicalAddressWidth, uint64_t virtualAddressWidth);
+
+    bool operator==(const Geometry &other) const
+    {
+        return offsetWidth == other.offsetWidth && physicalAddressWidth == other.physicalAddressWidth &&
+               virtualAddressWidth == other.virtualAddressWidth;
+    }
+    bool operator!=(const Geometry &other) const { return !(*this == other); }
+};
+
+/*
+ * A layout fixed at compile time. It exposes the same members as Geometry, but as static constants,
+ * so code templated on the geometry type folds every shift and mask.
+ */
+template <uint64_t Offset, uint64_t Phys, uint64_t Virt>
+struct FixedGeometry
+{
+    static_assert(Offset > 0 && Phys > Offset && Virt > Offset && Virt < 64, "invalid geometry");
+
+    static constexpr uint64_t offsetWidth = Offset;
+    static constexpr uint64_t physicalAddressWidth = Phys;
+    static constexpr uint64_t virtualAddressWidth = Virt;
+
+    static constexpr uint64_t pageSize = 1ULL << Offset;
+    static constexpr uint64_t ramSize = 1ULL << Phys;
+    static constexpr uint64_t virtualMemorySize = 1ULL << Virt;
+    static constexpr uint64_t numFrames = ramSize / pageSize;
+    static constexpr uint64_t numPages = virtualMemorySize / pageSize;
+    static constexpr uint64_t tablesDepth = tablesDepthOf(Offset, Virt);
+
+    static constexpr bool fixed = true;
+
+    static constexpr uint64_t shiftAtLevel(uint64_t level) { return offsetWidth * (tablesDepth - level); }
+
+    static Geometry runtime() { return Geometry(Offset, Phys, Virt); }
+};
+
+/* the layout of MemoryConstants.h */
+typedef FixedGeometry<OFFSET_WIDTH, PHYSICAL_ADDRESS_WIDTH, VIRTUAL_ADDRESS_WIDTH> DefaultGeometry;
+static_assert(DefaultGeometry::tablesDepth == TABLES_DEPTH, "TABLES_DEPTH disagrees with tablesDepthOf");
@@ -0,0 +1,326 @@
+#include "Inspect.h"
+#include "VMContext.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// the dump reaches the stream in blocks of about this many bytes
+#define DUMP_BLOCK_BYTES (64 * 1024)
+// referenced-row count of a frame that is a table
+#define TABLE_MARK UINT32_MAX
+
+/**
+ * calls visit(row, entry) for the non-zero rows of table 'frame', in order, 64 rows at a time from a
+ * bitmap of them, until it returns false. returns false if it did.
+ **/
+template <class Visit>
+static bool forEachRow(const VMContext &ctx, uint64_t frame, Visit visit)
+{
+    const Geometry &geo = ctx.geometry;
+    for (uint64_t first = 0; first < geo.pageSize; first += 64)
+    {
+        uint64_t count = std::min<uint64_t>(64, geo.pageSize - first);
+        for (uint64_t rows = ctx.memory->nonZeroRows(frame, first, count); rows != 0; rows &= rows - 1)
+        {
+            uint64_t row = first + __builtin_ctzll(rows);
+            word_t entry;
+            ctx.memory->read(frame * geo.pageSize + row, &entry);
+            if (!visit(row, entry)) return false;
+        }
+    }
+    return true;
+}
+
+static inline uint64_t frameOf(word_t entry)
+{
+    return (uint64_t)(entry & ~HUGE_ENTRY_FLAG);
+}
+
+/**
+ * the first page a row of a table at 'depth' maps, from that row's prefix of the page number.
+ **/
+static inline uint64_t firstPageOf(const Geometry &geo, uint64_t depth, uint64_t prefix)
+{
+    return prefix << (geo.offsetWidth * (geo.tablesDepth - depth - 1));
+}
+
+/* ===================================================================== */
+/*                                 DUMP                                  */
+/* ===================================================================== */
+
+/*
+ * the text of the dump, handed to the stream whenever a block of it is ready.
+ */
+class DumpBuffer
+{
+public:
+    explicit DumpBuffer(std::ostream &out) : out_(out) { text_.reserve(DUMP_BLOCK_BYTES + 256); }
+
+    ~DumpBuffer()
+    {
+        out_.write(text_.data(), (std::streamsize)text_.size());
+        out_.flush();
+    }
+
+    DumpBuffer &operator<<(const char *text)
+    {
+        text_ += text;
+        return spill();
+    }
+
+    DumpBuffer &operator<<(uint64_t n)
+    {
+        text_ += std::to_string(n);
+        return spill();
+    }
+
+    void hex(uint64_t n)
+    {
+        char digits[19];
+        int length = snprintf(digits, sizeof(digits), "0x%llx", (unsigned long long)n);
+        text_.append(digits, (size_t)length);
+    }
+
+    void indent(uint64_t depth) { text_.append(2 * depth, ' '); }
+
+private:
+    DumpBuffer &spill()
+    {
+        if (text_.size() >= DUMP_BLOCK_BYTES)
+        {
+            out_.write(text_.data(), (std::streamsize)text_.size());
+            text_.clear();
+        }
+        return *this;
+    }
+
+    std::ostream &out_;
+    std::string text_;
+};
+
+/*
+ * what the dump says about the data page of a row (or the first page of a huge run).
+ */
+struct Mapping
+{
+    uint64_t page;
+    uint64_t frame;
+    uint64_t run; // frames of a huge run, 0 for a small page
+    bool dirty;
+    bool inSwap;
+    bool shared;
+};
+
+static Mapping mappingOf(const VMContext &ctx, uint64_t space, uint64_t depth, uint64_t prefix, word_t entry)
+{
+    Mapping mapping;
+    mapping.page = firstPageOf(ctx.geometry, depth, prefix);
+    mapping.frame = frameOf(entry);
+    mapping.run = (entry & HUGE_ENTRY_FLAG) ? ctx.hugeFrames : 0;
+    mapping.dirty = false;
+    mapping.inSwap = false;
+    for (uint64_t i = 0; i < std::max<uint64_t>(mapping.run, 1); ++i)
+    {
+        mapping.dirty = mapping.dirty || ctx.memory->isDirty(mapping.frame + i);
+        mapping.inSwap = mapping.inSwap || ctx.memory->inSwap((space << ctx.pageBits) | (mapping.page + i));
+    }
+    mapping.shared = mapping.run == 0 && ctx.frameTable.isShared(mapping.frame);
+    return mapping;
+}
+
+static void dumpText(const VMContext &ctx, DumpBuffer &out, uint64_t space, uint64_t frame, uint64_t depth,
+                     uint64_t prefix)
+{
+    const Geometry &geo = ctx.geometry;
+    forEachRow(ctx, frame, [&](uint64_t row, word_t entry) {
+        uint64_t childPrefix = (prefix << geo.offsetWidth) | row;
+        out.indent(depth + 1);
+        out << "row " << row;
+        if (frameOf(entry) >= geo.numFrames)
+        {
+            out << " -> frame " << frameOf(entry) << " past NUM_FRAMES\n";
+            return true;
+        }
+        if (depth + 1 < geo.tablesDepth && !(entry & HUGE_ENTRY_FLAG))
+        {
+            out << " -> table " << frameOf(entry) << "\n";
+            dumpText(ctx, out, space, frameOf(entry), depth + 1, childPrefix);
+            return true;
+        }
+
+        Mapping mapping = mappingOf(ctx, space, depth, childPrefix, entry);
+        out << " -> page ";
+        out.hex(mapping.page);
+        out << " frame " << mapping.frame;
+        if (mapping.run != 0) out << " huge " << mapping.run;
+        if (mapping.dirty) out << " dirty";
+        if (mapping.inSwap) out << " swap";
+        if (mapping.shared) out << " shared";
+        out << "\n";
+        return true;
+    });
+}
+
+static void dumpJson(const VMContext &ctx, DumpBuffer &out, uint64_t space, uint64_t frame, uint64_t depth,
+                     uint64_t prefix)
+{
+    const Geometry &geo = ctx.geometry;
+    out << "{\"frame\":" << frame << ",\"rows\":[";
+    bool first = true;
+    forEachRow(ctx, frame, [&](uint64_t row, word_t entry) {
+        uint64_t childPrefix = (prefix << geo.offsetWidth) | row;
+        out << (first ? "{\"row\":" : ",{\"row\":") << row;
+        first = false;
+        if (frameOf(entry) >= geo.numFrames)
+        {
+            out << ",\"invalid\":" << frameOf(entry) << "}";
+            return true;
+        }
+        if (depth + 1 < geo.tablesDepth && !(entry & HUGE_ENTRY_FLAG))
+        {
+            out << ",\"table\":";
+            dumpJson(ctx, out, space, frameOf(entry), depth + 1, childPrefix);
+            out << "}";
+            return true;
+        }
+
+        Mapping mapping = mappingOf(ctx, space, depth, childPrefix, entry);
+        out << ",\"page\":" << mapping.page << ",\"frame\":" << mapping.frame << ",\"huge\":" << mapping.run
+            << ",\"dirty\":" << (mapping.dirty ? "true" : "false") << ",\"swap\":" << (mapping.inSwap ? "true" : "false")
+            << ",\"shared\":" << (mapping.shared ? "true" : "false") << "}";
+        return true;
+    });
+    out << "]}";
+}
+
+void VMdump(const VMContext &ctx, std::ostream &stream, DumpFormat format)
+{
+    const Geometry &geo = ctx.geometry;
+    DumpBuffer out(stream);
+    if (format == DUMP_TEXT)
+    {
+        out << "layout " << geo.offsetWidth << "/" << geo.physicalAddressWidth << "/" << geo.virtualAddressWidth
+            << ", " << geo.tablesDepth << " levels, " << geo.numFrames << " frames, address spaces "
+            << ctx.config.addressSpaces << "\n";
+        for (uint64_t space = 0; space < ctx.config.addressSpaces; ++space)
+        {
+            out << "space " << space << " -> table " << space << "\n";
+            dumpText(ctx, out, space, space, 0, 0);
+        }
+        return;
+    }
+
+    out << "{\"offsetWidth\":" << geo.offsetWidth << ",\"physicalAddressWidth\":" << geo.physicalAddressWidth
+        << ",\"virtualAddressWidth\":" << geo.virtualAddressWidth << ",\"tablesDepth\":" << geo.tablesDepth
+        << ",\"numFrames\":" << geo.numFrames << ",\"spaces\":[";
+    for (uint64_t space = 0; space < ctx.config.addressSpaces; ++space)
+    {
+        out << (space == 0 ? "{\"space\":" : ",{\"space\":") << space << ",\"root\":";
+        dumpJson(ctx, out, space, space, 0, 0);
+        out << "}";
+    }
+    out << "]}\n";
+}
+
+void VMdump(std::ostream &out, DumpFormat format)
+{
+    VMdump(VMdefaultContext(), out, format);
+}
+
+/* ===================================================================== */
+/*                           CONSISTENCY CHECK                           */
+/* ===================================================================== */
+
+struct CheckState
+{
+    const VMContext &ctx;
+    ConsistencyReport &report;
+    std::vector<uint32_t> references; // rows seen pointing to each frame, TABLE_MARK for a table
+    std::vector<word_t> copy;         // a swap copy being compared
+};
+
+static bool fail(CheckState &state, uint64_t table, uint64_t row, const std::string &what)
+{
+    state.report.consistent = false;
+    state.report.error = "table " + std::to_string(table) + " row " + std::to_string(row) + ": " + what;
+    return false;
+}
+
+/**
+ * a resident page that may skip its write-back must hold what its swap copy holds.
+ **/
+static bool checkResident(CheckState &state, uint64_t table, uint64_t row, uint64_t frame, uint64_t key)
+{
+    const VMContext &ctx = state.ctx;
+    if (ctx.memory->isDirty(frame) || !ctx.memory->inSwap(key)) return true;
+
+    uint64_t pageSize = ctx.geometry.pageSize;
+    ctx.memory->swap().read(key, state.copy.data());
+    state.report.comparedPages++;
+    if (std::equal(state.copy.begin(), state.copy.end(), ctx.memory->ram() + frame * pageSize)) return true;
+    return fail(state, table, row, "frame " + std::to_string(frame) + " is clean but differs from the swap copy of page " +
+                                       std::to_string(key));
+}
+
+static bool checkRows(CheckState &state, uint64_t space, uint64_t frame, uint64_t depth, uint64_t prefix)
+{
+    const VMContext &ctx = state.ctx;
+    const Geometry &geo = ctx.geometry;
+    return forEachRow(ctx, frame, [&](uint64_t row, word_t entry) {
+        uint64_t child = frameOf(entry);
+        uint64_t childPrefix = (prefix << geo.offsetWidth) | row;
+        if (child >= geo.numFrames) return fail(state, frame, row, "frame " + std::to_string(child) + " is past NUM_FRAMES");
+        if (child < ctx.config.addressSpaces) return fail(state, frame, row, "points to the root " + std::to_string(child));
+        uint32_t &references = state.references[child];
+
+        if (entry & HUGE_ENTRY_FLAG)
+        {
+            if (ctx.hugeFrames == 0 || depth != ctx.hugeLevel || child + ctx.hugeFrames > geo.numFrames)
+                return fail(state, frame, row, "huge mapping of frame " + std::to_string(child) + " out of place");
+            uint64_t firstKey = (space << ctx.pageBits) | firstPageOf(geo, depth, childPrefix);
+            for (uint64_t i = 0; i < ctx.hugeFrames; ++i)
+            {
+                if (state.references[child + i] != 0)
+                    return fail(state, frame, row, "frame " + std::to_string(child + i) + " referenced twice");
+                state.references[child + i] = 1;
+                state.report.dataPages++;
+                if (!checkResident(state, frame, row, child + i, firstKey + i)) return false;
+            }
+            return true;
+        }
+
+        if (depth + 1 == geo.tablesDepth)
+        {
+            bool shared = ctx.frameTable.isShared(child);
+            if (references == TABLE_MARK || (references != 0 && (!shared || references >= ctx.frameTable.ownerCount(child))))
+                return fail(state, frame, row, "frame " + std::to_string(child) + " referenced twice");
+            if (references++ != 0) return true; // another owner of a page shared since a VMfork
+            state.report.dataPages++;
+            return shared || checkResident(state, frame, row, child, (space << ctx.pageBits) | childPrefix);
+        }
+
+        if (references != 0) return fail(state, frame, row, "frame " + std::to_string(child) + " referenced twice");
+        references = TABLE_MARK;
+        state.report.tables++;
+        return checkRows(state, space, child, depth + 1, childPrefix);
+    });
+}
+
+ConsistencyReport VMcheckConsistency(const VMContext &ctx)
+{
+    ConsistencyReport report;
+    CheckState state{ctx, report, std::vector<uint32_t>(ctx.geometry.numFrames, 0),
+                     std::vector<word_t>(ctx.geometry.pageSize)};
+    for (uint64_t root = 0; root < ctx.config.addressSpaces; ++root) state.references[root] = TABLE_MARK;
+    report.tables = ctx.config.addressSpaces;
+
+    for (uint64_t root = 0; root < ctx.config.addressSpaces; ++root)
+        if (!checkRows(state, root, root, 0, 0)) break;
+    return report;
+}
+
+ConsistencyReport VMcheckConsistency()
+{
+    return VMcheckConsistency(VMdefaultContext());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+struct VMContext; // VMContext.h
+
+/*
+ * Looking inside a simulation without printRam(), which prints every word of the RAM: a dump of the
+ * page-table trees that shows only their live rows, and a consistency check cheap enough to run
+ * after every large run. Both cost one pass over the live tables, visiting only their non-zero rows.
+ */
+
+enum DumpFormat
+{
+    DUMP_TEXT, // one line per live row, indented by depth
+    DUMP_JSON  // one object: the layout, then per address space its tree as nested tables
+};
+
+/*
+ * writes the page-table trees of every address space: each table and, under it, its non-zero rows,
+ * which point to a table or map a data page (with its page number, frame, and whether it is dirty,
+ * in swap, shared since a VMfork or huge). a row pointing past NUM_FRAMES is shown, not followed.
+ * the output is built in large blocks, never flushed per line.
+ */
+void VMdump(const VMContext &context, std::ostream &out, DumpFormat format = DUMP_TEXT);
+void VMdump(std::ostream &out, DumpFormat format = DUMP_TEXT);
+
+/*
+ * What VMcheckConsistency found.
+ */
+struct ConsistencyReport
+{
+    bool consistent = true;
+    std::string error; // the first violation found, empty when consistent
+
+    uint64_t tables = 0;        // reached, the roots included
+    uint64_t dataPages = 0;     // resident data pages reached (every page of a huge run)
+    uint64_t comparedPages = 0; // clean resident pages compared against their swap copy
+};
+
+/*
+ * checks the trees themselves (VMcheckIntegrity checks them against the frame table):
+ *   - every row points below NUM_FRAMES, and never to a root;
+ *   - every frame is referenced at most once: a table by one row, a data page by one row per address
+ *     space sharing it since a VMfork;
+ *   - a huge mapping sits at the huge level, and its frames are referenced by nothing else;
+ *   - swap and residency agree: a clean resident page that has a swap copy holds exactly that copy
+ *     (its eviction skips the write-back on the strength of it). pages shared since a VMfork are
+ *     not compared, since whose copy they hold depends on the lineage.
+ * stops at the first violation. O(live rows + PAGE_SIZE * clean pages in swap).
+ */
+ConsistencyReport VMcheckConsistency(const VMContext &context);
+ConsistencyReport VMcheckConsistency();
@@ -31,10 +31,22 @@ typedef int word_t;
 // number of pages in the virtual memory
 #define NUM_PAGES (VIRTUAL_MEMORY_SIZE / PAGE_SIZE)
 
-#define CEIL(VARIABLE) ( (VARIABLE - (int)VARIABLE)==0 ? (int)VARIABLE : (int)VARIABLE+1 )
-
-#define TABLES_DEPTH CEIL((((VIRTUAL_ADDRESS_WIDTH - OFFSET_WIDTH) / (double)OFFSET_WIDTH)))
+// number of table levels: ceil((VIRTUAL_ADDRESS_WIDTH - OFFSET_WIDTH) / OFFSET_WIDTH), in integers
+#define TABLES_DEPTH ((VIRTUAL_ADDRESS_WIDTH - OFFSET_WIDTH + OFFSET_WIDTH - 1) / OFFSET_WIDTH)
 
 // the weights for the evacuation algorithm
 #define WEIGHT_EVEN 4
 #define WEIGHT_ODD 2
+
+// default geometry of the software TLB in front of the page-table walk
+// number of sets (must be a power of 2)
+#define TLB_SETS 16
+// entries per set, 0 disables the TLB
+#define TLB_WAYS 4
+
+// set in a table entry that maps a huge page: the rest of the entry is the first frame of its run
+// (frame numbers never reach this bit, see Geometry)
+#define HUGE_ENTRY_FLAG ((word_t)1 << (WORD_WIDTH - 2))
+
+// default number of entries per table level of the paging-structure cache (a power of 2, 0 disables it)
+#define WALK_CACHE_ENTRIES 32
@@ -0,0 +1,361 @@
+#include "PageKernels.h"
+#include <atomic>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_X86
+#include <immintrin.h>
+// functions built for AVX2 whatever the compiler flags; only called once the CPU reported it
+#define AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+// vector steps between two early-exit checks of allZero and sameValue
+#define KERNEL_CHECK_EVERY 8
+
+/* ===================================================================== */
+/*                                SCALAR                                 */
+/* ===================================================================== */
+
+static void clearScalar(word_t *page, uint64_t words)
+{
+    for (uint64_t i = 0; i < words; ++i) page[i] = 0;
+}
+
+static void copyScalar(word_t *to, const word_t *from, uint64_t words)
+{
+    for (uint64_t i = 0; i < words; ++i) to[i] = from[i];
+}
+
+static bool allZeroScalar(const word_t *page, uint64_t words)
+{
+    for (uint64_t i = 0; i < words; ++i)
+    {
+        if (page[i] != 0) return false;
+    }
+    return true;
+}
+
+/**
+ * from word 'i' on, whether every word equals 'value' (the tail of the vector versions too).
+ **/
+static inline bool sameFrom(const word_t *page, uint64_t i, uint64_t words, word_t value)
+{
+    for (; i < words; ++i)
+    {
+        if (page[i] != value) return false;
+    }
+    return true;
+}
+
+static bool sameValueScalar(const word_t *page, uint64_t words, word_t &value)
+{
+    value = page[0];
+    return sameFrom(page, 1, words, value);
+}
+
+static inline uint64_t nonZeroFrom(const word_t *words, uint64_t i, uint64_t count, uint64_t mask)
+{
+    for (; i < count; ++i)
+    {
+        if (words[i] != 0) mask |= 1ULL << i;
+    }
+    return mask;
+}
+
+static uint64_t nonZeroMaskScalar(const word_t *words, uint64_t count)
+{
+    return nonZeroFrom(words, 0, count, 0);
+}
+
+static const PageKernels scalarKernels = {"scalar", clearScalar, copyScalar, allZeroScalar, sameValueScalar,
+                                          nonZeroMaskScalar};
+
+/*
+ * The vector versions work on bytes, so they suit any word_t, except nonZeroMask, whose lanes are
+ * 32-bit words: with another word_t it stays scalar. sameValue first checks that the first vector
+ * holds one value; the page then does iff every other vector equals the first.
+ */
+#define WORD_LANES_32 (sizeof(word_t) == 4)
+
+#ifdef KERNELS_X86
+/* ===================================================================== */
+/*                                 SSE2                                  */
+/* ===================================================================== */
+
+#define SSE2_BYTES 16
+
+static inline bool zero128(__m128i v)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xFFFF;
+}
+
+static void clearSse2(word_t *page, uint64_t words)
+{
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(page);
+    uint64_t size = words * sizeof(word_t), at = 0;
+    for (; at + SSE2_BYTES <= size; at += SSE2_BYTES)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + at), _mm_setzero_si128());
+    std::memset(bytes + at, 0, size - at);
+}
+
+static void copySse2(word_t *to, const word_t *from, uint64_t words)
+{
+    uint8_t *out = reinterpret_cast<uint8_t *>(to);
+    const uint8_t *in = reinterpret_cast<const uint8_t *>(from);
+    uint64_t size = words * sizeof(word_t), at = 0;
+    for (; at + SSE2_BYTES <= size; at += SSE2_BYTES)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + at), _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + at)));
+    std::memcpy(out + at, in + at, size - at);
+}
+
+static bool allZeroSse2(const word_t *page, uint64_t words)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(page);
+    uint64_t size = words * sizeof(word_t), at = 0, step = 0;
+    __m128i any = _mm_setzero_si128();
+    for (; at + SSE2_BYTES <= size; at += SSE2_BYTES)
+    {
+        any = _mm_or_si128(any, _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + at)));
+        if (++step % KERNEL_CHECK_EVERY == 0 && !zero128(any)) return false;
+    }
+    return zero128(any) && allZeroScalar(page + at / sizeof(word_t), words - at / sizeof(word_t));
+}
+
+static bool sameValueSse2(const word_t *page, uint64_t words, word_t &value)
+{
+    const uint64_t lane = SSE2_BYTES / sizeof(word_t);
+    if (SSE2_BYTES % sizeof(word_t) != 0 || words < 2 * lane) return sameValueScalar(page, words, value);
+    value = page[0];
+    if (!sameFrom(page, 1, lane, value)) return false;
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(page);
+    uint64_t vectors = words / lane;
+    __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+    __m128i diff = _mm_setzero_si128();
+    for (uint64_t v = 1; v < vectors; ++v)
+    {
+        diff = _mm_or_si128(diff, _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + v * SSE2_BYTES)), first));
+        if (v % KERNEL_CHECK_EVERY == 0 && !zero128(diff)) return false;
+    }
+    return zero128(diff) && sameFrom(page, vectors * lane, words, value);
+}
+
+static uint64_t nonZeroMaskSse2(const word_t *words, uint64_t count)
+{
+    uint64_t mask = 0, i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + i));
+        unsigned zeros = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_setzero_si128())));
+        mask |= (uint64_t)(~zeros & 0xF) << i;
+    }
+    return nonZeroFrom(words, i, count, mask);
+}
+
+static const PageKernels sse2Kernels = {"sse2", clearSse2, copySse2, allZeroSse2, sameValueSse2,
+                                        WORD_LANES_32 ? nonZeroMaskSse2 : nonZeroMaskScalar};
+
+/* ===================================================================== */
+/*                                 AVX2                                  */
+/* ===================================================================== */
+
+#define AVX2_BYTES 32
+
+AVX2_TARGET static inline bool zero256(__m256i v)
+{
+    return _mm256_testz_si256(v, v) != 0;
+}
+
+AVX2_TARGET static void clearAvx2(word_t *page, uint64_t words)
+{
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(page);
+    uint64_t size = words * sizeof(word_t), at = 0;
+    for (; at + AVX2_BYTES <= size; at += AVX2_BYTES)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(bytes + at), _mm256_setzero_si256());
+    std::memset(bytes + at, 0, size - at);
+}
+
+AVX2_TARGET static void copyAvx2(word_t *to, const word_t *from, uint64_t words)
+{
+    uint8_t *out = reinterpret_cast<uint8_t *>(to);
+    const uint8_t *in = reinterpret_cast<const uint8_t *>(from);
+    uint64_t size = words * sizeof(word_t), at = 0;
+    for (; at + AVX2_BYTES <= size; at += AVX2_BYTES)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + at), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + at)));
+    std::memcpy(out + at, in + at, size - at);
+}
+
+AVX2_TARGET static bool allZeroAvx2(const word_t *page, uint64_t words)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(page);
+    uint64_t size = words * sizeof(word_t), at = 0, step = 0;
+    __m256i any = _mm256_setzero_si256();
+    for (; at + AVX2_BYTES <= size; at += AVX2_BYTES)
+    {
+        any = _mm256_or_si256(any, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + at)));
+        if (++step % KERNEL_CHECK_EVERY == 0 && !zero256(any)) return false;
+    }
+    return zero256(any) && allZeroScalar(page + at / sizeof(word_t), words - at / sizeof(word_t));
+}
+
+AVX2_TARGET static bool sameValueAvx2(const word_t *page, uint64_t words, word_t &value)
+{
+    const uint64_t lane = AVX2_BYTES / sizeof(word_t);
+    if (AVX2_BYTES % sizeof(word_t) != 0 || words < 2 * lane) return sameValueSse2(page, words, value);
+    value = page[0];
+    if (!sameFrom(page, 1, lane, value)) return false;
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(page);
+    uint64_t vectors = words / lane;
+    __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes));
+    __m256i diff = _mm256_setzero_si256();
+    for (uint64_t v = 1; v < vectors; ++v)
+    {
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + v * AVX2_BYTES)), first));
+        if (v % KERNEL_CHECK_EVERY == 0 && !zero256(diff)) return false;
+    }
+    return zero256(diff) && sameFrom(page, vectors * lane, words, value);
+}
+
+AVX2_TARGET static uint64_t nonZeroMaskAvx2(const word_t *words, uint64_t count)
+{
+    uint64_t mask = 0, i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + i));
+        unsigned zeros = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, _mm256_setzero_si256())));
+        mask |= (uint64_t)(~zeros & 0xFF) << i;
+    }
+    return nonZeroFrom(words, i, count, mask);
+}
+
+static const PageKernels avx2Kernels = {"avx2", clearAvx2, copyAvx2, allZeroAvx2, sameValueAvx2,
+                                        WORD_LANES_32 ? nonZeroMaskAvx2 : nonZeroMaskScalar};
+#endif
+
+#ifdef KERNELS_NEON
+/* ===================================================================== */
+/*                                 NEON                                  */
+/* ===================================================================== */
+
+#define NEON_BYTES 16
+
+static void clearNeon(word_t *page, uint64_t words)
+{
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(page);
+    uint64_t size = words * sizeof(word_t), at = 0;
+    for (; at + NEON_BYTES <= size; at += NEON_BYTES) vst1q_u8(bytes + at, vdupq_n_u8(0));
+    std::memset(bytes + at, 0, size - at);
+}
+
+static void copyNeon(word_t *to, const word_t *from, uint64_t words)
+{
+    uint8_t *out = reinterpret_cast<uint8_t *>(to);
+    const uint8_t *in = reinterpret_cast<const uint8_t *>(from);
+    uint64_t size = words * sizeof(word_t), at = 0;
+    for (; at + NEON_BYTES <= size; at += NEON_BYTES) vst1q_u8(out + at, vld1q_u8(in + at));
+    std::memcpy(out + at, in + at, size - at);
+}
+
+static bool allZeroNeon(const word_t *page, uint64_t words)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(page);
+    uint64_t size = words * sizeof(word_t), at = 0, step = 0;
+    uint8x16_t any = vdupq_n_u8(0);
+    for (; at + NEON_BYTES <= size; at += NEON_BYTES)
+    {
+        any = vorrq_u8(any, vld1q_u8(bytes + at));
+        if (++step % KERNEL_CHECK_EVERY == 0 && vmaxvq_u8(any) != 0) return false;
+    }
+    return vmaxvq_u8(any) == 0 && allZeroScalar(page + at / sizeof(word_t), words - at / sizeof(word_t));
+}
+
+static bool sameValueNeon(const word_t *page, uint64_t words, word_t &value)
+{
+    const uint64_t lane = NEON_BYTES / sizeof(word_t);
+    if (NEON_BYTES % sizeof(word_t) != 0 || words < 2 * lane) return sameValueScalar(page, words, value);
+    value = page[0];
+    if (!sameFrom(page, 1, lane, value)) return false;
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(page);
+    uint64_t vectors = words / lane;
+    uint8x16_t first = vld1q_u8(bytes);
+    uint8x16_t diff = vdupq_n_u8(0);
+    for (uint64_t v = 1; v < vectors; ++v)
+    {
+        diff = vorrq_u8(diff, veorq_u8(vld1q_u8(bytes + v * NEON_BYTES), first));
+        if (v % KERNEL_CHECK_EVERY == 0 && vmaxvq_u8(diff) != 0) return false;
+    }
+    return vmaxvq_u8(diff) == 0 && sameFrom(page, vectors * lane, words, value);
+}
+
+static uint64_t nonZeroMaskNeon(const word_t *words, uint64_t count)
+{
+    /* no movemask on NEON: weigh the lanes' all-ones results by their bit and add them up */
+    static const uint32_t weights[4] = {1, 2, 4, 8};
+    const uint32x4_t weight = vld1q_u32(weights);
+    uint64_t mask = 0, i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32x4_t v = vld1q_u32(reinterpret_cast<const uint32_t *>(words + i));
+        uint32x4_t set = vmvnq_u32(vceqq_u32(v, vdupq_n_u32(0)));
+        mask |= (uint64_t)vaddvq_u32(vandq_u32(set, weight)) << i;
+    }
+    return nonZeroFrom(words, i, count, mask);
+}
+
+static const PageKernels neonKernels = {"neon", clearNeon, copyNeon, allZeroNeon, sameValueNeon,
+                                        WORD_LANES_32 ? nonZeroMaskNeon : nonZeroMaskScalar};
+#endif
+
+/* ===================================================================== */
+/*                               DISPATCH                                */
+/* ===================================================================== */
+
+/**
+ * the built-in kernels called 'name' that this CPU can run, nullptr if none.
+ **/
+static const PageKernels *supported(const char *name)
+{
+    if (std::strcmp(name, scalarKernels.name) == 0) return &scalarKernels;
+#ifdef KERNELS_X86
+    if (std::strcmp(name, sse2Kernels.name) == 0) return &sse2Kernels; // part of x86-64
+    if (std::strcmp(name, avx2Kernels.name) == 0) return __builtin_cpu_supports("avx2") ? &avx2Kernels : nullptr;
+#endif
+#ifdef KERNELS_NEON
+    if (std::strcmp(name, neonKernels.name) == 0) return &neonKernels; // part of AArch64
+#endif
+    return nullptr;
+}
+
+static std::atomic<const PageKernels *> &activeKernels()
+{
+    static std::atomic<const PageKernels *> active([] {
+#ifdef KERNELS_X86
+        __builtin_cpu_init(); // may run before the constructors that would have done it
+#endif
+        for (const char *name : {"avx2", "sse2", "neon"})
+        {
+            if (const PageKernels *kernels = supported(name)) return kernels;
+        }
+        return &scalarKernels;
+    }());
+    return active;
+}
+
+const PageKernels &pageKernels()
+{
+    return *activeKernels().load(std::memory_order_relaxed);
+}
+
+bool usePageKernels(const char *name)
+{
+    const PageKernels *kernels = supported(name);
+    if (kernels == nullptr) return false;
+    activeKernels().store(kernels, std::memory_order_relaxed);
+    return true;
+}
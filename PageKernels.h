@@ -0,0 +1,36 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include <cstdint>
+
+/*
+ * Whole-page kernels over the flat RAM: clearing and copying a page, the all-zero and same-value
+ * checks, and the bitmap of the non-zero rows of a table. Each has a scalar version and vector ones
+ * (SSE2 and AVX2 on x86-64, NEON on AArch64); the fastest one the CPU runs is picked on first use.
+ */
+struct PageKernels
+{
+    const char *name; // "scalar", "sse2", "avx2" or "neon"
+
+    void (*clear)(word_t *page, uint64_t words);
+    void (*copy)(word_t *to, const word_t *from, uint64_t words);
+    bool (*allZero)(const word_t *page, uint64_t words);
+
+    /* true if every word of the page holds the same value, which is put in 'value' */
+    bool (*sameValue)(const word_t *page, uint64_t words, word_t &value);
+
+    /* a movemask: bit i is set iff words[i] != 0, for the first 'count' (at most 64) words */
+    uint64_t (*nonZeroMask)(const word_t *words, uint64_t count);
+};
+
+/*
+ * the kernels in use: the fastest the CPU supports, unless usePageKernels chose others.
+ */
+const PageKernels &pageKernels();
+
+/*
+ * switches to the kernels called 'name' (for instance "scalar", to compare against the vector ones).
+ * returns false, changing nothing, if they are not built in or the CPU lacks their instructions.
+ * must not be called while a simulation runs on another thread.
+ */
+bool usePageKernels(const char *name);
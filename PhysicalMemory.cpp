@@ -1,87 +1,234 @@
 #include "PhysicalMemory.h"
-#include <vector>
-#include <unordered_map>
+#include "SwapStore.h"
+#include <memory>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 
 
-typedef std::vector<word_t> page_t;
+// RAM is allocated on cache-line boundaries so a frame never straddles more lines than it must
+#define RAM_ALIGNMENT 64
+// print() hands its text to std::cout in blocks of about this many bytes
+#define PRINT_BLOCK_BYTES (64 * 1024)
 
-int evict_counter = 0;
+void PhysicalMemory::AlignedFree::operator()(word_t* memory) const {
+    std::free(memory);
+}
+
+PhysicalMemory::PhysicalMemory() {
+    initialize(Geometry(), SWAP_POOLED);
+}
+
+void PhysicalMemory::initialize(const Geometry& layout, SwapBackend backend, const std::string& swapPath,
+                                uint64_t addressSpaces, uint64_t swapWorkers) {
+    geometry_ = layout;
+
+    uint64_t bytes = geometry_.ramSize * sizeof(word_t);
+    bytes = (bytes + RAM_ALIGNMENT - 1) / RAM_ALIGNMENT * RAM_ALIGNMENT;
+    ram_.reset(static_cast<word_t*>(std::aligned_alloc(RAM_ALIGNMENT, bytes)));
+    assert(ram_);
+    std::memset(ram_.get(), 0, bytes);
 
-std::vector<page_t> RAM;
-std::unordered_map<uint64_t, page_t> swapFile;
+    swapLayout_ = swapLayoutFor(layout, addressSpaces);
+    swapPages_ = swapLayout_.numPages;
 
-void initialize() {
-    RAM.resize(NUM_FRAMES, page_t(PAGE_SIZE));
+    swapWorkers_ = swapWorkers;
+
+    swap_.reset();
+    swap_ = makeAsync(makeSwapStore(backend, swapLayout_, swapPath), swapLayout_, swapWorkers_);
+    dirty_.assign(geometry_.numFrames, 1);
+    evictions_ = 0;
+    writeBacks_ = 0;
 }
 
-void PMread(uint64_t physicalAddress, word_t* value) {
+Geometry PhysicalMemory::swapLayoutFor(const Geometry& layout, uint64_t addressSpaces) {
+    /* one virtual space widened by the bits of the space number */
+    uint64_t spaceBits = 0;
+    while ((1ULL << spaceBits) < addressSpaces) spaceBits++;
+    return Geometry(layout.offsetWidth, layout.physicalAddressWidth, layout.virtualAddressWidth + spaceBits);
+}
 
-    if (RAM.empty())
-        initialize();
+void PhysicalMemory::adopt(const word_t* ram, const std::vector<uint8_t>& dirty, uint64_t evictions,
+                           uint64_t writeBacks, std::unique_ptr<SwapStore> swap) {
+    assert(dirty.size() == geometry_.numFrames);
 
-    assert(physicalAddress < RAM_SIZE);
+    std::memcpy(ram_.get(), ram, geometry_.ramSize * sizeof(word_t));
+    dirty_ = dirty;
+    evictions_ = evictions;
+    writeBacks_ = writeBacks;
+    swap_.reset();
+    swap_ = makeAsync(std::move(swap), swapLayout_, swapWorkers_);
+}
 
-    *value = RAM[physicalAddress / PAGE_SIZE][physicalAddress
-             % PAGE_SIZE];
-//    std::cout << "read " << *value << " from physical address " << physicalAddress << std::endl;
- }
+void PhysicalMemory::readRange(uint64_t physicalAddress, word_t* values, uint64_t length) const {
+    assert(physicalAddress < geometry_.ramSize);
+    assert(physicalAddress % geometry_.pageSize + length <= geometry_.pageSize);
 
-void PMwrite(uint64_t physicalAddress, word_t value) {
-//    std::cout << "write " << value << " into physical address " << physicalAddress<< std::endl;
-    if (RAM.empty())
-        initialize();
+    std::memcpy(values, &ram_[physicalAddress], length * sizeof(word_t));
+}
 
-    assert(physicalAddress < RAM_SIZE);
+void PhysicalMemory::writeRange(uint64_t physicalAddress, const word_t* values, uint64_t length) {
+    assert(physicalAddress < geometry_.ramSize);
+    assert(physicalAddress % geometry_.pageSize + length <= geometry_.pageSize);
 
-    RAM[physicalAddress / PAGE_SIZE][physicalAddress
-             % PAGE_SIZE] = value;
+    std::memcpy(&ram_[physicalAddress], values, length * sizeof(word_t));
+    dirty_[physicalAddress >> geometry_.offsetWidth] = 1;
 }
 
-void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex) {
+void PhysicalMemory::copyFrame(uint64_t to, uint64_t from) {
+    assert(to < geometry_.numFrames && from < geometry_.numFrames);
+
+    pageKernels().copy(&ram_[to * geometry_.pageSize], &ram_[from * geometry_.pageSize], geometry_.pageSize);
+    dirty_[to] = 1;
+}
+
+void PhysicalMemory::clearFrame(uint64_t frameIndex) {
+    assert(frameIndex < geometry_.numFrames);
+
+    pageKernels().clear(&ram_[frameIndex * geometry_.pageSize], geometry_.pageSize);
+    dirty_[frameIndex] = 1;
+}
+
+void PhysicalMemory::copySwap(uint64_t from, uint64_t to) {
+    assert(from < swapPages_ && to < swapPages_);
+
+    std::vector<word_t> page(geometry_.pageSize);
+    bool found = swap_->read(from, page.data());
+    assert(found);
+    (void)found;
+    swap_->write(to, page.data());
+}
+
+void PhysicalMemory::evict(uint64_t frameIndex, uint64_t evictedPageIndex) {
 //    std::cout << "evict " << evictedPageIndex << " from the frame " <<frameIndex<< std::endl;
-    if (RAM.empty())
-        initialize();
+    assert(frameIndex < geometry_.numFrames);
+    assert(evictedPageIndex < swapPages_);
 
-    assert(swapFile.find(evictedPageIndex) == swapFile.end());
-    assert(frameIndex < NUM_FRAMES);
-    assert(evictedPageIndex < NUM_PAGES);
+    evictions_++;
+    // clean and still in swap: the copy there is what the frame holds
+    if (!dirty_[frameIndex] && swap_->contains(evictedPageIndex)) return;
 
-    swapFile[evictedPageIndex] = RAM[frameIndex];
-    evict_counter++;
+    swap_->write(evictedPageIndex, &ram_[frameIndex * geometry_.pageSize]);
+    writeBacks_++;
 }
 
-void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex) {
+bool PhysicalMemory::restore(uint64_t frameIndex, uint64_t restoredPageIndex) {
 //    std::cout << "restore " << restoredPageIndex << " from the hard drive to the frame " << frameIndex << std::endl;
-    if (RAM.empty())
-        initialize();
-
-    assert(frameIndex < NUM_FRAMES);
+    assert(frameIndex < geometry_.numFrames);
 
     // page is not in swap file, so this is essentially
     // the first reference to this page. we can just return
     // as it doesn't matter if the page contains garbage
-    if (swapFile.find(restoredPageIndex) == swapFile.end())
-        return;
+    if (!swap_->read(restoredPageIndex, &ram_[frameIndex * geometry_.pageSize]))
+    {
+        dirty_[frameIndex] = 1; // no copy to fall back on
+        return false;
+    }
 
-    RAM[frameIndex] = std::move(swapFile[restoredPageIndex]);
-    swapFile.erase(restoredPageIndex);
+    // the copy stays in swap, so evicting the page before it is written costs no copy
+    dirty_[frameIndex] = 0;
+    return true;
 }
 
-void printRam()
+void PhysicalMemory::evictRun(uint64_t firstFrame, uint64_t firstPage, uint64_t count)
 {
-    for (uint64_t  i = 0; i < RAM_SIZE; i++)
+    for (uint64_t i = 0; i < count; ++i) evict(firstFrame + i, firstPage + i);
+}
+
+uint64_t PhysicalMemory::restoreRun(uint64_t firstFrame, uint64_t firstPage, uint64_t count, bool zeroFirstTouch)
+{
+    /* with swap workers, the pages of the run are read in parallel while the first ones are copied in */
+    if (swapWorkers_ != 0)
+        for (uint64_t i = 0; i < count; ++i) swap_->prefetch(firstPage + i);
+
+    uint64_t restored = 0;
+    for (uint64_t i = 0; i < count; ++i)
     {
-        word_t tmp;
-        PMread(i, &tmp);
-        std::cout << i << ": " << tmp << std::endl;
+        if (restore(firstFrame + i, firstPage + i)) restored++;
+        else if (zeroFirstTouch) pageKernels().clear(&ram_[(firstFrame + i) * geometry_.pageSize], geometry_.pageSize);
+    }
+    return restored;
+}
 
+void PhysicalMemory::print() const
+{
+    /* built in blocks instead of flushed after every word (VMdump prints only the live tables) */
+    std::string text;
+    for (uint64_t  i = 0; i < geometry_.ramSize; i++)
+    {
+        word_t tmp;
+        read(i, &tmp);
+        text += std::to_string(i) + ": " + std::to_string(tmp) + '\n';
+        if (text.size() >= PRINT_BLOCK_BYTES)
+        {
+            std::cout.write(text.data(), (std::streamsize)text.size());
+            text.clear();
+        }
     }
+    std::cout.write(text.data(), (std::streamsize)text.size());
+    std::cout.flush();
+}
+
+/* ===================================================================== */
+/*                  PM* API, on the process-wide instance                */
+/* ===================================================================== */
+
+PhysicalMemory& PMdefault() {
+    static PhysicalMemory memory;
+    return memory;
+}
+
+void PMinitialize(const Geometry& layout, SwapBackend backend, const std::string& swapPath) {
+    PMdefault().initialize(layout, backend, swapPath);
+}
+
+void PMread(uint64_t physicalAddress, word_t* value) {
+    PMdefault().read(physicalAddress, value);
+//    std::cout << "read " << *value << " from physical address " << physicalAddress << std::endl;
+ }
+
+void PMwrite(uint64_t physicalAddress, word_t value) {
+//    std::cout << "write " << value << " into physical address " << physicalAddress<< std::endl;
+    PMdefault().write(physicalAddress, value);
+}
+
+void PMreadRange(uint64_t physicalAddress, word_t* values, uint64_t length) {
+    PMdefault().readRange(physicalAddress, values, length);
+}
+
+void PMwriteRange(uint64_t physicalAddress, const word_t* values, uint64_t length) {
+    PMdefault().writeRange(physicalAddress, values, length);
+}
+
+void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex) {
+    PMdefault().evict(frameIndex, evictedPageIndex);
+}
+
+void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex) {
+    PMdefault().restore(frameIndex, restoredPageIndex);
+}
+
+void PMevictRun(uint64_t firstFrame, uint64_t firstPage, uint64_t count) {
+    PMdefault().evictRun(firstFrame, firstPage, count);
+}
+
+uint64_t PMrestoreRun(uint64_t firstFrame, uint64_t firstPage, uint64_t count, bool zeroFirstTouch) {
+    return PMdefault().restoreRun(firstFrame, firstPage, count, zeroFirstTouch);
+}
+
+bool PMinSwap(uint64_t pageIndex) {
+    return PMdefault().inSwap(pageIndex);
+}
+
+void printRam()
+{
+    PMdefault().print();
 }
 
 
 void printEvictionCounter()
 {
-    std::cout << evict_counter << std::endl;
-}
\ No newline at end of file
+    std::cout << PMdefault().evictions() << std::endl;
+}
@@ -1,6 +1,165 @@
 #pragma once
 
 #include "MemoryConstants.h"
+#include "Geometry.h"
+#include "SwapStore.h"
+#include "PageKernels.h"
+#include <cassert>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * One simulated RAM and its swap. The PM* functions below operate on a process-wide default
+ * instance; independent simulations (see VMContext) each own one of these.
+ */
+class PhysicalMemory
+{
+public:
+    /*
+     * the MemoryConstants.h layout with a pooled swap
+     */
+    PhysicalMemory();
+
+    PhysicalMemory(const PhysicalMemory&) = delete;
+    PhysicalMemory& operator=(const PhysicalMemory&) = delete;
+
+    /* same contracts as the PM* functions of the same name.
+     * the swap holds the pages of 'addressSpaces' address spaces: its page indices carry the space
+     * number above the virtual page number (space << (virtualAddressWidth - offsetWidth) | page).
+     * with 'swapWorkers' threads, swap I/O goes through an AsyncSwapStore. */
+    void initialize(const Geometry& layout, SwapBackend backend = SWAP_POOLED, const std::string& swapPath = "",
+                    uint64_t addressSpaces = 1, uint64_t swapWorkers = 0);
+
+    void read(uint64_t physicalAddress, word_t* value) const {
+        assert(physicalAddress < geometry_.ramSize);
+        *value = ram_[physicalAddress];
+    }
+
+    void write(uint64_t physicalAddress, word_t value) {
+        assert(physicalAddress < geometry_.ramSize);
+        ram_[physicalAddress] = value;
+        dirty_[physicalAddress >> geometry_.offsetWidth] = 1;
+    }
+
+    /* read and write for the lock-free hits of a concurrent context (SharedAccess), which may run while
+     * other threads access other words of the frame */
+    word_t readShared(uint64_t physicalAddress) const {
+        assert(physicalAddress < geometry_.ramSize);
+        return __atomic_load_n(&ram_[physicalAddress], __ATOMIC_RELAXED);
+    }
+
+    void writeShared(uint64_t physicalAddress, word_t value) {
+        assert(physicalAddress < geometry_.ramSize);
+        __atomic_store_n(&ram_[physicalAddress], value, __ATOMIC_RELAXED);
+        __atomic_store_n(&dirty_[physicalAddress >> geometry_.offsetWidth], 1, __ATOMIC_RELAXED);
+    }
+
+    /* the page-table rows of a concurrent context: written under its allocator lock, read by lock-free
+     * walks, which then see the frame a row names as it was when the row was written */
+    word_t readEntryShared(uint64_t physicalAddress) const {
+        assert(physicalAddress < geometry_.ramSize);
+        return __atomic_load_n(&ram_[physicalAddress], __ATOMIC_ACQUIRE);
+    }
+
+    void writeEntryShared(uint64_t physicalAddress, word_t value) {
+        assert(physicalAddress < geometry_.ramSize);
+        __atomic_store_n(&ram_[physicalAddress], value, __ATOMIC_RELEASE);
+        __atomic_store_n(&dirty_[physicalAddress >> geometry_.offsetWidth], 1, __ATOMIC_RELAXED);
+    }
+
+    void readRange(uint64_t physicalAddress, word_t* values, uint64_t length) const;
+    void writeRange(uint64_t physicalAddress, const word_t* values, uint64_t length);
+    void evict(uint64_t frameIndex, uint64_t evictedPageIndex);
+    /* returns false when the page was not in swap (its first touch) */
+    bool restore(uint64_t frameIndex, uint64_t restoredPageIndex);
+    void evictRun(uint64_t firstFrame, uint64_t firstPage, uint64_t count);
+    uint64_t restoreRun(uint64_t firstFrame, uint64_t firstPage, uint64_t count, bool zeroFirstTouch = false);
+    bool inSwap(uint64_t pageIndex) const { return swap_->contains(pageIndex); }
+
+    /* swap I/O runs on worker threads: restores worth announcing early with prefetch() */
+    bool asyncSwap() const { return swapWorkers_ != 0; }
+    /* the page will likely be restored soon: lets the swap start reading it */
+    void prefetch(uint64_t pageIndex) { swap_->prefetch(pageIndex); }
+    bool isDirty(uint64_t frameIndex) const { return dirty_[frameIndex]; }
+
+    /* the next evict of this frame copies it, whatever its swap copy holds */
+    void markDirty(uint64_t frameIndex) { dirty_[frameIndex] = 1; }
+
+    /* copies frame 'from' into frame 'to' (which becomes dirty) */
+    void copyFrame(uint64_t to, uint64_t from);
+
+    /* zeroes a frame (which becomes dirty) */
+    void clearFrame(uint64_t frameIndex);
+
+    /* bit i set iff row firstRow + i of the frame is non-zero, for 'count' (at most 64) rows */
+    uint64_t nonZeroRows(uint64_t frameIndex, uint64_t firstRow, uint64_t count) const {
+        assert(frameIndex < geometry_.numFrames && firstRow + count <= geometry_.pageSize && count <= 64);
+        return pageKernels().nonZeroMask(&ram_[frameIndex * geometry_.pageSize + firstRow], count);
+    }
+
+    /* gives page 'to' a swap copy identical to the one of page 'from', which must exist */
+    void copySwap(uint64_t from, uint64_t to);
+
+    /* drops the swap copy of a page, if it has one */
+    void discard(uint64_t pageIndex) { swap_->erase(pageIndex); }
+    void print() const;
+
+    const Geometry& layout() const { return geometry_; }
+
+    /* the RAM as one array, the swap, and the layout the swap is built for (VMcheckpoint) */
+    const word_t* ram() const { return ram_.get(); }
+    const SwapStore& swap() const { return *swap_; }
+    const Geometry& swapLayout() const { return swapLayout_; }
+    static Geometry swapLayoutFor(const Geometry& layout, uint64_t addressSpaces);
+
+    /* after initialize() with the same layout: takes the RAM content, dirty bits and counters of a
+     * saved memory, and 'swap' as its swap, behind the swap workers of initialize() (VMrestore) */
+    void adopt(const word_t* ram, const std::vector<uint8_t>& dirty, uint64_t evictions, uint64_t writeBacks,
+               std::unique_ptr<SwapStore> swap);
+
+    /*
+     * number of PMevict calls since the last initialize()
+     */
+    uint64_t evictions() const { return evictions_; }
+
+    /*
+     * number of those evictions that copied the page to swap (the others found it clean)
+     */
+    uint64_t writeBacks() const { return writeBacks_; }
+
+private:
+    struct AlignedFree {
+        void operator()(word_t* memory) const;
+    };
+
+    // layout of RAM and of one address space
+    Geometry geometry_;
+    // layout of the swap: one virtual space widened by the space number
+    Geometry swapLayout_;
+    // number of page indices the swap accepts (numPages of every address space together)
+    uint64_t swapPages_ = 0;
+    uint64_t swapWorkers_ = 0;
+    // one contiguous array of RAM_SIZE words, indexed directly by physical address
+    std::unique_ptr<word_t[], AlignedFree> ram_;
+    std::unique_ptr<SwapStore> swap_;
+    // per frame: written since it was restored. a clean frame still matches its page's swap copy
+    std::vector<uint8_t> dirty_;
+    uint64_t evictions_ = 0;
+    uint64_t writeBacks_ = 0;
+};
+
+/*
+ * the instance behind the PM* functions
+ */
+PhysicalMemory& PMdefault();
+
+/*
+ * (re)creates an all-zero RAM and an empty swap of the given kind with the given layout,
+ * and resets the eviction counter. 'swapPath' names the backing file of SWAP_MAPPED
+ * (an anonymous temporary file when empty).
+ */
+void PMinitialize(const Geometry& layout, SwapBackend backend = SWAP_POOLED, const std::string& swapPath = "");
 
 /*
  * reads an integer from the given physical address and puts it in 'value'
@@ -14,18 +173,49 @@ void PMwrite(uint64_t physicalAddress, word_t value);
 
 
 /*
- * evicts a page from the RAM to the hard drive
+ * reads 'length' consecutive words starting at the given physical address into 'values'.
+ * the range must not cross a frame boundary.
+ */
+void PMreadRange(uint64_t physicalAddress, word_t* values, uint64_t length);
+
+/*
+ * writes 'length' consecutive words from 'values' starting at the given physical address.
+ * the range must not cross a frame boundary.
+ */
+void PMwriteRange(uint64_t physicalAddress, const word_t* values, uint64_t length);
+
+/*
+ * evicts a page from the RAM to the hard drive. a page that was not written since it was
+ * restored already has an identical copy there and is not copied again.
  */
 void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex);
 
 
 /*
- * restores a page from the hard drive to the RAM
+ * restores a page from the hard drive to the RAM. the swap keeps its copy until the page
+ * is written.
  */
 void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex);
 
 /*
- * print the current state of the ram.
+ * evicts the 'count' pages firstPage.. held by the frames firstFrame.. (a huge mapping) as a unit
+ */
+void PMevictRun(uint64_t firstFrame, uint64_t firstPage, uint64_t count);
+
+/*
+ * restores the 'count' pages firstPage.. into the frames firstFrame..; returns how many were in swap.
+ * with zeroFirstTouch the frames of the pages that were not in swap are zeroed.
+ */
+uint64_t PMrestoreRun(uint64_t firstFrame, uint64_t firstPage, uint64_t count, bool zeroFirstTouch = false);
+
+/*
+ * true if the given page currently has a copy in the swap
+ */
+bool PMinSwap(uint64_t pageIndex);
+
+/*
+ * print the current state of the ram: every word, one per line.
+ * VMdump (Inspect.h) prints only the live page tables and mappings.
  */
 void printRam();
 
@@ -0,0 +1,90 @@
+#include "Prefetcher.h"
+
+void Prefetcher::reset(uint64_t limit, uint64_t numFrames, uint64_t numPages)
+{
+    limit_ = limit;
+    window_ = limit;
+    numPages_ = numPages;
+    last_ = UINT64_MAX;
+    stride_ = 0;
+    confirmed_ = false;
+    frontier_ = UINT64_MAX;
+    pending_ = false;
+    unused_.assign(limit == 0 ? 0 : numFrames, false);
+    batch_.clear();
+}
+
+void Prefetcher::observe(uint64_t page)
+{
+    if (last_ != UINT64_MAX)
+    {
+        int64_t stride = (int64_t)(page - last_);
+        if (stride != 0 && stride == stride_)
+        {
+            confirmed_ = true;
+        }
+        else
+        {
+            /* a new stream (or none): start over from this pair */
+            stride_ = stride;
+            confirmed_ = false;
+            frontier_ = UINT64_MAX;
+        }
+    }
+    last_ = page;
+    pending_ = confirmed_;
+}
+
+const std::vector<uint64_t> &Prefetcher::take()
+{
+    batch_.clear();
+    pending_ = false;
+
+    for (uint64_t i = 1; i <= window_; ++i)
+    {
+        int64_t target = (int64_t)last_ + stride_ * (int64_t)i;
+        if (target < 0 || (uint64_t)target >= numPages_) break;
+
+        /* proposed by an earlier batch of the same stream */
+        if (frontier_ != UINT64_MAX &&
+            (stride_ > 0 ? (uint64_t)target <= frontier_ : (uint64_t)target >= frontier_)) continue;
+
+        batch_.push_back((uint64_t)target);
+        frontier_ = (uint64_t)target;
+    }
+    return batch_;
+}
+
+void Prefetcher::save(ImageWords &words) const
+{
+    words.insert(words.end(), {limit_, numPages_, window_, last_, (uint64_t)stride_, (uint64_t)confirmed_, frontier_,
+                               (uint64_t)pending_});
+    words.push_back(unused_.size());
+    for (uint64_t frame = 0; frame < unused_.size(); ++frame)
+    {
+        if (unused_[frame]) words.push_back(frame);
+    }
+    words.push_back(UINT64_MAX);
+}
+
+bool Prefetcher::load(ImageReader &words)
+{
+    words.expect(limit_);
+    words.expect(numPages_);
+    window_ = words.next();
+    last_ = words.next();
+    stride_ = (int64_t)words.next();
+    confirmed_ = words.next() != 0;
+    frontier_ = words.next();
+    pending_ = words.next() != 0;
+    words.expect(unused_.size());
+    if (words.failed() || window_ > limit_) return false;
+
+    /* the frames holding unused prefetched pages, ended by UINT64_MAX */
+    for (uint64_t frame = words.next(); frame != UINT64_MAX && !words.failed(); frame = words.next())
+    {
+        if (frame >= unused_.size()) return false;
+        unused_[frame] = true;
+    }
+    return !words.failed();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Checkpoint.h"
+#include <cstdint>
+#include <vector>
+
+/*
+ * Adaptive read-ahead: watches the stream of demand faults (and first uses of prefetched pages),
+ * and once two consecutive ones are the same stride apart, proposes the next 'window' pages of
+ * that stride. The window grows by one for every prefetched page that gets used and halves for
+ * every one evicted before its first use.
+ * It only decides what to fetch; walk() does the fetching, after the access that triggered it.
+ */
+class Prefetcher
+{
+public:
+    /*
+     * forget every stream. limit is the largest window (0 disables read-ahead).
+     */
+    void reset(uint64_t limit, uint64_t numFrames, uint64_t numPages);
+
+    bool enabled() const { return limit_ != 0; }
+
+    /*
+     * 'page' was faulted in on demand, or a prefetched page was used for the first time.
+     */
+    void observe(uint64_t page);
+
+    /*
+     * true if observe() found a stream whose next pages should be fetched now.
+     */
+    bool pending() const { return pending_; }
+
+    /*
+     * the pages to fetch, in stream order, skipping those a previous call already proposed.
+     * clears pending().
+     */
+    const std::vector<uint64_t> &take();
+
+    /*
+     * 'frame' now holds a page that was fetched ahead of its use.
+     */
+    void prefetched(uint64_t frame) { unused_[frame] = true; }
+
+    /*
+     * the page in 'frame' is being accessed. returns true if this is the first use of a prefetched page.
+     */
+    bool used(uint64_t frame)
+    {
+        if (!unused_[frame]) return false;
+        unused_[frame] = false;
+        if (window_ < limit_) window_++;
+        return true;
+    }
+
+    /*
+     * the page in 'frame' is being evicted. returns true if it was prefetched and never used.
+     */
+    bool evicted(uint64_t frame)
+    {
+        if (!unused_[frame]) return false;
+        unused_[frame] = false;
+        window_ = (window_ > 1) ? window_ / 2 : 1;
+        return true;
+    }
+
+    uint64_t window() const { return window_; }
+
+    /*
+     * appends the stream state to an image, and reads it back right after a reset() with the same
+     * arguments. load returns false if the words were saved by a prefetcher reset otherwise.
+     */
+    void save(ImageWords &words) const;
+    bool load(ImageReader &words);
+
+private:
+    uint64_t limit_ = 0;
+    uint64_t window_ = 0;
+    uint64_t numPages_ = 0;
+
+    uint64_t last_ = UINT64_MAX;     // the page last observed
+    int64_t stride_ = 0;
+    bool confirmed_ = false;         // the last two observations were stride_ apart
+    uint64_t frontier_ = UINT64_MAX; // the farthest page already proposed for this stream
+    bool pending_ = false;
+
+    std::vector<bool> unused_;       // by frame: holds a prefetched page not used yet
+    std::vector<uint64_t> batch_;
+};
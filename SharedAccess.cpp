@@ -0,0 +1,72 @@
+#include "SharedAccess.h"
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+/* tells the contexts apart (a new one may reuse the address of one destroyed) */
+static std::atomic<uint64_t> nextSerial{1};
+
+thread_local SharedAccess::ThreadState SharedAccess::thread_;
+
+SharedAccess::SharedAccess(uint64_t numFrames)
+    : serial_(nextSerial.fetch_add(1)), versions_(new std::atomic<uint64_t>[numFrames]), slots_(new Slots())
+{
+    for (uint64_t frame = 0; frame < numFrames; ++frame) versions_[frame].store(0, std::memory_order_relaxed);
+}
+
+/**
+ * frees the slot the thread holds, if any. its hazard is already clear: no access is running.
+ **/
+void SharedAccess::ThreadState::release()
+{
+    if (!slots) return;
+    {
+        std::lock_guard<std::mutex> lock(slots->claimLock);
+        Slot &slot = slots->slots[view.slot];
+        slot.frame.store(NO_FRAME, std::memory_order_release);
+        slot.taken = false;
+    }
+    slots.reset();
+    view.owner = 0;
+}
+
+SharedAccess::View &SharedAccess::view()
+{
+    ThreadState &state = thread_;
+    if (state.view.owner == serial_) return state.view;
+
+    state.release();
+    {
+        /* the lowest free slot, or a new one */
+        std::lock_guard<std::mutex> lock(slots_->claimLock);
+        uint64_t claimed = slots_->claimed.load(std::memory_order_relaxed);
+        uint64_t slot = 0;
+        while (slot < claimed && slots_->slots[slot].taken) slot++;
+        if (slot == SHARED_MAX_THREADS)
+        {
+            std::cerr << "concurrent context: more than " << SHARED_MAX_THREADS << " threads access it at once"
+                      << std::endl;
+            std::abort();
+        }
+        slots_->slots[slot].taken = true;
+        if (slot == claimed) slots_->claimed.store(claimed + 1); // before the thread's first hazard, see retire()
+        state.view.slot = slot;
+    }
+    state.slots = slots_;
+    for (Entry &entry : state.view.entries) entry = Entry();
+    state.view.owner = serial_;
+    return state.view;
+}
+
+/**
+ * the version bump and the hazards are sequentially consistent: either a thread announced 'frame'
+ * before the bump, and is waited for here, or it reads the new version in enter() and misses.
+ * a slot claimed after the bump belongs to a thread that reads the new version too.
+ **/
+void SharedAccess::retire(uint64_t frame)
+{
+    versions_[frame].fetch_add(1);
+    uint64_t claimed = slots_->claimed.load();
+    for (uint64_t slot = 0; slot < claimed; ++slot)
+        while (slots_->slots[slot].frame.load() == frame) std::this_thread::yield();
+}
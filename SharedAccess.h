@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// threads that may access one concurrent context (VMConfig::concurrent) at the same time
+#define SHARED_MAX_THREADS 256
+// the per-page fault locks, striped by page number
+#define SHARED_FAULT_STRIPES 64
+// entries of each thread's private translation cache (power of 2)
+#define SHARED_CACHE_ENTRIES 256
+
+/*
+ * What lets many threads access the single address space of one context at once.
+ *
+ * Every frame has a version, odd while the allocator is taking the frame away (evicting it, or reusing
+ * an empty table) and even otherwise. A thread uses a frame only after it
+ *     1. announces the frame in its hazard slot,
+ *     2. checks that the frame's version is still the even one it read earlier,
+ * and clears its slot when done. Before taking a frame away the allocator retires it: it makes the
+ * version odd and waits until no hazard slot names the frame, so no access that started from the old
+ * translation is still running while the frame is written back, cleared or refilled. It reissues the
+ * frame (makes the version even again) before linking it anew.
+ *
+ * A resident page takes no lock. Every thread caches page -> (frame, version) privately; a miss in
+ * that cache walks the page tables without locks, one announced table at a time: it accepts a child
+ * only once the row still names it after its version was read, so the child was linked there at that
+ * version. Only a missing row is a fault: it takes the page's fault lock, so the threads faulting one
+ * page queue behind one fault, and the allocator lock, which guards everything a fault touches (the
+ * tables being changed, the frame table, the shared TLB and walk cache, and the swap), from that row
+ * down. The tables are written with release stores and walked with acquire loads.
+ */
+class SharedAccess
+{
+public:
+    explicit SharedAccess(uint64_t numFrames);
+
+    SharedAccess(const SharedAccess &) = delete;
+    SharedAccess &operator=(const SharedAccess &) = delete;
+
+    struct Entry
+    {
+        uint64_t page = UINT64_MAX;
+        uint64_t frame = 0;
+        uint64_t version = 0;
+    };
+
+    /* a thread's hazard slot and translation cache for this context */
+    struct View
+    {
+        uint64_t owner = 0; // serial of the SharedAccess it belongs to
+        uint64_t slot = 0;
+        Entry entries[SHARED_CACHE_ENTRIES];
+
+        Entry &entry(uint64_t page) { return entries[page & (SHARED_CACHE_ENTRIES - 1)]; }
+    };
+
+    /*
+     * the calling thread's view, claiming a free slot on its first access. a thread holds a slot only in
+     * the context it accessed last: it gives it back when it exits or moves on to another context.
+     * more than SHARED_MAX_THREADS threads holding a slot at once is fatal.
+     */
+    View &view();
+
+    /* steps 1 and 2: true if 'frame' may be used until leave(), false if it went away since 'version' */
+    bool enter(const View &view, uint64_t frame, uint64_t version)
+    {
+        std::atomic<uint64_t> &hazard = slots_->slots[view.slot].frame;
+        hazard.store(frame);
+        if (versions_[frame].load() == version) return true;
+        hazard.store(NO_FRAME, std::memory_order_release);
+        return false;
+    }
+
+    bool enter(const View &view, const Entry &entry) { return enter(view, entry.frame, entry.version); }
+
+    void leave(const View &view) { slots_->slots[view.slot].frame.store(NO_FRAME, std::memory_order_release); }
+
+    /* the current version of 'frame': odd while it is being taken away */
+    uint64_t version(uint64_t frame) const { return versions_[frame].load(); }
+
+    /* under the allocator lock: invalidates every cached translation to 'frame' and waits out its users */
+    void retire(uint64_t frame);
+
+    /* under the allocator lock: 'frame', retired, is refilled and about to be linked again */
+    void reissue(uint64_t frame) { versions_[frame].fetch_add(1); }
+
+    std::mutex &faultLock(uint64_t page) { return faultLocks_[page % SHARED_FAULT_STRIPES]; }
+    std::mutex &allocatorLock() { return allocatorLock_; }
+
+private:
+    static constexpr uint64_t NO_FRAME = UINT64_MAX;
+
+    struct alignas(64) Slot
+    {
+        bool taken = false; // under Slots::claimLock
+        std::atomic<uint64_t> frame{NO_FRAME};
+    };
+
+    /* the hazard slots, owned together by the context and the threads holding one of them, so that a
+     * thread can give its slot back after the context is gone */
+    struct Slots
+    {
+        Slot slots[SHARED_MAX_THREADS];
+        std::atomic<uint64_t> claimed{0}; // slots ever handed out (free ones included), scanned by retire()
+        std::mutex claimLock;
+    };
+
+    /* the calling thread's view, and the slots of the context it holds one in */
+    struct ThreadState
+    {
+        View view;
+        std::shared_ptr<Slots> slots;
+
+        void release();
+        ~ThreadState() { release(); }
+    };
+    static thread_local ThreadState thread_;
+
+    uint64_t serial_;
+    std::unique_ptr<std::atomic<uint64_t>[]> versions_;
+    std::shared_ptr<Slots> slots_;
+    std::mutex faultLocks_[SHARED_FAULT_STRIPES];
+    std::mutex allocatorLock_;
+};
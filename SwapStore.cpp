@@ -0,0 +1,704 @@
+#include "SwapStore.h"
+#include "Compression.h"
+#include "PageKernels.h"
+#include "VMStats.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// the dense page -> slot index costs 8 bytes per virtual page, above this many pages hash instead
+#define DENSE_SWAP_INDEX_LIMIT (1ULL << 20)
+// initial number of hash buckets, doubled whenever the table gets half full
+#define SWAP_INDEX_MIN_BUCKETS 1024
+// the presence bitmap of a mapped store is padded to this, so the data region starts on an OS page
+// (of any size up to this) and the layout does not depend on the machine
+#define SWAP_BITMAP_ALIGNMENT (64 * 1024)
+// write-backs an asynchronous store holds (queued or being written) at most; a write beyond it waits
+#define ASYNC_QUEUE_PAGES 4096
+// read-ahead copies (and reads in flight) it holds at most
+#define ASYNC_AHEAD_PAGES 1024
+
+/**
+ * the swap cannot work without its backing file, so like any other failed system call this is fatal.
+ **/
+static void systemError(const char *what)
+{
+    std::cerr << "system error: " << what << ": " << std::strerror(errno) << std::endl;
+    std::exit(1);
+}
+
+std::unique_ptr<SwapStore> makeSwapStore(SwapBackend backend, const Geometry &layout, const std::string &path)
+{
+    switch (backend)
+    {
+        case SWAP_MAP:
+            return std::unique_ptr<SwapStore>(new MapSwapStore(layout));
+        case SWAP_POOLED:
+            return std::unique_ptr<SwapStore>(new PooledSwapStore(layout));
+        case SWAP_MAPPED:
+            return std::unique_ptr<SwapStore>(new MappedSwapStore(layout, path));
+        case SWAP_COMPRESSED:
+            return std::unique_ptr<SwapStore>(new CompressedSwapStore(layout));
+    }
+    assert(false);
+    return nullptr;
+}
+
+std::unique_ptr<SwapStore> makeAsync(std::unique_ptr<SwapStore> store, const Geometry &layout, uint64_t workers)
+{
+    if (workers == 0) return store;
+    return std::unique_ptr<SwapStore>(new AsyncSwapStore(std::move(store), layout, workers));
+}
+
+/* ===================================================================== */
+/*                              MAP STORE                                */
+/* ===================================================================== */
+
+bool MapSwapStore::contains(uint64_t page) const
+{
+    return pages_.find(page) != pages_.end();
+}
+
+void MapSwapStore::write(uint64_t page, const word_t *data)
+{
+    std::vector<word_t> &copy = pages_[page];
+    copy.assign(data, data + pageSize_);
+}
+
+bool MapSwapStore::read(uint64_t page, word_t *data) const
+{
+    auto it = pages_.find(page);
+    if (it == pages_.end()) return false;
+
+    std::memcpy(data, it->second.data(), pageSize_ * sizeof(word_t));
+    return true;
+}
+
+void MapSwapStore::erase(uint64_t page)
+{
+    pages_.erase(page);
+}
+
+void MapSwapStore::forEach(const std::function<void(uint64_t, const word_t *)> &visit) const
+{
+    for (const auto &entry : pages_) visit(entry.first, entry.second.data());
+}
+
+/* ===================================================================== */
+/*                             POOLED STORE                              */
+/* ===================================================================== */
+
+PooledSwapStore::PooledSwapStore(const Geometry &layout)
+    : pageSize_(layout.pageSize), dense_(layout.numPages <= DENSE_SWAP_INDEX_LIMIT)
+{
+    if (dense_)
+        denseIndex_.assign(layout.numPages, NO_SLOT);
+    else
+        buckets_.assign(SWAP_INDEX_MIN_BUCKETS, Bucket());
+}
+
+void PooledSwapStore::write(uint64_t page, const word_t *data)
+{
+    uint64_t slot = slotOf(page);
+    if (slot == NO_SLOT)
+    {
+        if (!freeSlots_.empty())
+        {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        }
+        else
+        {
+            slot = arena_.size() / pageSize_;
+            arena_.resize(arena_.size() + pageSize_);
+        }
+        setSlot(page, slot);
+    }
+    std::memcpy(slotData(slot), data, pageSize_ * sizeof(word_t));
+}
+
+bool PooledSwapStore::read(uint64_t page, word_t *data) const
+{
+    uint64_t slot = slotOf(page);
+    if (slot == NO_SLOT) return false;
+
+    std::memcpy(data, slotData(slot), pageSize_ * sizeof(word_t));
+    return true;
+}
+
+void PooledSwapStore::erase(uint64_t page)
+{
+    uint64_t slot = slotOf(page);
+    if (slot == NO_SLOT) return;
+
+    clearSlot(page);
+    freeSlots_.push_back(slot);
+}
+
+void PooledSwapStore::forEach(const std::function<void(uint64_t, const word_t *)> &visit) const
+{
+    if (dense_)
+    {
+        for (uint64_t page = 0; page < denseIndex_.size(); ++page)
+        {
+            if (denseIndex_[page] != NO_SLOT) visit(page, slotData(denseIndex_[page]));
+        }
+        return;
+    }
+    for (const Bucket &bucket : buckets_)
+    {
+        if (bucket.page != UINT64_MAX) visit(bucket.page, slotData(bucket.slot));
+    }
+}
+
+/* ------------------------- page -> slot index ------------------------ */
+
+uint64_t PooledSwapStore::bucketOf(uint64_t page) const
+{
+    // splitmix64 finalizer, so strided page numbers do not pile up in a few probe runs
+    uint64_t h = page;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return (h ^ (h >> 31)) & (buckets_.size() - 1);
+}
+
+uint64_t PooledSwapStore::slotOf(uint64_t page) const
+{
+    if (dense_) return denseIndex_[page];
+
+    for (uint64_t b = bucketOf(page); ; b = (b + 1) & (buckets_.size() - 1))
+    {
+        if (buckets_[b].page == page) return buckets_[b].slot;
+        if (buckets_[b].page == UINT64_MAX) return NO_SLOT;
+    }
+}
+
+void PooledSwapStore::setSlot(uint64_t page, uint64_t slot)
+{
+    if (dense_)
+    {
+        denseIndex_[page] = slot;
+        return;
+    }
+
+    if (2 * (used_ + 1) > buckets_.size()) growBuckets();
+
+    uint64_t b = bucketOf(page);
+    while (buckets_[b].page != UINT64_MAX) b = (b + 1) & (buckets_.size() - 1);
+    buckets_[b].page = page;
+    buckets_[b].slot = slot;
+    used_++;
+}
+
+void PooledSwapStore::clearSlot(uint64_t page)
+{
+    if (dense_)
+    {
+        denseIndex_[page] = NO_SLOT;
+        return;
+    }
+
+    uint64_t mask = buckets_.size() - 1;
+    uint64_t hole = bucketOf(page);
+    while (buckets_[hole].page != page) hole = (hole + 1) & mask;
+
+    /* backward-shift deletion: pull later members of the probe run into the hole so lookups
+     * never need tombstones */
+    for (uint64_t next = (hole + 1) & mask; buckets_[next].page != UINT64_MAX; next = (next + 1) & mask)
+    {
+        uint64_t home = bucketOf(buckets_[next].page);
+        // move it if its home is not cyclically within (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            buckets_[hole] = buckets_[next];
+            hole = next;
+        }
+    }
+    buckets_[hole] = Bucket();
+    used_--;
+}
+
+void PooledSwapStore::growBuckets()
+{
+    std::vector<Bucket> old;
+    old.swap(buckets_);
+    buckets_.assign(old.size() * 2, Bucket());
+    used_ = 0;
+    for (const Bucket &bucket : old)
+    {
+        if (bucket.page != UINT64_MAX) setSlot(bucket.page, bucket.slot);
+    }
+}
+
+/* ===================================================================== */
+/*                          MEMORY-MAPPED STORE                          */
+/* ===================================================================== */
+
+MappedSwapStore::MappedSwapStore(const Geometry &layout, const std::string &path) : pageSize_(layout.pageSize)
+{
+    if (path.empty())
+    {
+        /* anonymous swap: create a unique file and unlink it right away, it dies with the mapping */
+        const char *dir = std::getenv("TMPDIR");
+        std::string name = std::string(dir ? dir : "/tmp") + "/vmswap.XXXXXX";
+        fd_ = mkstemp(&name[0]);
+        if (fd_ < 0) systemError("cannot create the swap file");
+        unlink(name.c_str());
+    }
+    else
+    {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd_ < 0) systemError("cannot open the swap file");
+    }
+
+    /* layout: [presence bitmap, padded to SWAP_BITMAP_ALIGNMENT][NUM_PAGES * PAGE_SIZE words].
+     * ftruncate only sets the size; untouched parts of the file never get blocks. */
+    if (ftruncate(fd_, static_cast<off_t>(imageBytes(layout))) != 0) systemError("cannot size the swap file");
+    map(layout, MAP_SHARED, 0);
+}
+
+MappedSwapStore::MappedSwapStore(const Geometry &layout, int fd, uint64_t offset) : pageSize_(layout.pageSize)
+{
+    fd_ = dup(fd);
+    if (fd_ < 0) systemError("cannot open the image swap");
+    map(layout, MAP_PRIVATE, offset);
+}
+
+uint64_t MappedSwapStore::bitmapBytes(const Geometry &layout)
+{
+    uint64_t bytes = (layout.numPages + 63) / 64 * sizeof(uint64_t);
+    return (bytes + SWAP_BITMAP_ALIGNMENT - 1) / SWAP_BITMAP_ALIGNMENT * SWAP_BITMAP_ALIGNMENT;
+}
+
+uint64_t MappedSwapStore::imageBytes(const Geometry &layout)
+{
+    return bitmapBytes(layout) + layout.virtualMemorySize * sizeof(word_t);
+}
+
+void MappedSwapStore::map(const Geometry &layout, int flags, uint64_t offset)
+{
+    numPages_ = layout.numPages;
+    mappingBytes_ = imageBytes(layout);
+    mapping_ = mmap(nullptr, mappingBytes_, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, fd_,
+                    static_cast<off_t>(offset));
+    if (mapping_ == MAP_FAILED) systemError("cannot map the swap file");
+
+    bitmap_ = static_cast<uint64_t *>(mapping_);
+    data_ = reinterpret_cast<word_t *>(static_cast<char *>(mapping_) + bitmapBytes(layout));
+}
+
+MappedSwapStore::~MappedSwapStore()
+{
+    munmap(mapping_, mappingBytes_);
+    close(fd_);
+}
+
+void MappedSwapStore::write(uint64_t page, const word_t *data)
+{
+    std::memcpy(&data_[page * pageSize_], data, pageSize_ * sizeof(word_t));
+    __atomic_fetch_or(&bitmap_[page / 64], 1ULL << (page % 64), __ATOMIC_RELEASE);
+}
+
+bool MappedSwapStore::read(uint64_t page, word_t *data) const
+{
+    if (!contains(page)) return false;
+
+    std::memcpy(data, &data_[page * pageSize_], pageSize_ * sizeof(word_t));
+    return true;
+}
+
+void MappedSwapStore::forEach(const std::function<void(uint64_t, const word_t *)> &visit) const
+{
+    for (uint64_t w = 0; w < (numPages_ + 63) / 64; ++w)
+    {
+        for (uint64_t bits = bitmap_[w]; bits != 0; bits &= bits - 1)
+        {
+            uint64_t page = w * 64 + __builtin_ctzll(bits);
+            visit(page, &data_[page * pageSize_]);
+        }
+    }
+}
+
+/**
+ * writes 'bytes' bytes at 'offset' of 'fd', however many calls that takes.
+ **/
+static bool writeAt(int fd, const void *data, uint64_t bytes, uint64_t offset)
+{
+    const char *cursor = static_cast<const char *>(data);
+    while (bytes != 0)
+    {
+        ssize_t written = pwrite(fd, cursor, bytes, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        cursor += written;
+        bytes -= written;
+        offset += written;
+    }
+    return true;
+}
+
+bool MappedSwapStore::writeImage(int fd, uint64_t offset, const Geometry &layout, const SwapStore &store)
+{
+    if (ftruncate(fd, static_cast<off_t>(offset + imageBytes(layout))) != 0) return false;
+
+    uint64_t dataOffset = offset + bitmapBytes(layout);
+    std::vector<uint64_t> bitmap((layout.numPages + 63) / 64, 0);
+    bool written = true;
+    store.forEach([&](uint64_t page, const word_t *data) {
+        bitmap[page / 64] |= 1ULL << (page % 64);
+        uint64_t bytes = layout.pageSize * sizeof(word_t);
+        written = written && writeAt(fd, data, bytes, dataOffset + page * bytes);
+    });
+
+    /* only the bitmap words with a page get blocks, the others stay holes */
+    for (uint64_t w = 0; w < bitmap.size() && written; ++w)
+    {
+        if (bitmap[w] != 0) written = writeAt(fd, &bitmap[w], sizeof(uint64_t), offset + w * sizeof(uint64_t));
+    }
+    return written;
+}
+
+/* ===================================================================== */
+/*                            COMPRESSED STORE                           */
+/* ===================================================================== */
+
+#ifdef VM_STATS_TIMERS
+#define COMPRESSION_TIMER(total) StatsTimer compressionTimer(total)
+#else
+#define COMPRESSION_TIMER(total) ((void)0)
+#endif
+
+void CompressedSwapStore::write(uint64_t page, const word_t *data)
+{
+    uint64_t bytes = pageSize_ * sizeof(word_t);
+    Page &stored = pages_[page];
+    stats_.storedBytes -= stored.bytes.size();
+    stats_.bytesIn += bytes;
+    COMPRESSION_TIMER(stats_.compressTicks);
+
+    if (pageKernels().sameValue(data, pageSize_, stored.value))
+    {
+        stored.encoding = ENCODING_SAME_VALUE;
+        std::vector<uint8_t>().swap(stored.bytes);
+        if (stored.value == 0)
+        {
+            stats_.zeroPages++;
+            return;
+        }
+        stats_.sameValuePages++;
+        stats_.bytesOut += sizeof(word_t);
+        return;
+    }
+
+    /* a block must save something to be worth its decompression */
+    scratch_.resize(bytes);
+    size_t size = lz4Compress(reinterpret_cast<const uint8_t *>(data), bytes, scratch_.data(), bytes - 1);
+    if (size != 0)
+    {
+        stored.encoding = ENCODING_LZ4;
+        stored.bytes.assign(scratch_.begin(), scratch_.begin() + size);
+        stats_.compressedPages++;
+    }
+    else
+    {
+        stored.encoding = ENCODING_RAW;
+        const uint8_t *raw = reinterpret_cast<const uint8_t *>(data);
+        stored.bytes.assign(raw, raw + bytes);
+        stats_.rawPages++;
+    }
+    stats_.bytesOut += stored.bytes.size();
+    stats_.storedBytes += stored.bytes.size();
+}
+
+void CompressedSwapStore::decode(const Page &stored, word_t *data) const
+{
+    switch (stored.encoding)
+    {
+        case ENCODING_SAME_VALUE:
+            std::fill(data, data + pageSize_, stored.value);
+            return;
+        case ENCODING_LZ4:
+        {
+            COMPRESSION_TIMER(stats_.decompressTicks);
+            bool decoded = lz4Decompress(stored.bytes.data(), stored.bytes.size(), reinterpret_cast<uint8_t *>(data),
+                                         pageSize_ * sizeof(word_t));
+            assert(decoded);
+            (void)decoded;
+            return;
+        }
+        case ENCODING_RAW:
+            std::memcpy(data, stored.bytes.data(), stored.bytes.size());
+            return;
+    }
+}
+
+bool CompressedSwapStore::read(uint64_t page, word_t *data) const
+{
+    auto it = pages_.find(page);
+    if (it == pages_.end()) return false;
+    decode(it->second, data);
+    return true;
+}
+
+void CompressedSwapStore::erase(uint64_t page)
+{
+    auto it = pages_.find(page);
+    if (it == pages_.end()) return;
+    stats_.storedBytes -= it->second.bytes.size();
+    pages_.erase(it);
+}
+
+void CompressedSwapStore::forEach(const std::function<void(uint64_t, const word_t *)> &visit) const
+{
+    std::vector<word_t> data(pageSize_);
+    for (const auto &entry : pages_)
+    {
+        decode(entry.second, data.data());
+        visit(entry.first, data.data());
+    }
+}
+
+bool CompressedSwapStore::compressionStats(CompressionStats &stats) const
+{
+    stats = stats_;
+    return true;
+}
+
+/* ===================================================================== */
+/*                           ASYNCHRONOUS STORE                          */
+/* ===================================================================== */
+
+AsyncSwapStore::AsyncSwapStore(std::unique_ptr<SwapStore> store, const Geometry &layout, uint64_t workers)
+    : store_(std::move(store)), concurrent_(store_->concurrent()), pageSize_(layout.pageSize)
+{
+    assert(workers > 0 && workers <= SWAP_MAX_WORKERS);
+    for (uint64_t i = 0; i < workers; ++i) workers_.emplace_back(new Worker());
+    for (std::unique_ptr<Worker> &worker : workers_)
+    {
+        Worker *self = worker.get();
+        worker->thread = std::thread([this, self] { run(*self); });
+    }
+}
+
+AsyncSwapStore::~AsyncSwapStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (std::unique_ptr<Worker> &worker : workers_) worker->wake.notify_one();
+    }
+    for (std::unique_ptr<Worker> &worker : workers_) worker->thread.join();
+}
+
+std::vector<word_t> AsyncSwapStore::takeBuffer() const
+{
+    if (spare_.empty()) return std::vector<word_t>(pageSize_);
+    std::vector<word_t> buffer = std::move(spare_.back());
+    spare_.pop_back();
+    return buffer;
+}
+
+void AsyncSwapStore::storeWrite(const WriteBack &operation, uint64_t page)
+{
+    std::unique_lock<std::mutex> lock(storeMutex_, std::defer_lock);
+    if (!concurrent_) lock.lock();
+    if (operation.erase) store_->erase(page);
+    else store_->write(page, operation.data.data());
+}
+
+bool AsyncSwapStore::storeRead(uint64_t page, word_t *data) const
+{
+    std::unique_lock<std::mutex> lock(storeMutex_, std::defer_lock);
+    if (!concurrent_) lock.lock();
+    return store_->read(page, data);
+}
+
+bool AsyncSwapStore::storeContains(uint64_t page) const
+{
+    std::unique_lock<std::mutex> lock(storeMutex_, std::defer_lock);
+    if (!concurrent_) lock.lock();
+    return store_->contains(page);
+}
+
+/**
+ * a worker: takes its jobs in order, runs each without holding mutex_. it stops once the store is
+ * being destroyed and its write-backs are done (read-aheads left are dropped).
+ **/
+void AsyncSwapStore::run(Worker &worker)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        worker.wake.wait(lock, [&] { return stopping_ || !worker.jobs.empty(); });
+        if (worker.jobs.empty()) return;
+        uint64_t page = worker.jobs.front().first;
+        bool readAhead = worker.jobs.front().second;
+        worker.jobs.pop_front();
+
+        if (!readAhead)
+        {
+            /* the page's latest content: writes while it waited only replaced the queued copy */
+            auto queued = queued_.find(page);
+            WriteBack &running = running_[page]; // elements of an unordered_map never move
+            running = std::move(queued->second);
+            queued_.erase(queued);
+
+            lock.unlock();
+            storeWrite(running, page);
+            lock.lock();
+
+            if (running.data.size() == pageSize_) spare_.push_back(std::move(running.data));
+            running_.erase(page);
+            progress_.notify_all();
+            continue;
+        }
+
+        auto hint = hinted_.find(page);
+        if (hint == hinted_.end()) continue; // the page was read, written or erased in the meantime
+        if (stopping_)
+        {
+            hinted_.erase(hint);
+            continue;
+        }
+        hint->second = true;
+        std::vector<word_t> buffer = takeBuffer();
+
+        lock.unlock();
+        bool found = storeRead(page, buffer.data());
+        lock.lock();
+
+        /* a write or an erase queued during the read makes the copy stale */
+        hinted_.erase(page);
+        if (found && latest(page) == nullptr) ahead_[page] = std::move(buffer);
+        else spare_.push_back(std::move(buffer));
+        progress_.notify_all();
+    }
+}
+
+const AsyncSwapStore::WriteBack *AsyncSwapStore::latest(uint64_t page) const
+{
+    auto queued = queued_.find(page);
+    if (queued != queued_.end()) return &queued->second;
+    auto running = running_.find(page);
+    return running == running_.end() ? nullptr : &running->second;
+}
+
+void AsyncSwapStore::queue(uint64_t page, bool erase, const word_t *data)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    hinted_.erase(page);
+    auto ahead = ahead_.find(page);
+    if (ahead != ahead_.end())
+    {
+        spare_.push_back(std::move(ahead->second));
+        ahead_.erase(ahead);
+    }
+
+    auto queued = queued_.find(page);
+    if (queued == queued_.end())
+    {
+        progress_.wait(lock, [&] { return queued_.size() + running_.size() < ASYNC_QUEUE_PAGES; });
+        queued = queued_.emplace(page, WriteBack()).first;
+        Worker &worker = workerOf(page);
+        worker.jobs.emplace_back(page, false);
+        if (worker.jobs.size() == 1) worker.wake.notify_one(); // it only sleeps with nothing to do
+    }
+
+    WriteBack &writeBack = queued->second;
+    writeBack.erase = erase;
+    if (erase) return;
+    if (writeBack.data.size() != pageSize_) writeBack.data = takeBuffer();
+    std::memcpy(writeBack.data.data(), data, pageSize_ * sizeof(word_t));
+}
+
+void AsyncSwapStore::write(uint64_t page, const word_t *data)
+{
+    queue(page, false, data);
+}
+
+void AsyncSwapStore::erase(uint64_t page)
+{
+    queue(page, true, nullptr);
+}
+
+bool AsyncSwapStore::contains(uint64_t page) const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (const WriteBack *pending = latest(page)) return !pending->erase;
+    lock.unlock();
+
+    /* nothing can reach the store for this page now: only write() and erase() queue work on it */
+    return storeContains(page);
+}
+
+bool AsyncSwapStore::read(uint64_t page, word_t *data) const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (const WriteBack *pending = latest(page))
+    {
+        if (pending->erase) return false;
+        std::memcpy(data, pending->data.data(), pageSize_ * sizeof(word_t));
+        return true;
+    }
+
+    auto hint = hinted_.find(page);
+    if (hint != hinted_.end())
+    {
+        if (hint->second) progress_.wait(lock, [&] { return hinted_.count(page) == 0; }); // nearly there
+        else hinted_.erase(hint); // still waiting for its worker: reading it here is sooner
+    }
+    auto ahead = ahead_.find(page);
+    if (ahead != ahead_.end())
+    {
+        std::memcpy(data, ahead->second.data(), pageSize_ * sizeof(word_t));
+        spare_.push_back(std::move(ahead->second));
+        ahead_.erase(ahead);
+        return true;
+    }
+    lock.unlock();
+    return storeRead(page, data);
+}
+
+void AsyncSwapStore::prefetch(uint64_t page)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ || latest(page) != nullptr || hinted_.count(page) != 0 || ahead_.count(page) != 0) return;
+    if (hinted_.size() + ahead_.size() >= ASYNC_AHEAD_PAGES)
+    {
+        if (ahead_.size() < ASYNC_AHEAD_PAGES / 2) return; // wait for the reads in flight
+        /* hints outlive their use when the pages are mapped some other way: drop the copies nobody took */
+        for (auto &copy : ahead_) spare_.push_back(std::move(copy.second));
+        ahead_.clear();
+    }
+
+    hinted_.emplace(page, false);
+    Worker &worker = workerOf(page);
+    worker.jobs.emplace_back(page, true);
+    if (worker.jobs.size() == 1) worker.wake.notify_one();
+}
+
+void AsyncSwapStore::flush() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    progress_.wait(lock, [&] { return queued_.empty() && running_.empty(); });
+}
+
+void AsyncSwapStore::forEach(const std::function<void(uint64_t, const word_t *)> &visit) const
+{
+    flush();
+    std::unique_lock<std::mutex> lock(storeMutex_);
+    store_->forEach(visit);
+}
+
+bool AsyncSwapStore::compressionStats(CompressionStats &stats) const
+{
+    flush();
+    std::lock_guard<std::mutex> lock(storeMutex_);
+    return store_->compressionStats(stats);
+}
@@ -0,0 +1,348 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include "Geometry.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Where evicted pages live.
+ */
+enum SwapBackend
+{
+    SWAP_MAP,    // std::unordered_map of page vectors (the original store)
+    SWAP_POOLED, // slab of PAGE_SIZE-word slots with a page -> slot index
+    SWAP_MAPPED, // sparse memory-mapped file, page p at word offset p * PAGE_SIZE
+    SWAP_COMPRESSED // in memory, compressed: same-value (and zero) pages as one word, others LZ4
+};
+
+/*
+ * What a SWAP_COMPRESSED store did with the pages written to it since it was created.
+ */
+struct CompressionStats
+{
+    uint64_t zeroPages = 0;       // pages of zeros, kept without any storage
+    uint64_t sameValuePages = 0;  // other pages whose words all hold one value, kept as that word
+    uint64_t compressedPages = 0; // pages kept as an LZ4 block
+    uint64_t rawPages = 0;        // pages LZ4 could not shrink, kept as they are
+    uint64_t bytesIn = 0;         // bytes of the pages written
+    uint64_t bytesOut = 0;        // bytes they were kept in: bytesIn / bytesOut is the compression ratio
+    uint64_t storedBytes = 0;     // bytes held now by the pages still stored
+    // ticks (as VMStats, counted with -DVM_STATS_TIMERS only) spent compressing and decompressing
+    uint64_t compressTicks = 0;
+    uint64_t decompressTicks = 0;
+};
+
+/*
+ * The "hard drive" behind PMevict/PMrestore: a set of virtual pages, each holding PAGE_SIZE words.
+ */
+class SwapStore
+{
+public:
+    virtual ~SwapStore() = default;
+
+    virtual bool contains(uint64_t page) const = 0;
+
+    /*
+     * stores a copy of 'data' as the content of 'page', replacing any previous copy.
+     */
+    virtual void write(uint64_t page, const word_t *data) = 0;
+
+    /*
+     * copies the content of 'page' into 'data'. returns false (and copies nothing) if it is not stored.
+     */
+    virtual bool read(uint64_t page, word_t *data) const = 0;
+
+    /*
+     * forgets 'page', if stored.
+     */
+    virtual void erase(uint64_t page) = 0;
+
+    /*
+     * calls visit(page, data) once for every stored page, in no particular order.
+     */
+    virtual void forEach(const std::function<void(uint64_t, const word_t *)> &visit) const = 0;
+
+    /*
+     * a hint that 'page' will be read soon. a store that reads asynchronously may start reading it now.
+     */
+    virtual void prefetch(uint64_t page) { (void)page; }
+
+    /*
+     * true if calls on different pages may run on several threads at once.
+     */
+    virtual bool concurrent() const { return false; }
+
+    /*
+     * puts the compression counters of the store in 'stats'. returns false if it does not compress.
+     */
+    virtual bool compressionStats(CompressionStats &stats) const
+    {
+        (void)stats;
+        return false;
+    }
+};
+
+/*
+ * creates an empty store. 'path' is only used by SWAP_MAPPED: the backing file to (re)create,
+ * or an anonymous temporary file when empty.
+ */
+std::unique_ptr<SwapStore> makeSwapStore(SwapBackend backend, const Geometry &layout, const std::string &path = "");
+
+// the most worker threads an AsyncSwapStore takes
+#define SWAP_MAX_WORKERS 64
+
+/*
+ * Evicted pages kept compressed in memory (zswap-style). A page whose words all hold one value is kept
+ * as that value (nothing at all for a zero page); any other page as an LZ4 block, or as it is when LZ4
+ * cannot shrink it.
+ */
+class CompressedSwapStore : public SwapStore
+{
+public:
+    explicit CompressedSwapStore(const Geometry &layout) : pageSize_(layout.pageSize) {}
+
+    bool contains(uint64_t page) const override { return pages_.count(page) != 0; }
+    void write(uint64_t page, const word_t *data) override;
+    bool read(uint64_t page, word_t *data) const override;
+    void erase(uint64_t page) override;
+    void forEach(const std::function<void(uint64_t, const word_t *)> &visit) const override;
+    bool compressionStats(CompressionStats &stats) const override;
+
+private:
+    enum Encoding : uint8_t
+    {
+        ENCODING_SAME_VALUE, // every word holds 'value'
+        ENCODING_LZ4,        // 'bytes' is an LZ4 block
+        ENCODING_RAW         // 'bytes' is the page
+    };
+
+    struct Page
+    {
+        Encoding encoding = ENCODING_SAME_VALUE;
+        word_t value = 0;
+        std::vector<uint8_t> bytes;
+    };
+
+    void decode(const Page &stored, word_t *data) const;
+
+    uint64_t pageSize_;
+    std::unordered_map<uint64_t, Page> pages_;
+    std::vector<uint8_t> scratch_; // LZ4 output, before it is known to be worth keeping
+    mutable CompressionStats stats_;
+};
+
+/*
+ * 'store' behind an AsyncSwapStore with the given number of worker threads, or 'store' itself for 0.
+ */
+std::unique_ptr<SwapStore> makeAsync(std::unique_ptr<SwapStore> store, const Geometry &layout, uint64_t workers);
+
+/*
+ * The original store: one heap-allocated vector per evicted page.
+ */
+class MapSwapStore : public SwapStore
+{
+public:
+    explicit MapSwapStore(const Geometry &layout) : pageSize_(layout.pageSize) {}
+
+    bool contains(uint64_t page) const override;
+    void write(uint64_t page, const word_t *data) override;
+    bool read(uint64_t page, word_t *data) const override;
+    void erase(uint64_t page) override;
+    void forEach(const std::function<void(uint64_t, const word_t *)> &visit) const override;
+
+private:
+    uint64_t pageSize_;
+    std::unordered_map<uint64_t, std::vector<word_t>> pages_;
+};
+
+/*
+ * Evicted pages live in fixed-size slots of one growing arena. Freed slots are recycled through a
+ * free list, so once the arena reached its working size eviction and restore allocate nothing.
+ * The page -> slot index is a dense array when NUM_PAGES is small enough, and an open-addressing
+ * hash table (linear probing, backward-shift deletion) for sparse large virtual spaces.
+ */
+class PooledSwapStore : public SwapStore
+{
+public:
+    explicit PooledSwapStore(const Geometry &layout);
+
+    bool contains(uint64_t page) const override { return slotOf(page) != NO_SLOT; }
+    void write(uint64_t page, const word_t *data) override;
+    bool read(uint64_t page, word_t *data) const override;
+    void erase(uint64_t page) override;
+    void forEach(const std::function<void(uint64_t, const word_t *)> &visit) const override;
+
+private:
+    static constexpr uint64_t NO_SLOT = UINT64_MAX;
+
+    struct Bucket
+    {
+        uint64_t page = UINT64_MAX; // UINT64_MAX marks an empty bucket
+        uint64_t slot = 0;
+    };
+
+    uint64_t slotOf(uint64_t page) const;
+    void setSlot(uint64_t page, uint64_t slot);
+    void clearSlot(uint64_t page);
+
+    uint64_t bucketOf(uint64_t page) const;
+    void growBuckets();
+
+    word_t *slotData(uint64_t slot) { return &arena_[slot * pageSize_]; }
+    const word_t *slotData(uint64_t slot) const { return &arena_[slot * pageSize_]; }
+
+    uint64_t pageSize_;
+    std::vector<word_t> arena_;
+    std::vector<uint64_t> freeSlots_;
+
+    bool dense_;
+    std::vector<uint64_t> denseIndex_;  // page -> slot, used when dense_
+    std::vector<Bucket> buckets_;       // used otherwise, size is a power of 2
+    uint64_t used_ = 0;
+};
+
+/*
+ * Evicted pages live in a sparse file mapped into memory, so residency is left to the OS page cache
+ * instead of the heap. Page p occupies words [p * PAGE_SIZE, (p + 1) * PAGE_SIZE) of the data region;
+ * a presence bitmap in front of it (also sparse) tells stored pages from holes.
+ * The same layout is the swap section of a simulator image (Checkpoint.h).
+ * Pages are independent but for their bitmap words, which are updated atomically, so different pages
+ * can be stored and read from several threads at once.
+ */
+class MappedSwapStore : public SwapStore
+{
+public:
+    MappedSwapStore(const Geometry &layout, const std::string &path);
+
+    /*
+     * a store over the swap section of an image: the imageBytes(layout) bytes of 'fd' at 'offset'
+     * (a multiple of the OS page size), mapped privately, so writes to the store never reach the file.
+     */
+    MappedSwapStore(const Geometry &layout, int fd, uint64_t offset);
+    ~MappedSwapStore() override;
+
+    MappedSwapStore(const MappedSwapStore &) = delete;
+    MappedSwapStore &operator=(const MappedSwapStore &) = delete;
+
+    bool contains(uint64_t page) const override
+    {
+        return (__atomic_load_n(&bitmap_[page / 64], __ATOMIC_ACQUIRE) >> (page % 64)) & 1;
+    }
+    void write(uint64_t page, const word_t *data) override;
+    bool read(uint64_t page, word_t *data) const override;
+    void erase(uint64_t page) override { __atomic_fetch_and(&bitmap_[page / 64], ~(1ULL << (page % 64)), __ATOMIC_RELEASE); }
+    void forEach(const std::function<void(uint64_t, const word_t *)> &visit) const override;
+    bool concurrent() const override { return true; }
+
+    /*
+     * the size of the file (or image section) holding the pages of 'layout'.
+     */
+    static uint64_t imageBytes(const Geometry &layout);
+
+    /*
+     * writes the pages of 'store' in this layout into the imageBytes(layout) bytes of 'fd' at 'offset',
+     * leaving the parts no page uses as holes. returns false if the file cannot be written.
+     */
+    static bool writeImage(int fd, uint64_t offset, const Geometry &layout, const SwapStore &store);
+
+private:
+    static uint64_t bitmapBytes(const Geometry &layout);
+    void map(const Geometry &layout, int flags, uint64_t offset);
+
+    uint64_t pageSize_;
+    uint64_t numPages_ = 0;
+    int fd_ = -1;
+    void *mapping_ = nullptr;
+    uint64_t mappingBytes_ = 0;
+    uint64_t *bitmap_ = nullptr;
+    word_t *data_ = nullptr;
+};
+
+/*
+ * Asynchronous swap I/O in front of another store. write() only queues a copy of the page: worker
+ * threads write the queue back to the store behind the simulation, and a page written again before
+ * its turn is written back once, with its latest content. Reads, contains() and erase() see the queue
+ * first, so a page restored while its write-back is still queued is served from the queue.
+ * prefetch() hands a read to the workers, whose copy the next read() of the page takes, so the swap-ins
+ * the simulator knows are coming (bulk accesses, read-ahead, huge runs) overlap instead of each waiting
+ * for its own. Every page goes to the same worker, so its operations reach the store in order; a store
+ * that is not concurrent() is accessed by one thread at a time.
+ * Semantically it is the store it wraps: the simulation sees the same pages, only the blocking moves.
+ */
+class AsyncSwapStore : public SwapStore
+{
+public:
+    AsyncSwapStore(std::unique_ptr<SwapStore> store, const Geometry &layout, uint64_t workers);
+
+    /*
+     * writes the queue back, then stops the workers.
+     */
+    ~AsyncSwapStore() override;
+
+    AsyncSwapStore(const AsyncSwapStore &) = delete;
+    AsyncSwapStore &operator=(const AsyncSwapStore &) = delete;
+
+    bool contains(uint64_t page) const override;
+    void write(uint64_t page, const word_t *data) override;
+    bool read(uint64_t page, word_t *data) const override;
+    void erase(uint64_t page) override;
+    void forEach(const std::function<void(uint64_t, const word_t *)> &visit) const override;
+    void prefetch(uint64_t page) override;
+    bool compressionStats(CompressionStats &stats) const override;
+
+    /*
+     * waits until every queued write-back reached the wrapped store.
+     */
+    void flush() const;
+
+private:
+    /* a queued or running write-back: the page's latest content, or its removal */
+    struct WriteBack
+    {
+        bool erase = false;
+        std::vector<word_t> data;
+    };
+
+    struct Worker
+    {
+        std::thread thread;
+        std::deque<std::pair<uint64_t, bool>> jobs; // (page, is a read-ahead), in arrival order
+        std::condition_variable wake;
+    };
+
+    Worker &workerOf(uint64_t page) const { return *workers_[page % workers_.size()]; }
+    void run(Worker &worker);
+    void queue(uint64_t page, bool erase, const word_t *data);
+    /* the latest queued or running operation on 'page', nullptr if there is none. needs mutex_ */
+    const WriteBack *latest(uint64_t page) const;
+
+    /* calls on the wrapped store, serialized unless it is concurrent() */
+    void storeWrite(const WriteBack &operation, uint64_t page);
+    bool storeRead(uint64_t page, word_t *data) const;
+    bool storeContains(uint64_t page) const;
+    std::vector<word_t> takeBuffer() const;
+
+    std::unique_ptr<SwapStore> store_;
+    bool concurrent_;
+    uint64_t pageSize_;
+    mutable std::mutex storeMutex_;
+
+    /* everything below is guarded by mutex_; reads change it too (they take read-ahead copies) */
+    mutable std::mutex mutex_;
+    mutable std::condition_variable progress_; // a write-back or read-ahead finished
+    std::vector<std::unique_ptr<Worker>> workers_;
+    bool stopping_ = false;
+    std::unordered_map<uint64_t, WriteBack> queued_;  // write-backs not picked up yet, one per page
+    std::unordered_map<uint64_t, WriteBack> running_; // write-backs being written to the store
+    mutable std::unordered_map<uint64_t, bool> hinted_;                 // read-aheads: page -> being read
+    mutable std::unordered_map<uint64_t, std::vector<word_t>> ahead_;   // finished read-aheads
+    mutable std::vector<std::vector<word_t>> spare_;                    // recycled page buffers
+};
@@ -0,0 +1,213 @@
+#include "Sweep.h"
+#include "VMContext.h"
+#include "TraceFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// reads of a run are replayed through a buffer of this many words
+#define SWEEP_READ_CHUNK 4096
+
+/* ===================================================================== */
+/*                                 TRACE                                 */
+/* ===================================================================== */
+
+void Trace::append(bool isWrite, uint64_t virtualAddress, word_t value)
+{
+    if (runs_.empty() || runs_.back().isWrite != isWrite)
+        runs_.push_back(Run{isWrite, addresses_.size(), addresses_.size()});
+
+    addresses_.push_back(virtualAddress);
+    values_.push_back(isWrite ? value : 0);
+    runs_.back().end = addresses_.size();
+}
+
+bool Trace::load(const std::string &path, Trace &trace)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    char magic[TRACE_MAGIC_SIZE] = {};
+    in.read(magic, TRACE_MAGIC_SIZE);
+    if (in.gcount() == TRACE_MAGIC_SIZE && std::memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) == 0)
+    {
+        TraceReplayer binary;
+        if (!binary.open(path)) return false;
+        binary.decode(trace);
+        return true;
+    }
+    in.clear();
+    in.seekg(0);
+
+    std::ostringstream content;
+    content << in.rdbuf();
+    const std::string text = content.str();
+
+    /* hand-rolled tokenizer: istream extraction is far slower than the simulator on big traces */
+    const char *cursor = text.c_str();
+    const char *end = cursor + text.size();
+    while (cursor < end)
+    {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n')) ++cursor;
+        if (cursor == end) break;
+
+        if (*cursor == '#')
+        {
+            while (cursor < end && *cursor != '\n') ++cursor;
+            continue;
+        }
+
+        char op = *cursor++;
+        bool isWrite = (op == 'W' || op == 'w');
+        if (!isWrite && op != 'R' && op != 'r') return false;
+
+        char *next;
+        uint64_t va = std::strtoull(cursor, &next, 0);
+        if (next == cursor) return false;
+        cursor = next;
+
+        word_t value = 0;
+        if (isWrite)
+        {
+            value = static_cast<word_t>(std::strtoll(cursor, &next, 0));
+            if (next == cursor) return false;
+            cursor = next;
+        }
+        trace.append(isWrite, va, value);
+    }
+    return true;
+}
+
+/* ===================================================================== */
+/*                           WORK-STEALING POOL                          */
+/* ===================================================================== */
+
+/**
+ * runs job(0..tasks-1) on 'workers' threads. every worker owns a deque seeded round-robin,
+ * pops from its back and, once it runs dry, steals from the front of the others', so a few
+ * slow configurations (large geometries, scan-mode allocators) do not leave cores idle.
+ **/
+template <class Job>
+static void runStealing(size_t tasks, unsigned workers, Job job)
+{
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+    std::vector<Queue> queues(workers);
+    for (size_t task = 0; task < tasks; ++task)
+        queues[task % workers].tasks.push_back(task);
+
+    auto take = [&](unsigned self, size_t &task) -> bool {
+        {
+            std::lock_guard<std::mutex> guard(queues[self].lock);
+            if (!queues[self].tasks.empty())
+            {
+                task = queues[self].tasks.back();
+                queues[self].tasks.pop_back();
+                return true;
+            }
+        }
+        for (unsigned k = 1; k < workers; ++k)
+        {
+            Queue &victim = queues[(self + k) % workers];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned self = 0; self < workers; ++self)
+    {
+        threads.emplace_back([&, self] {
+            size_t task;
+            while (take(self, task)) job(task);
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+}
+
+/* ===================================================================== */
+/*                                 SWEEP                                 */
+/* ===================================================================== */
+
+static SweepResult replay(const Trace &trace, const SweepConfig &sweep)
+{
+    SweepResult result;
+    result.name = sweep.name;
+    result.accesses = trace.size();
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+        if (trace.addresses()[i] >= sweep.geometry.virtualMemorySize) result.failed++;
+    }
+
+    VMContext ctx;
+    VMinitialize(ctx, sweep.geometry, sweep.config);
+    std::vector<word_t> sink(SWEEP_READ_CHUNK);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const Trace::Run &run : trace.runs())
+    {
+        if (run.isWrite)
+        {
+            VMwriteBulk(ctx, trace.addresses() + run.begin, trace.values() + run.begin, run.end - run.begin);
+            continue;
+        }
+        for (size_t at = run.begin; at < run.end; at += SWEEP_READ_CHUNK)
+        {
+            size_t n = std::min<size_t>(SWEEP_READ_CHUNK, run.end - at);
+            VMreadBulk(ctx, trace.addresses() + at, sink.data(), n);
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.pageFaults = ctx.pageFaults;
+    result.evictions = ctx.memory->evictions();
+    result.writeBacks = ctx.memory->writeBacks();
+    return result;
+}
+
+std::vector<SweepResult> VMsweep(const Trace &trace, const std::vector<SweepConfig> &configs, unsigned threads)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(configs.size(), 1)));
+
+    std::vector<SweepResult> results(configs.size());
+    runStealing(configs.size(), threads, [&](size_t i) { results[i] = replay(trace, configs[i]); });
+    return results;
+}
+
+void printSweep(std::ostream &out, const std::vector<SweepResult> &results)
+{
+    size_t nameWidth = 6;
+    for (const SweepResult &result : results) nameWidth = std::max(nameWidth, result.name.size());
+
+    out << std::left << std::setw(nameWidth) << "config" << std::right
+        << std::setw(14) << "accesses" << std::setw(10) << "failed"
+        << std::setw(14) << "faults" << std::setw(14) << "evictions"
+        << std::setw(14) << "write-backs"
+        << std::setw(12) << "seconds" << '\n';
+    for (const SweepResult &result : results)
+    {
+        out << std::left << std::setw(nameWidth) << result.name << std::right
+            << std::setw(14) << result.accesses << std::setw(10) << result.failed
+            << std::setw(14) << result.pageFaults << std::setw(14) << result.evictions
+            << std::setw(14) << result.writeBacks
+            << std::setw(12) << std::fixed << std::setprecision(4) << result.seconds << '\n';
+    }
+    out.flush();
+}
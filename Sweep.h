@@ -0,0 +1,77 @@
+#pragma once
+
+#include "VirtualMemory.h"
+#include "Geometry.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * An access trace held in memory, parsed once and shared read-only by every replay.
+ * Consecutive accesses of the same kind are grouped into runs so a replay can feed them
+ * to VMreadBulk/VMwriteBulk.
+ */
+class Trace
+{
+public:
+    /*
+     * parses a text trace: one access per line, "R <va>" or "W <va> <value>" (case-insensitive,
+     * numbers in decimal or 0x-hex), blank lines and lines starting with '#' are ignored.
+     * a binary trace (TraceFile.h) is recognized by its magic and decoded instead.
+     * returns false if the file cannot be read or a line is malformed.
+     */
+    static bool load(const std::string &path, Trace &trace);
+
+    void append(bool isWrite, uint64_t virtualAddress, word_t value);
+
+    size_t size() const { return addresses_.size(); }
+
+    struct Run
+    {
+        bool isWrite;
+        size_t begin;
+        size_t end;
+    };
+
+    const std::vector<Run> &runs() const { return runs_; }
+    const uint64_t *addresses() const { return addresses_.data(); }
+    const word_t *values() const { return values_.data(); }
+
+private:
+    std::vector<uint64_t> addresses_;
+    std::vector<word_t> values_; // 0 for reads
+    std::vector<Run> runs_;
+};
+
+/*
+ * One configuration of a sweep.
+ */
+struct SweepConfig
+{
+    std::string name;
+    Geometry geometry;
+    VMConfig config;
+};
+
+struct SweepResult
+{
+    std::string name;
+    uint64_t accesses = 0;
+    uint64_t failed = 0;     // accesses outside the virtual memory of that geometry
+    uint64_t pageFaults = 0;
+    uint64_t evictions = 0;  // PMevict calls
+    uint64_t writeBacks = 0; // evictions that copied a dirty page to swap
+    double seconds = 0;      // wall time of the replay, excluding VMinitialize
+};
+
+/*
+ * replays the trace once per configuration, each on its own VMContext, on a work-stealing
+ * pool of 'threads' workers (0 = one per hardware thread). results are in the order of 'configs'.
+ */
+std::vector<SweepResult> VMsweep(const Trace &trace, const std::vector<SweepConfig> &configs, unsigned threads = 0);
+
+/*
+ * prints the results as an aligned table.
+ */
+void printSweep(std::ostream &out, const std::vector<SweepResult> &results);
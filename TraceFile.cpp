@@ -0,0 +1,241 @@
+#include "TraceFile.h"
+#include "VMContext.h"
+#include "Sweep.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a replay hands at most this many accesses to one bulk call
+#define TRACE_REPLAY_CHUNK 4096
+
+static void putWord32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t getWord32(const uint8_t *in)
+{
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+/* ===================================================================== */
+/*                                RECORDER                               */
+/* ===================================================================== */
+
+bool TraceRecorder::open(const std::string &path)
+{
+    close();
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) return false;
+
+    failed_ = std::fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, file_) != TRACE_MAGIC_SIZE;
+    payload_.clear();
+    payload_.reserve(TRACE_BLOCK_BYTES + MAX_RECORD);
+    records_ = 0;
+    total_ = 0;
+    lastAddress_ = 0;
+    lastValue_ = 0;
+    return !failed_;
+}
+
+void TraceRecorder::flushBlock()
+{
+    if (records_ != 0 && file_ != nullptr)
+    {
+        uint8_t header[TRACE_BLOCK_HEADER];
+        putWord32(header, records_);
+        putWord32(header + 4, (uint32_t)payload_.size());
+        if (std::fwrite(header, 1, sizeof(header), file_) != sizeof(header) ||
+            std::fwrite(payload_.data(), 1, payload_.size(), file_) != payload_.size())
+        {
+            failed_ = true;
+        }
+    }
+    total_ += records_;
+    records_ = 0;
+    payload_.clear();
+    lastAddress_ = 0;
+    lastValue_ = 0;
+}
+
+bool TraceRecorder::close()
+{
+    if (file_ == nullptr) return !failed_;
+
+    flushBlock();
+    if (std::fclose(file_) != 0) failed_ = true;
+    file_ = nullptr;
+    return !failed_;
+}
+
+void VMrecord(VMContext &context, TraceRecorder *recorder)
+{
+    context.recorder = recorder;
+}
+
+void VMrecord(TraceRecorder *recorder)
+{
+    VMrecord(VMdefaultContext(), recorder);
+}
+
+/* ===================================================================== */
+/*                                REPLAYER                               */
+/* ===================================================================== */
+
+/**
+ * decodes one varint, or returns false if it runs past 'end' or past 64 bits.
+ **/
+static inline bool getVarint(const uint8_t *&cursor, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && cursor < end; shift += 7)
+    {
+        uint8_t byte = *cursor++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static inline int64_t unzigzag(uint64_t n)
+{
+    return (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+}
+
+/**
+ * decodes a block payload, calling record(isWrite, va, value) for each of its 'records' accesses.
+ * returns false if the payload is malformed.
+ **/
+template <class Record>
+static bool decodeBlock(const uint8_t *cursor, const uint8_t *end, uint32_t records, Record record)
+{
+    uint64_t va = 0;
+    int64_t value = 0;
+    for (uint32_t i = 0; i < records; ++i)
+    {
+        uint64_t tag;
+        if (!getVarint(cursor, end, tag)) return false;
+        va += (uint64_t)unzigzag(tag >> 1);
+
+        bool isWrite = tag & 1;
+        if (isWrite)
+        {
+            uint64_t delta;
+            if (!getVarint(cursor, end, delta)) return false;
+            value = (int64_t)(word_t)(value + unzigzag(delta));
+        }
+        record(isWrite, va, isWrite ? (word_t)value : 0);
+    }
+    return cursor == end;
+}
+
+bool TraceReplayer::open(const std::string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < TRACE_MAGIC_SIZE)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (mapping == MAP_FAILED) return false;
+
+    data_ = static_cast<const uint8_t *>(mapping);
+    size_ = info.st_size;
+    madvise(mapping, size_, MADV_SEQUENTIAL);
+
+    /* the header and every block boundary must be sound; payloads are checked while decoding */
+    bool sound = std::memcmp(data_, TRACE_MAGIC, TRACE_MAGIC_SIZE) == 0;
+    size_t at = TRACE_MAGIC_SIZE;
+    while (sound && at < size_)
+    {
+        if (size_ - at < TRACE_BLOCK_HEADER) { sound = false; break; }
+        uint32_t bytes = getWord32(data_ + at + 4);
+        records_ += getWord32(data_ + at);
+        at += TRACE_BLOCK_HEADER;
+        if (size_ - at < bytes) { sound = false; break; }
+        at += bytes;
+    }
+    if (!sound) close();
+    return sound;
+}
+
+void TraceReplayer::close()
+{
+    if (data_ != nullptr) munmap(const_cast<uint8_t *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    records_ = 0;
+}
+
+/**
+ * calls sink(isWrite, addresses, values, n) for every run of same-kind accesses, split into
+ * chunks of at most TRACE_REPLAY_CHUNK. stops at the first malformed block.
+ **/
+template <class Sink>
+void TraceReplayer::forEachRun(Sink sink) const
+{
+    std::vector<uint64_t> addresses;
+    std::vector<word_t> values;
+    addresses.reserve(TRACE_REPLAY_CHUNK);
+    values.reserve(TRACE_REPLAY_CHUNK);
+    bool runIsWrite = false;
+
+    auto flush = [&] {
+        if (!addresses.empty()) sink(runIsWrite, addresses.data(), values.data(), addresses.size());
+        addresses.clear();
+        values.clear();
+    };
+
+    size_t at = TRACE_MAGIC_SIZE;
+    while (data_ != nullptr && at < size_)
+    {
+        uint32_t records = getWord32(data_ + at);
+        uint32_t bytes = getWord32(data_ + at + 4);
+        const uint8_t *payload = data_ + at + TRACE_BLOCK_HEADER;
+        at += TRACE_BLOCK_HEADER + bytes;
+
+        bool ok = decodeBlock(payload, payload + bytes, records, [&](bool isWrite, uint64_t va, word_t value) {
+            if (isWrite != runIsWrite || addresses.size() == TRACE_REPLAY_CHUNK)
+            {
+                flush();
+                runIsWrite = isWrite;
+            }
+            addresses.push_back(va);
+            values.push_back(value);
+        });
+        if (!ok) break;
+    }
+    flush();
+}
+
+uint64_t TraceReplayer::replay(VMContext &context) const
+{
+    uint64_t failed = 0;
+    std::vector<word_t> scratch(TRACE_REPLAY_CHUNK);
+
+    forEachRun([&](bool isWrite, const uint64_t *addresses, const word_t *values, size_t n) {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (addresses[i] >= context.geometry.virtualMemorySize) failed++;
+        }
+        if (isWrite) VMwriteBulk(context, addresses, values, n);
+        else VMreadBulk(context, addresses, scratch.data(), n);
+    });
+    return failed;
+}
+
+void TraceReplayer::decode(Trace &trace) const
+{
+    forEachRun([&trace](bool isWrite, const uint64_t *addresses, const word_t *values, size_t n) {
+        for (size_t i = 0; i < n; ++i) trace.append(isWrite, addresses[i], values[i]);
+    });
+}
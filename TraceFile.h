@@ -0,0 +1,142 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct VMContext; // VMContext.h
+class Trace;      // Sweep.h
+
+/*
+ * Binary access traces.
+ *
+ * File layout: the 8-byte magic "VMTRACE1", then blocks of
+ *     uint32 records, uint32 payload bytes, payload
+ * (little endian). Every record of a payload is one LEB128 varint
+ *     zigzag(va - previous va) << 1 | isWrite
+ * followed, for writes, by the varint zigzag(value - previous written value).
+ * Both "previous" values restart at 0 in every block, so blocks decode independently.
+ */
+#define TRACE_MAGIC "VMTRACE1"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_BLOCK_HEADER 8
+// a block is closed once its payload reaches this many bytes
+#define TRACE_BLOCK_BYTES (64 * 1024)
+
+/*
+ * Appends accesses to a binary trace file. Attach one to a context with VMrecord() to capture
+ * every access its VMread/VMwrite (and bulk/range) calls make, or call record() directly.
+ */
+class TraceRecorder
+{
+public:
+    TraceRecorder() = default;
+    ~TraceRecorder() { close(); }
+
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+    /*
+     * creates (truncates) the file and writes the header. returns false if it cannot be written.
+     */
+    bool open(const std::string &path);
+
+    void record(bool isWrite, uint64_t virtualAddress, word_t value)
+    {
+        if (payload_.size() >= TRACE_BLOCK_BYTES) flushBlock();
+        int64_t delta = (int64_t)(virtualAddress - lastAddress_);
+        lastAddress_ = virtualAddress;
+        putVarint((zigzag(delta) << 1) | (isWrite ? 1 : 0));
+        if (isWrite)
+        {
+            putVarint(zigzag((int64_t)value - (int64_t)lastValue_));
+            lastValue_ = value;
+        }
+        records_++;
+    }
+
+    /*
+     * writes the pending block and closes the file. returns false if any write failed.
+     */
+    bool close();
+
+    uint64_t recorded() const { return total_ + records_; }
+
+private:
+    // a varint of a 64-bit number takes at most 10 bytes, a record two of them (a block overshoots by at most this)
+    static const size_t MAX_RECORD = 20;
+
+    static uint64_t zigzag(int64_t n) { return ((uint64_t)n << 1) ^ (uint64_t)(n >> 63); }
+
+    void putVarint(uint64_t n)
+    {
+        while (n >= 0x80)
+        {
+            payload_.push_back((uint8_t)(n | 0x80));
+            n >>= 7;
+        }
+        payload_.push_back((uint8_t)n);
+    }
+
+    void flushBlock();
+
+    std::FILE *file_ = nullptr;
+    bool failed_ = false;
+    std::vector<uint8_t> payload_;
+    uint32_t records_ = 0;
+    uint64_t total_ = 0;
+    uint64_t lastAddress_ = 0;
+    word_t lastValue_ = 0;
+};
+
+/*
+ * starts (or, with nullptr, stops) recording the accesses made through the given context
+ * (the default one without it). the recorder must outlive the recording.
+ */
+void VMrecord(VMContext &context, TraceRecorder *recorder);
+void VMrecord(TraceRecorder *recorder);
+
+/*
+ * Replays a binary trace straight from a read-only memory mapping: blocks are decoded into
+ * small buffers and fed, one run of same-kind accesses at a time, to VMreadBulk/VMwriteBulk.
+ */
+class TraceReplayer
+{
+public:
+    TraceReplayer() = default;
+    ~TraceReplayer() { close(); }
+
+    TraceReplayer(const TraceReplayer &) = delete;
+    TraceReplayer &operator=(const TraceReplayer &) = delete;
+
+    /*
+     * maps the file and checks its header and block structure. returns false if it cannot be
+     * mapped or is not a well-formed trace.
+     */
+    bool open(const std::string &path);
+    void close();
+
+    uint64_t records() const { return records_; }
+
+    /*
+     * runs every access of the trace on the context. returns the number of accesses that failed
+     * (outside its virtual memory).
+     */
+    uint64_t replay(VMContext &context) const;
+
+    /*
+     * appends every access of the trace to 'trace' (for VMsweep).
+     */
+    void decode(Trace &trace) const;
+
+private:
+    template <class Sink>
+    void forEachRun(Sink sink) const;
+
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    uint64_t records_ = 0;
+};
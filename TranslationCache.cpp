@@ -0,0 +1,99 @@
+#include "TranslationCache.h"
+#include <cassert>
+
+void TranslationCache::configure(uint64_t sets, uint64_t ways)
+{
+    assert(ways == 0 || (sets != 0 && (sets & (sets - 1)) == 0));
+
+    sets_ = (ways == 0) ? 0 : sets;
+    ways_ = ways;
+    entries_.assign(sets_ * ways_, Entry());
+    clock_ = 0;
+}
+
+bool TranslationCache::lookup(uint64_t page, uint64_t &frame)
+{
+    if (!enabled()) return false;
+
+    Entry *set = setOf(page);
+    for (uint64_t way = 0; way < ways_; ++way)
+    {
+        if (set[way].page == page)
+        {
+            set[way].lastUse = ++clock_;
+            frame = set[way].frame;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranslationCache::insert(uint64_t page, uint64_t frame)
+{
+    if (!enabled()) return;
+
+    /* prefer an invalid way, otherwise the least recently used one */
+    Entry *set = setOf(page);
+    Entry *slot = &set[0];
+    for (uint64_t way = 0; way < ways_; ++way)
+    {
+        if (set[way].page == UINT64_MAX) { slot = &set[way]; break; }
+        if (set[way].lastUse < slot->lastUse) slot = &set[way];
+    }
+    slot->page = page;
+    slot->frame = frame;
+    slot->lastUse = ++clock_;
+}
+
+void TranslationCache::invalidatePage(uint64_t page)
+{
+    if (!enabled()) return;
+
+    Entry *set = setOf(page);
+    for (uint64_t way = 0; way < ways_; ++way)
+    {
+        if (set[way].page == page) set[way].page = UINT64_MAX;
+    }
+}
+
+void TranslationCache::invalidateFrame(uint64_t frame)
+{
+    for (Entry &entry : entries_)
+    {
+        if (entry.page != UINT64_MAX && entry.frame == frame) entry.page = UINT64_MAX;
+    }
+}
+
+void TranslationCache::flush()
+{
+    for (Entry &entry : entries_) entry.page = UINT64_MAX;
+    clock_ = 0;
+}
+
+/* ===================================================================== */
+/*                          PAGING-STRUCTURE CACHE                       */
+/* ===================================================================== */
+
+void WalkCache::configure(uint64_t tablesDepth, uint64_t offsetWidth, uint64_t entriesPerLevel)
+{
+    assert((entriesPerLevel & (entriesPerLevel - 1)) == 0);
+
+    tablesDepth_ = tablesDepth;
+    offsetWidth_ = offsetWidth;
+    // a one-level tree has no tables below the root to cache
+    perLevel_ = (tablesDepth < 2) ? 0 : entriesPerLevel;
+    entries_.assign((tablesDepth < 2 ? 0 : tablesDepth - 1) * perLevel_, Entry());
+}
+
+void WalkCache::invalidateFrame(uint64_t frame)
+{
+    for (Entry &entry : entries_)
+    {
+        if (entry.prefix != UINT64_MAX && entry.frame == frame) entry.prefix = UINT64_MAX;
+    }
+}
+
+void WalkCache::flush()
+{
+    for (Entry &entry : entries_) entry.prefix = UINT64_MAX;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * A set-associative software TLB that maps a virtual page number to the frame that holds its data page.
+ * The page numbers it is given carry their address space above the page bits (VMContext::spaceBase),
+ * so entries are tagged by address space and a switch between spaces needs no flush.
+ * It only memoizes what walk() would find in the page tables, so the allocator must invalidate an entry
+ * whenever the mapping behind it changes (victim eviction, empty-table unlinking).
+ */
+class TranslationCache
+{
+public:
+    /*
+     * (re)builds the cache with the given geometry and drops every entry.
+     * sets must be a power of 2; ways == 0 disables the cache.
+     */
+    void configure(uint64_t sets, uint64_t ways);
+
+    /*
+     * looks the page up. returns true and fills 'frame' on a hit.
+     */
+    bool lookup(uint64_t page, uint64_t &frame);
+
+    /*
+     * records page -> frame, replacing the least recently used way of the set.
+     */
+    void insert(uint64_t page, uint64_t frame);
+
+    /*
+     * drops the entry of the given page, if present.
+     */
+    void invalidatePage(uint64_t page);
+
+    /*
+     * drops every entry that translates to the given frame.
+     */
+    void invalidateFrame(uint64_t frame);
+
+    /*
+     * drops every entry.
+     */
+    void flush();
+
+    bool enabled() const { return ways_ != 0; }
+
+private:
+    struct Entry
+    {
+        uint64_t page = UINT64_MAX; // UINT64_MAX marks an invalid way
+        uint64_t frame = 0;
+        uint64_t lastUse = 0;       // for LRU replacement inside the set
+    };
+
+    Entry *setOf(uint64_t page) { return &entries_[(page & (sets_ - 1)) * ways_]; }
+
+    uint64_t sets_ = 0;
+    uint64_t ways_ = 0;
+    uint64_t clock_ = 0;
+    std::vector<Entry> entries_;
+};
+
+/*
+ * A paging-structure cache: for every table depth 1..tablesDepth-1, a direct-mapped cache of
+ * (page-number prefix at that depth -> frame of the table), so a TLB miss only reads the rows below
+ * the deepest table it already knows.
+ * Page numbers are tagged with their address space like the TLB's, so every space has its own prefixes.
+ * Only tables are cached and a table only moves when the allocator unlinks an empty one, so that is
+ * the one invalidation it needs: evicting a leaf zeroes a row of its parent but moves no table.
+ */
+class WalkCache
+{
+public:
+    /*
+     * (re)builds the cache for trees of the given shape and drops every entry.
+     * entriesPerLevel must be a power of 2; 0 disables the cache.
+     */
+    void configure(uint64_t tablesDepth, uint64_t offsetWidth, uint64_t entriesPerLevel);
+
+    /*
+     * the depth of the deepest cached table on the path of 'page' and, in 'frame', that table.
+     * returns 0 (the root, frame untouched) when nothing is cached.
+     */
+    uint64_t deepest(uint64_t page, uint64_t &frame) const
+    {
+        for (uint64_t depth = tablesDepth_ - 1; depth >= 1 && enabled(); --depth)
+        {
+            uint64_t prefix = page >> (offsetWidth_ * (tablesDepth_ - depth));
+            const Entry &entry = slot(depth, prefix);
+            if (entry.prefix == prefix)
+            {
+                frame = entry.frame;
+                return depth;
+            }
+        }
+        return 0;
+    }
+
+    /*
+     * records that the table of the given depth on the path of 'page' is 'frame'.
+     */
+    void insert(uint64_t depth, uint64_t page, uint64_t frame)
+    {
+        if (!enabled()) return;
+        uint64_t prefix = page >> (offsetWidth_ * (tablesDepth_ - depth));
+        Entry &entry = slot(depth, prefix);
+        entry.prefix = prefix;
+        entry.frame = frame;
+    }
+
+    /*
+     * drops every entry that points to the given table frame.
+     */
+    void invalidateFrame(uint64_t frame);
+
+    /*
+     * drops every entry.
+     */
+    void flush();
+
+    bool enabled() const { return perLevel_ != 0; }
+
+private:
+    struct Entry
+    {
+        uint64_t prefix = UINT64_MAX; // UINT64_MAX marks an invalid entry
+        uint64_t frame = 0;
+    };
+
+    Entry &slot(uint64_t depth, uint64_t prefix) { return entries_[(depth - 1) * perLevel_ + (prefix & (perLevel_ - 1))]; }
+    const Entry &slot(uint64_t depth, uint64_t prefix) const
+    {
+        return entries_[(depth - 1) * perLevel_ + (prefix & (perLevel_ - 1))];
+    }
+
+    uint64_t tablesDepth_ = 0;
+    uint64_t offsetWidth_ = 0;
+    uint64_t perLevel_ = 0;
+    std::vector<Entry> entries_; // depth-major
+};
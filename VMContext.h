@@ -0,0 +1,119 @@
+#pragma once
+
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+#include "Geometry.h"
+#include "TranslationCache.h"
+#include "FrameTable.h"
+#include "EvictionPolicy.h"
+#include "VMStats.h"
+#include "TraceFile.h"
+#include "Prefetcher.h"
+#include "Analytics.h"
+#include "SharedAccess.h"
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * Where the swap copies of an address space's pages come from after VMfork: a forked space reads the
+ * pages it has no copy of through the space it was forked from (and so on up), except the pages whose
+ * swap state became its own (a copy of its own, or the knowledge that it has none).
+ */
+struct SwapLineage
+{
+    uint64_t origin = UINT64_MAX;     // the space it was forked from, UINT64_MAX when it inherits nothing
+    std::unordered_set<uint64_t> own; // virtual page numbers; with several spaces, every page it wrote back
+};
+
+/*
+ * One independent simulation: its physical memory and swap, the page tables rooted in frame 0
+ * of that memory, and all translation state.
+ * Different contexts share nothing, so N simulations can run on N threads without locks.
+ * A single context must not be used by two threads at once, unless it is concurrent
+ * (VMConfig::concurrent), and then only through VMread/VMwrite and their bulk and range forms.
+ *
+ * The members are the simulator's working state; outside VirtualMemory.cpp treat them as read-only.
+ */
+struct VMContext
+{
+    /*
+     * a context with its own physical memory. like the default context, it must be
+     * VMinitialize()d before use.
+     */
+    VMContext();
+
+    /*
+     * a context driving a physical memory it does not own (the default context drives PMdefault()).
+     */
+    explicit VMContext(PhysicalMemory &sharedMemory);
+
+    VMContext(const VMContext &) = delete;
+    VMContext &operator=(const VMContext &) = delete;
+
+    std::unique_ptr<PhysicalMemory> ownedMemory; // empty when driving a shared memory
+    PhysicalMemory *memory;
+
+    /* the layout of this simulation. the hot path is instantiated for DefaultGeometry too,
+     * and uses that instantiation whenever the layout is the one compiled into MemoryConstants.h */
+    Geometry geometry;
+    bool defaultGeometry = true;
+
+    VMConfig config;
+
+    /* the current address space (VMswitch), whose root is frame 'asid', and asid << pageBits: the
+     * space number carried above the virtual page number in TLB, walk-cache, swap and policy keys */
+    uint64_t asid = 0;
+    uint64_t spaceBase = 0;
+    uint64_t pageBits = 0; // virtualAddressWidth - offsetWidth
+
+    /* per address space, and whether VMfork ever ran (so data pages may be shared copy-on-write) */
+    std::vector<SwapLineage> lineage;
+    bool forked = false;
+
+    /* page number -> leaf frame, consulted before walk() */
+    TranslationCache tlb;
+
+    /* va prefix -> table frame per level, consulted on a TLB miss */
+    WalkCache walkCache;
+
+    /* the inverted page table, and the indexes of the incremental allocator modes */
+    FrameTable frameTable;
+
+    /* priority #3 of the allocator: one policy, or one per address space under EVICT_LOCAL.
+     * empty for the built-in cyclic-distance rule */
+    std::vector<std::unique_ptr<EvictionPolicy>> policies;
+    bool trackAccesses = false; // the policies' tracksAccesses(), cached for the hot path
+
+    /* huge mappings: frames per run (0 = off), the table depth whose rows map them, and the
+     * advised regions (page >> (offsetWidth * hugeOrder)) */
+    uint64_t hugeFrames = 0;
+    uint64_t hugeLevel = 0;
+    std::unordered_set<uint64_t> hugeRegions;
+
+    /* read-ahead state, and whether walk() is currently fetching ahead rather than on demand */
+    Prefetcher prefetcher;
+    bool prefetching = false;
+
+    /* data pages mapped on demand by walk() since VMinitialize() (read-ahead not included) */
+    uint64_t pageFaults = 0;
+
+    /* hot-path counters, only written in VM_STATS builds (see VMStats.h) */
+    VMStats stats;
+
+    /* the hazard slots, versions and locks of a concurrent context, empty otherwise */
+    std::unique_ptr<SharedAccess> shared;
+
+    /* receives every access made through the public API when set (VMrecord) */
+    TraceRecorder *recorder = nullptr;
+
+    /* receives every access and demand fault when set (VManalyze) */
+    AccessAnalyzer *analyzer = nullptr;
+};
+
+/*
+ * everything VMinitialize does but recreating the physical memory: the context takes the layout and
+ * tunables, and forgets its page tables (but not the RAM they live in), translation state, policies
+ * and counters. VMrestore uses it to rebuild a simulation around the memory of an image.
+ */
+void VMresetState(VMContext &context, const Geometry &layout, const VMConfig &config);
@@ -0,0 +1,114 @@
+#include "VMStats.h"
+#include "VMContext.h"
+
+#ifdef VM_STATS_TIMERS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+uint64_t StatsTimer::ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+#endif
+
+VMStats VMstatsSnapshot(const VMContext &context)
+{
+    VMStats snapshot = context.stats;
+#ifdef VM_STATS
+    snapshot.counting = true;
+#endif
+#ifdef VM_STATS_TIMERS
+    snapshot.timing = true;
+#endif
+    snapshot.pageFaults = context.pageFaults;
+    snapshot.evictions = context.memory->evictions();
+    snapshot.writeBacks = context.memory->writeBacks();
+
+    CompressionStats compression;
+    if (context.memory->swap().compressionStats(compression))
+    {
+        snapshot.swapZeroPages = compression.zeroPages;
+        snapshot.swapSameValuePages = compression.sameValuePages;
+        snapshot.swapCompressedPages = compression.compressedPages;
+        snapshot.swapRawPages = compression.rawPages;
+        snapshot.swapBytesIn = compression.bytesIn;
+        snapshot.swapBytesOut = compression.bytesOut;
+        snapshot.swapStoredBytes = compression.storedBytes;
+        snapshot.compressTicks = compression.compressTicks;
+        snapshot.decompressTicks = compression.decompressTicks;
+    }
+    return snapshot;
+}
+
+VMStats VMstatsSnapshot()
+{
+    return VMstatsSnapshot(VMdefaultContext());
+}
+
+void VMstatsReset(VMContext &context)
+{
+    context.stats = VMStats();
+}
+
+void VMstatsReset()
+{
+    VMstatsReset(VMdefaultContext());
+}
+
+void printStats(std::ostream &out, const VMStats &stats)
+{
+    auto line = [&out](const char *name, uint64_t value) {
+        if (value != 0) out << name << " " << value << "\n";
+    };
+
+    line("tlb_hits", stats.tlbHits);
+    line("tlb_misses", stats.tlbMisses);
+    line("walks", stats.walks);
+    line("walk_cache_hits", stats.walkCacheHits);
+    for (uint64_t level = 0; level < VM_STATS_MAX_LEVELS; ++level)
+    {
+        if (stats.faultsByLevel[level] != 0)
+            out << "faults_level_" << level << " " << stats.faultsByLevel[level] << "\n";
+    }
+    line("alloc_empty_table", stats.allocEmptyTable);
+    line("alloc_new_frame", stats.allocNewFrame);
+    line("alloc_eviction", stats.allocEviction);
+    line("huge_mappings", stats.hugeMappings);
+    line("huge_fallbacks", stats.hugeFallbacks);
+    line("restore_hits", stats.restoreHits);
+    line("restore_misses", stats.restoreMisses);
+    line("prefetch_issued", stats.prefetchIssued);
+    line("prefetch_used", stats.prefetchUsed);
+    line("prefetch_wasted", stats.prefetchWasted);
+    line("cow_breaks", stats.cowBreaks);
+    line("scans", stats.scans);
+    line("scan_entries", stats.scanEntries);
+    line("scan_ticks", stats.scanTicks);
+    line("walk_ticks", stats.walkTicks);
+    line("evict_ticks", stats.evictTicks);
+    line("restore_ticks", stats.restoreTicks);
+    line("page_faults", stats.pageFaults);
+    line("evictions", stats.evictions);
+    line("write_backs", stats.writeBacks);
+    line("swap_zero_pages", stats.swapZeroPages);
+    line("swap_same_value_pages", stats.swapSameValuePages);
+    line("swap_compressed_pages", stats.swapCompressedPages);
+    line("swap_raw_pages", stats.swapRawPages);
+    line("swap_bytes_in", stats.swapBytesIn);
+    line("swap_bytes_out", stats.swapBytesOut);
+    line("swap_stored_bytes", stats.swapStoredBytes);
+    line("compress_ticks", stats.compressTicks);
+    line("decompress_ticks", stats.decompressTicks);
+}
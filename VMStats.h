@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+/*
+ * Hot-path instrumentation. Counting is compiled in only with -DVM_STATS, and the section
+ * timers only with -DVM_STATS_TIMERS (which implies VM_STATS). Without them every VM_STAT_*
+ * macro expands to nothing and the snapshot is all zeros apart from the always-kept
+ * pageFaults, evictions and writeBacks, and the counters of a SWAP_COMPRESSED swap.
+ */
+#if defined(VM_STATS_TIMERS) && !defined(VM_STATS)
+#define VM_STATS
+#endif
+
+// deepest tree whose faults are counted per level (a 64-bit page number cannot be deeper)
+#define VM_STATS_MAX_LEVELS 64
+
+struct VMStats
+{
+    /* true if this build counts (VM_STATS), and if it times (VM_STATS_TIMERS) */
+    bool counting = false;
+    bool timing = false;
+
+    uint64_t tlbHits = 0;
+    uint64_t tlbMisses = 0;
+
+    uint64_t walks = 0;
+    uint64_t walkCacheHits = 0; // walks that started below the root
+    // faultsByLevel[l]: missing entries filled in tables of depth l (l = tablesDepth - 1 is a data-page fault)
+    uint64_t faultsByLevel[VM_STATS_MAX_LEVELS] = {};
+
+    // which priority of allocateFrame() served each allocation
+    uint64_t allocEmptyTable = 0;
+    uint64_t allocNewFrame = 0;
+    uint64_t allocEviction = 0;
+    uint64_t hugeMappings = 0;  // huge faults served with a run of frames
+    uint64_t hugeFallbacks = 0; // huge faults that found no window and mapped a small page
+
+    // data-page faults whose page came back from swap vs. pages touched for the first time
+    uint64_t restoreHits = 0;
+    uint64_t restoreMisses = 0;
+
+    // read-ahead: pages fetched, fetched pages later used, fetched pages evicted unused
+    uint64_t prefetchIssued = 0;
+    uint64_t prefetchUsed = 0;
+    uint64_t prefetchWasted = 0;
+
+    // writes to a data page shared since a VMfork, which gave the writer a copy of its own
+    uint64_t cowBreaks = 0;
+
+    uint64_t scans = 0;
+    uint64_t scanEntries = 0; // table rows read by scan()
+
+    // ticks (TSC cycles on x86, the virtual counter on AArch64, nanoseconds elsewhere) spent inside
+    // scan(), walk() (including the allocations it triggers) and PMevict/PMrestore
+    uint64_t scanTicks = 0;
+    uint64_t walkTicks = 0;
+    uint64_t evictTicks = 0;
+    uint64_t restoreTicks = 0;
+
+    // kept in every build
+    uint64_t pageFaults = 0;
+    uint64_t evictions = 0;
+    uint64_t writeBacks = 0; // evictions of dirty pages, the only ones copied to swap
+
+    // a SWAP_COMPRESSED swap, kept in every build (but the ticks, as above): the pages written to it
+    // by how they were kept, their bytes before and after (the compression ratio is swapBytesIn /
+    // swapBytesOut), the bytes it holds now, and the ticks spent compressing and decompressing
+    uint64_t swapZeroPages = 0;
+    uint64_t swapSameValuePages = 0;
+    uint64_t swapCompressedPages = 0;
+    uint64_t swapRawPages = 0;
+    uint64_t swapBytesIn = 0;
+    uint64_t swapBytesOut = 0;
+    uint64_t swapStoredBytes = 0;
+    uint64_t compressTicks = 0;
+    uint64_t decompressTicks = 0;
+};
+
+struct VMContext; // VMContext.h
+
+/*
+ * the counters of the given simulation (the default one without an argument) since VMinitialize
+ * or the last VMstatsReset.
+ */
+VMStats VMstatsSnapshot(const VMContext &context);
+VMStats VMstatsSnapshot();
+
+/*
+ * zeroes the counters and timers. pageFaults, evictions, writeBacks and the swap compression counters
+ * only restart at VMinitialize.
+ */
+void VMstatsReset(VMContext &context);
+void VMstatsReset();
+
+/*
+ * one "name value" line per non-zero counter.
+ */
+void printStats(std::ostream &out, const VMStats &stats);
+
+/* ===================================================================== */
+/*                     INSTRUMENTATION (VirtualMemory.cpp)               */
+/* ===================================================================== */
+
+#ifdef VM_STATS
+#define VM_STAT_ADD(ctx, counter, n) ((ctx).stats.counter += (n))
+#else
+#define VM_STAT_ADD(ctx, counter, n) ((void)0)
+#endif
+
+#define VM_STAT_INC(ctx, counter) VM_STAT_ADD(ctx, counter, 1)
+
+#ifdef VM_STATS_TIMERS
+
+/*
+ * adds the ticks between its construction and destruction to 'total'.
+ */
+class StatsTimer
+{
+public:
+    explicit StatsTimer(uint64_t &total) : total_(total), start_(ticks()) {}
+    ~StatsTimer() { total_ += ticks() - start_; }
+
+    StatsTimer(const StatsTimer &) = delete;
+    StatsTimer &operator=(const StatsTimer &) = delete;
+
+    static uint64_t ticks();
+
+private:
+    uint64_t &total_;
+    uint64_t start_;
+};
+
+#define VM_STAT_TIMER(ctx, timer) StatsTimer statsTimer_##timer((ctx).stats.timer)
+#else
+#define VM_STAT_TIMER(ctx, timer) ((void)0)
+#endif
@@ -1,11 +1,19 @@
 #include "VirtualMemory.h"
+#include "VMContext.h"
 #include "MemoryConstants.h"
 #include "PhysicalMemory.h"
+#include "Geometry.h"
+#include "VMStats.h"
 #include <cstdint>
+#include <cassert>
 #include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #define ZERO 0
 
+
 /* ===================================================================== */
 /*                                 HELPERS                               */
 /* ===================================================================== */
@@ -13,9 +21,10 @@
 /**
  * Convert the pair (frame #, row inside that frame) into the physical word address that PMread/PMwrite expect.
  **/
-static inline uint64_t phys(uint64_t frame, uint64_t row)
+template <class G>
+static inline uint64_t phys(const G &geo, uint64_t frame, uint64_t row)
 {
-    return frame*PAGE_SIZE + row;
+    return frame*geo.pageSize + row;
 }
 
 /**
@@ -23,9 +32,10 @@ static inline uint64_t phys(uint64_t frame, uint64_t row)
  * Subtracting 1 from a power of two turns every low bit into 1.
  * that's why each va's(virtual-adders) bit that is the offsetOf range and up will stay up
  **/
-static inline uint64_t offsetOf(uint64_t va)
+template <class G>
+static inline uint64_t offsetOf(const G &geo, uint64_t va)
 {
-    return va & (PAGE_SIZE -1);
+    return va & (geo.pageSize -1);
 }
 
 /**
@@ -33,23 +43,70 @@ static inline uint64_t offsetOf(uint64_t va)
  * for example if we need to look for the the node in level 2 , we will put the virtual address & num_level
  * and get num of node that that written in the  virtual address.
  **/
-static inline uint64_t indexAtLevel(uint64_t va, int level)
+template <class G>
+static inline uint64_t indexAtLevel(const G &geo, uint64_t va, uint64_t level)
 {
-    int k = OFFSET_WIDTH + OFFSET_WIDTH * (TABLES_DEPTH - 1 - level);
-    // number of bits till the level we need is in the offset area
-    return (va >> k) & (PAGE_SIZE - 1);
-    // shift left k times till the level we need is in the offset area and we put zero elsewhere.
+    // shift right till the level we need is in the offset area and we put zero elsewhere.
+    // for a FixedGeometry and a constant level the shift is a compile-time constant.
+    return (va >> geo.shiftAtLevel(level)) & (geo.pageSize - 1);
 }
 
 /**
  * clearing the frame -turn it into an empty page table or an all-zero data page.
  * Only clears if not a leaf (table frame).
  **/
-static void clearFrame(uint64_t frame, bool isLeaf) // CHANGED
+static void clearFrame(VMContext &ctx, uint64_t frame, bool isLeaf) // CHANGED
 {
     if (isLeaf) return; // CHANGED
-    for (uint64_t i = 0; i < PAGE_SIZE; ++i)
-        PMwrite(phys(frame,i), 0);
+    ctx.memory->clearFrame(frame);
+}
+
+/**
+ * the key of 'page' of address space 'space' in the TLB, the walk cache, the swap and the policies:
+ * the space number sits above the virtual page number. the current space's keys are ctx.spaceBase | page.
+ **/
+static inline uint64_t pageKey(const VMContext &ctx, uint64_t space, uint64_t page)
+{
+    return (space << ctx.pageBits) | page;
+}
+
+/**
+ * the policy that tracks the pages of address space 'space', or nullptr for the cyclic rule.
+ **/
+static inline EvictionPolicy *policyFor(const VMContext &ctx, uint64_t space)
+{
+    if (ctx.policies.empty()) return nullptr;
+    return ctx.policies[ctx.policies.size() == 1 ? ZERO : space].get();
+}
+
+/**
+ * the swap page whose copy holds 'page' of address space 'space': its own copy, or the one it still
+ * inherits from the space it was forked from. UINT64_MAX if there is none (the page was never written back).
+ **/
+static uint64_t swapSource(const VMContext &ctx, uint64_t space, uint64_t page)
+{
+    while (true)
+    {
+        uint64_t key = pageKey(ctx, space, page);
+        if (ctx.memory->inSwap(key)) return key;
+        const SwapLineage &lineage = ctx.lineage[space];
+        if (lineage.origin == UINT64_MAX || lineage.own.count(page)) return UINT64_MAX;
+        space = lineage.origin;
+    }
+}
+
+/**
+ * with swap workers: lets the swap start reading 'page' of the current address space, if a fault would
+ * restore it (it has a swap copy and is not resident). changes nothing the simulation can observe.
+ **/
+static void hintRestore(VMContext &ctx, uint64_t page)
+{
+    uint64_t source = swapSource(ctx, ctx.asid, page);
+    if (source == UINT64_MAX) return;
+    uint64_t atOrAfter, before;
+    if (ctx.frameTable.cyclicNeighbours(ctx.asid, page, atOrAfter, before) && ctx.frameTable.pageOf(atOrAfter) == page)
+        return;
+    ctx.memory->prefetch(source);
 }
 
 /* ===================================================================== */
@@ -60,8 +117,14 @@ static void clearFrame(uint64_t frame, bool isLeaf) // CHANGED
  * we use it because  is a value that cannot be mistaken for any legal data.
  * Virtual page numbers range from 0 to NUM_PAGES-1. < 2^64.
  */
+// a scanInfo whose victim may come from any address space
+#define ANY_SPACE UINT64_MAX
+
 struct  scanInfo
 {
+    // input: the only address space whose pages may be the victim (EVICT_LOCAL), or ANY_SPACE
+    uint64_t scope = ANY_SPACE;
+
     // priority 1 ->first empty table we see
     uint64_t emptyFrame  = UINT64_MAX;      //frame id of that table
     uint64_t emptyParent = UINT64_MAX;      //frame id of its parent table
@@ -69,6 +132,7 @@ struct  scanInfo
 
     //priority 2 -> highest-index frame ever referenced
     uint64_t maxFrame = ZERO;
+    uint64_t freeFrame = UINT64_MAX; // an unreferenced frame below maxFrame (left by an evicted huge page)
 
     //priority 3 -> the best eviction candidate
     uint64_t victimFrame = UINT64_MAX; //frame that holds the data page
@@ -82,10 +146,10 @@ struct  scanInfo
  * this func is the way we decide how to choose the victim.
  * @return the distance on the NUM-PAGES-sized circle.
  */
-static inline uint64_t cyclicDistance(uint64_t a,uint64_t b)
+static inline uint64_t cyclicDistance(const VMContext &ctx, uint64_t a,uint64_t b)
 {
     uint64_t diff = (a > b) ? (a-b) : (b-a);
-    return std::min<uint64_t>(diff, NUM_PAGES - diff);
+    return std::min<uint64_t>(diff, ctx.geometry.numPages - diff);
 }
 
 /**
@@ -94,45 +158,51 @@ static inline uint64_t cyclicDistance(uint64_t a,uint64_t b)
  * The decision happens later in allocateFrame, which reads the filled struct and returns the chosen frame to walk.
  *
  * @param frame         curr frame we are visiting.
- * @param depth         ZER0 = root,TABLES_DEPTH = leaf = data-page(we never call on data page).
+ * @param depth         ZER0 = root,tablesDepth = leaf = data-page(we never call on data page).
  * @param pagePrefix    already constructed high bits of the virtual page number.
  * @param targetPage    page that triggered the allocation (for cyclic dist.).
  * @param info          in/out accumulator for results.
  */
-static void scan(uint64_t frame,int depth,uint64_t pagePrefix,uint64_t targetPage,scanInfo &info,uint64_t parentFrame)
+static void scan(VMContext &ctx,uint64_t frame,uint64_t depth,uint64_t pagePrefix,uint64_t targetPage,scanInfo &info,uint64_t parentFrame)
 {
     bool allZero = true;
+    VM_STAT_ADD(ctx, scanEntries, ctx.geometry.pageSize);
 
-    /* iterate over every row in the current table */
-    for (uint64_t row = 0; row < PAGE_SIZE; ++row)
+    /* iterate over the non-zero rows of the current table, 64 at a time from a bitmap of them */
+    for (uint64_t first = 0; first < ctx.geometry.pageSize; first += 64)
     {
-        word_t entry;
-        PMread(phys(frame,row),&entry);
-
-        if(entry == ZERO) continue;
-
-        allZero = false; //not an empty table
+        uint64_t count = std::min<uint64_t>(64, ctx.geometry.pageSize - first);
+        for (uint64_t rows = ctx.memory->nonZeroRows(frame, first, count); rows != 0; rows &= rows - 1)
+        {
+            uint64_t row = first + __builtin_ctzll(rows);
+            word_t entry;
+            ctx.memory->read(phys(ctx.geometry,frame,row),&entry);
 
-        info.maxFrame = std::max<uint64_t>(info.maxFrame,(uint64_t)entry); //update if needed the maxFrame
+            allZero = false; //not an empty table
 
-        //newPrefix is how the DFS “grows” the virtual-page number as it moves one level deeper in the page-table tree.
-        uint64_t newPrefix = (pagePrefix << OFFSET_WIDTH) | row;
+            info.maxFrame = std::max<uint64_t>(info.maxFrame,(uint64_t)entry); //update if needed the maxFrame
 
-        if( depth + 1 < TABLES_DEPTH) //means that were not in the data-page level, o we recursively repeat scan
-        {
-            scan(entry,depth+1,newPrefix,targetPage,info,parentFrame);
-        }
-        else // depth + 1 == TABLES_DEPTH means we are in data-page level
-        {
-            uint64_t dist = cyclicDistance(newPrefix,targetPage);
+            //newPrefix is how the DFS “grows” the virtual-page number as it moves one level deeper in the page-table tree.
+            uint64_t newPrefix = (pagePrefix << ctx.geometry.offsetWidth) | row;
 
-            if(dist >info.victimDistance)
+            if( depth + 1 < ctx.geometry.tablesDepth) //means that were not in the data-page level, o we recursively repeat scan
+            {
+                scan(ctx,entry,depth+1,newPrefix,targetPage,info,parentFrame);
+            }
+            else // depth + 1 == tablesDepth means we are in data-page level
             {
-                info.victimDistance = dist; //this is the max cyclicDistance
-                info.victimFrame = entry; //is the num of the frame physically holds the data page we may evict.
-                info.victimPage = newPrefix; //the full virtual page number of the page in that frame.
-                info.victimRowInParent = row; //is the index inside that parent table whose cell contained entry.
-                info.victimParent = frame; // is the table we are currently scanning—the parent of the data page.
+                if (info.scope != ANY_SPACE && ctx.frameTable.spaceOf(frame) != info.scope) continue;
+                uint64_t dist = cyclicDistance(ctx, newPrefix,targetPage);
+
+                // (only another address space can hold a page at distance 0, the target page itself is not resident)
+                if(info.victimFrame == UINT64_MAX || dist >info.victimDistance)
+                {
+                    info.victimDistance = dist; //this is the max cyclicDistance
+                    info.victimFrame = entry; //is the num of the frame physically holds the data page we may evict.
+                    info.victimPage = newPrefix; //the full virtual page number of the page in that frame.
+                    info.victimRowInParent = row; //is the index inside that parent table whose cell contained entry.
+                    info.victimParent = frame; // is the table we are currently scanning—the parent of the data page.
+                }
             }
         }
     }
@@ -141,37 +211,265 @@ static void scan(uint64_t frame,int depth,uint64_t pagePrefix,uint64_t targetPag
     {
         return;
     }
-    /* if ALL entries were 0 and this table is not the root, remember it */
-    if(allZero && frame != ZERO && info.emptyFrame == UINT64_MAX)
+    /* if ALL entries were 0 and this table is not a root, remember it.
+     * the frame table knows which row points to it, so its parent needs no second look. */
+    if(allZero && depth != ZERO && info.emptyFrame == UINT64_MAX)
     {
         info.emptyFrame        = frame;
-        info.emptyParent       = UINT64_MAX;   // we’ll fill these below
-        info.emptyRowInParent  = 0; // just for now;
+        info.emptyParent       = ctx.frameTable.parentOf(frame);
+        info.emptyRowInParent  = ctx.frameTable.rowOf(frame);
+    }
+}
+
+/* ===================================================================== */
+/*              FRAME TABLE BOOKKEEPING (scan() replacement)             */
+/* ===================================================================== */
+
+/**
+ * links 'child' into row 'row' of table 'parent', keeping the frame table in sync.
+ **/
+static void linkFrame(VMContext &ctx, uint64_t parent, uint64_t row, uint64_t child, bool isLeaf)
+{
+    if (ctx.shared) ctx.memory->writeEntryShared(phys(ctx.geometry, parent, row), child);
+    else ctx.memory->write(phys(ctx.geometry, parent, row), child);
+    ctx.frameTable.link(parent, row, child, isLeaf);
+}
+
+/**
+ * zeroes row 'row' of table 'parent' that used to point to 'child'.
+ **/
+static void unlinkFrame(VMContext &ctx, uint64_t parent, uint64_t row, uint64_t child)
+{
+    if (ctx.shared) ctx.memory->writeEntryShared(phys(ctx.geometry, parent, row), 0);
+    else ctx.memory->write(phys(ctx.geometry, parent, row), 0);
+    ctx.frameTable.unlink(child);
+}
+
+/**
+ * fills the same facts scan() gathers, but from the frame table: the empty table and the max frame
+ * are O(1), the victim is an O(log n) lookup in the ordered index of resident pages.
+ * the victim is only looked up when the first two priorities cannot serve the request (or when asked).
+ **/
+static void lookupInfo(VMContext &ctx, uint64_t targetPage, scanInfo &info, uint64_t parentFrame, bool wantVictim)
+{
+    info.emptyFrame = ctx.frameTable.firstEmptyTable(parentFrame);
+    if (info.emptyFrame != UINT64_MAX)
+    {
+        info.emptyParent = ctx.frameTable.parentOf(info.emptyFrame);
+        info.emptyRowInParent = ctx.frameTable.rowOf(info.emptyFrame);
     }
+    info.maxFrame = ctx.frameTable.maxFrame();
+    info.freeFrame = ctx.frameTable.firstFree();
+
+    if (!wantVictim && (info.emptyFrame != UINT64_MAX || info.freeFrame != UINT64_MAX ||
+                        info.maxFrame + 1 < ctx.geometry.numFrames)) return;
 
-    /* Fill parent/row for first empty table lazily (cheapest place) */
-    if(info.emptyFrame != UINT64_MAX && info.emptyParent == UINT64_MAX )
+    /* the page farthest from targetPage is the one closest to the opposite point of the circle,
+     * so only the two resident neighbours of that point (in each address space) can win. */
+    uint64_t opposite = (targetPage + ctx.geometry.numPages / 2) % ctx.geometry.numPages;
+    uint64_t first = (info.scope == ANY_SPACE) ? ZERO : info.scope;
+    uint64_t last = (info.scope == ANY_SPACE) ? ctx.config.addressSpaces : info.scope + 1;
+    uint64_t victimSpace = UINT64_MAX; // (a page shared since a VMfork is a candidate of each space)
+    for (uint64_t space = first; space < last; ++space)
     {
-        // We are in the parent of that frame if any row points to emptyFrame
-        for(uint64_t row = ZERO; row < PAGE_SIZE ; row++)
-        {
-            word_t entry;
-            PMread(phys(frame, row), &entry);
+        uint64_t candidates[2];
+        if (!ctx.frameTable.cyclicNeighbours(space, opposite, candidates[0], candidates[1])) continue;
 
-            if((uint64_t)entry == info.emptyFrame)
+        /* same order of preference as the DFS: larger distance wins, ties go to the lower space,
+         * then to the lower page number */
+        for (uint64_t frame : candidates)
+        {
+            uint64_t page = ctx.frameTable.pageOf(frame);
+            uint64_t dist = cyclicDistance(ctx, page, targetPage);
+            if (info.victimFrame == UINT64_MAX || dist > info.victimDistance ||
+                (dist == info.victimDistance && victimSpace == space && page < info.victimPage))
             {
-                info.emptyParent = frame;
-                info.emptyRowInParent = row;
-                break;
+                info.victimDistance = dist;
+                info.victimFrame = frame;
+                info.victimPage = page;
+                info.victimRowInParent = ctx.frameTable.rowOf(frame);
+                info.victimParent = ctx.frameTable.ownerIn(frame, space);
+                victimSpace = space;
             }
         }
     }
 }
 
+/**
+ * true if both infos lead allocateFrame() to the same decision.
+ **/
+[[maybe_unused]] static bool sameDecision(const scanInfo &a, const scanInfo &b)
+{
+    if (a.emptyFrame != b.emptyFrame || a.freeFrame != b.freeFrame) return false;
+    // (below freed frames the frame table's high-water mark can exceed the highest frame the DFS sees)
+    if (a.freeFrame == UINT64_MAX && a.maxFrame != b.maxFrame) return false;
+    if (a.emptyFrame != UINT64_MAX &&
+        (a.emptyParent != b.emptyParent || a.emptyRowInParent != b.emptyRowInParent)) return false;
+    return a.victimFrame == b.victimFrame && a.victimPage == b.victimPage &&
+           (a.victimFrame == UINT64_MAX ||
+            (a.victimParent == b.victimParent && a.victimRowInParent == b.victimRowInParent));
+}
+
+/**
+ * replaces the cyclic-distance victim by the one the configured policy picks.
+ **/
+static void policyVictim(VMContext &ctx, uint64_t targetPage, scanInfo &info)
+{
+    uint64_t key = ctx.spaceBase | targetPage;
+    uint64_t frame = UINT64_MAX;
+    if (info.scope != ANY_SPACE)
+    {
+        frame = policyFor(ctx, info.scope)->selectVictim(key);
+    }
+    else
+    {
+        for (const auto &policy : ctx.policies) // one, or the first space with a page to give up
+            if ((frame = policy->selectVictim(key)) != UINT64_MAX) break;
+    }
+    if (frame == UINT64_MAX) return;
+
+    info.victimFrame = frame;
+    info.victimPage = ctx.frameTable.pageOf(frame);
+    info.victimParent = ctx.frameTable.parentOf(frame);
+    info.victimRowInParent = ctx.frameTable.rowOf(frame);
+}
+
+/**
+ * gathers the allocator's view of the tree according to the configured mode.
+ * ALLOCATOR_CHECKED also runs the DFS and asserts that both views agree.
+ **/
+static void timedScan(VMContext &ctx, uint64_t targetPage, scanInfo &info, uint64_t parentFrame)
+{
+    VM_STAT_INC(ctx, scans);
+    VM_STAT_TIMER(ctx, scanTicks);
+    info.maxFrame = ctx.config.addressSpaces - 1; // the roots, which no row points to
+    info.freeFrame = ctx.frameTable.firstFree(); // unreferenced frames are not in any tree
+    for (uint64_t root = ZERO; root < ctx.config.addressSpaces; ++root)
+        scan(ctx,root,0,0,targetPage,info,parentFrame);
+}
+
+static void gatherInfo(VMContext &ctx, uint64_t targetPage, scanInfo &info, uint64_t parentFrame)
+{
+    if (ctx.config.allocator == ALLOCATOR_SCAN)
+    {
+        timedScan(ctx, targetPage, info, parentFrame);
+        return;
+    }
+
+    lookupInfo(ctx, targetPage, info, parentFrame, ctx.config.allocator == ALLOCATOR_CHECKED);
+
+    if (ctx.config.allocator == ALLOCATOR_CHECKED)
+    {
+        scanInfo oracle;
+        oracle.scope = info.scope;
+        timedScan(ctx, targetPage, oracle, parentFrame);
+        assert(sameDecision(info, oracle));
+        assert(VMcheckIntegrity(ctx));
+        (void)oracle;
+    }
+}
+
 /* ===================================================================== */
 /*                      ALLOCATE FRAME  (spec compliant)                 */
 /* ===================================================================== */
 
+/**
+ * 'space' is about to overwrite its swap copy of 'page': the spaces forked from it that still read that
+ * page through it take a copy of their own first (or learn that they have none).
+ **/
+static void detachForks(VMContext &ctx, uint64_t space, uint64_t page)
+{
+    uint64_t source = UINT64_MAX;
+    bool looked = false;
+    for (uint64_t fork = ZERO; fork < ctx.config.addressSpaces; ++fork)
+    {
+        SwapLineage &lineage = ctx.lineage[fork];
+        if (lineage.origin != space || !lineage.own.insert(page).second) continue;
+        if (!looked)
+        {
+            source = swapSource(ctx, space, page);
+            looked = true;
+        }
+        if (source != UINT64_MAX) ctx.memory->copySwap(source, pageKey(ctx, fork, page));
+    }
+}
+
+/**
+ * evicts the data page held by 'frame' as page 'page' of address space 'space' (PMevict).
+ **/
+static void writeBack(VMContext &ctx, uint64_t frame, uint64_t space, uint64_t page)
+{
+    uint64_t key = pageKey(ctx, space, page);
+    if (ctx.forked && (ctx.memory->isDirty(frame) || !ctx.memory->inSwap(key))) detachForks(ctx, space, page);
+    {
+        VM_STAT_TIMER(ctx, evictTicks);
+        ctx.memory->evict(frame, key); //evicting the frame_number from the specific data_page.
+    }
+    if (ctx.config.addressSpaces > 1) ctx.lineage[space].own.insert(page);
+}
+
+/**
+ * zeroes the row of table 'table' that points to the shared data page 'frame'. when that was the owner
+ * the policies know the page by, they learn it under the space of the owner that takes over.
+ **/
+static void dropOwner(VMContext &ctx, uint64_t table, uint64_t frame)
+{
+    uint64_t page = ctx.frameTable.pageOf(frame);
+    uint64_t before = ctx.frameTable.spaceOf(frame);
+    ctx.memory->write(phys(ctx.geometry, table, ctx.frameTable.rowOf(frame)), 0);
+    ctx.frameTable.unshare(table, frame);
+    ctx.tlb.invalidatePage(pageKey(ctx, ctx.frameTable.spaceOf(table), page));
+
+    uint64_t after = ctx.frameTable.spaceOf(frame);
+    if (after != before && !ctx.policies.empty())
+    {
+        policyFor(ctx, before)->onUnmap(pageKey(ctx, before, page), frame);
+        policyFor(ctx, after)->onMap(pageKey(ctx, after, page), frame);
+    }
+}
+
+/**
+ * evicts the data page held by 'frame' (all of its pages, for a huge mapping) and unlinks it from the
+ * row that points to it, or from every row, for a page shared since a VMfork: each space it leaves
+ * gets its own swap copy.
+ **/
+static void evictLeaf(VMContext &ctx, uint64_t frame)
+{
+    if (ctx.shared) ctx.shared->retire(frame); // no hit may still use it
+    uint64_t run = ctx.frameTable.runOf(frame);
+    uint64_t page = ctx.frameTable.pageOf(frame);
+    while (ctx.frameTable.isShared(frame))
+    {
+        uint64_t table = ctx.frameTable.ownerAt(frame, 1);
+        writeBack(ctx, frame, ctx.frameTable.spaceOf(table), page);
+        dropOwner(ctx, table, frame);
+    }
+
+    uint64_t space = ctx.frameTable.spaceOf(frame);
+    uint64_t key = pageKey(ctx, space, page); // huge runs only exist in a single address space
+    if (run != ZERO)
+    {
+        VM_STAT_TIMER(ctx, evictTicks);
+        ctx.memory->evictRun(frame, key, run);
+    }
+    else
+    {
+        writeBack(ctx, frame, space, page);
+    }
+    unlinkFrame(ctx, ctx.frameTable.parentOf(frame), ctx.frameTable.rowOf(frame), frame); // now its parent doesn't point to any table.
+    if (run != ZERO)
+        for (uint64_t i = 0; i < run; ++i) ctx.tlb.invalidatePage(key + i);
+    else
+        ctx.tlb.invalidatePage(key);
+    if (EvictionPolicy *policy = policyFor(ctx, space)) policy->onUnmap(key, frame);
+
+    if (ctx.prefetcher.enabled())
+    {
+        for (uint64_t i = 0; i < std::max<uint64_t>(run, 1); ++i)
+            if (ctx.prefetcher.evicted(frame + i)) VM_STAT_INC(ctx, prefetchWasted);
+    }
+}
+
 /**
  *
  * @param parentFrame
@@ -180,132 +478,1166 @@ static void scan(uint64_t frame,int depth,uint64_t pagePrefix,uint64_t targetPag
  * @param isLeaf      true if the frame is for a leaf (data page)
  * @return the new frame well going to use by the data we keep in the info and by the priority were set to us.
  */
-static uint64_t allocateFrame(uint64_t parentFrame, uint64_t ParentRow, uint64_t targetPage, bool isLeaf) // CHANGED
+static uint64_t allocateFrame(VMContext &ctx, uint64_t parentFrame, uint64_t ParentRow, uint64_t targetPage, bool isLeaf) // CHANGED
 {
+    (void)ParentRow;
     scanInfo info;
-    scan(0,0,0,targetPage,info,parentFrame);
+    if (ctx.config.evictionScope == EVICT_LOCAL) info.scope = ctx.asid;
+    gatherInfo(ctx, targetPage, info, parentFrame);
 
     /* ---------- Priority #1 : reuse an empty table ------------------ */
     if(info.emptyFrame != UINT64_MAX &&  info.emptyFrame != parentFrame)
     {
         /* detach it from its parent */
-        PMwrite(phys(info.emptyParent, info.emptyRowInParent), 0); //parent now does not point on any table.
-        clearFrame(info.emptyFrame, isLeaf); // CHANGED
+        if (ctx.shared) ctx.shared->retire(info.emptyFrame); // no walk may still read it
+        unlinkFrame(ctx, info.emptyParent, info.emptyRowInParent, info.emptyFrame); //parent now does not point on any table.
+        ctx.tlb.invalidateFrame(info.emptyFrame);
+        ctx.walkCache.invalidateFrame(info.emptyFrame);
+        clearFrame(ctx, info.emptyFrame, isLeaf); // CHANGED
+        if (ctx.shared) ctx.shared->reissue(info.emptyFrame);
+        VM_STAT_INC(ctx, allocEmptyTable);
         return info.emptyFrame;
     }
 
     /* ---------- Priority #2 : take a brand-new frame ---------------- */
-    if(info.maxFrame  + 1 < NUM_FRAMES ) // means that at least one frame is free to be used
+    if (info.freeFrame != UINT64_MAX) // a hole left by an evicted huge page comes first
+    {
+        clearFrame(ctx, info.freeFrame, isLeaf);
+        VM_STAT_INC(ctx, allocNewFrame);
+        return info.freeFrame;
+    }
+    if(info.maxFrame  + 1 < ctx.geometry.numFrames ) // means that at least one frame is free to be used
     {
         uint64_t newFrame = info.maxFrame  + 1;
-        clearFrame(newFrame, isLeaf); // CHANGED
+        clearFrame(ctx, newFrame, isLeaf); // CHANGED
+        VM_STAT_INC(ctx, allocNewFrame);
         return newFrame;
     }
 
     /* ---------- Priority #3 : evict victim page --------------------- */
-    /* victimFrame, victimParent, victimRowInParent guaranteed valid */
-    PMevict(info.victimFrame, info.victimPage); //evicting the frame_number from the specific data_page.
-    PMwrite(phys(info.victimParent, info.victimRowInParent), 0); // now its parent doesn't point to any table.
-    clearFrame(info.victimFrame, isLeaf); // CHANGED
+    if (!ctx.policies.empty()) policyVictim(ctx, targetPage, info);
+    if (info.victimFrame == UINT64_MAX) // EVICT_LOCAL, but the faulting space holds no page: take any
+    {
+        info = scanInfo();
+        gatherInfo(ctx, targetPage, info, parentFrame);
+        if (!ctx.policies.empty()) policyVictim(ctx, targetPage, info);
+    }
+
+    /* victimFrame guaranteed valid */
+    evictLeaf(ctx, info.victimFrame);
+    VM_STAT_INC(ctx, allocEviction);
+    clearFrame(ctx, info.victimFrame, isLeaf); // CHANGED
+    if (ctx.shared) ctx.shared->reissue(info.victimFrame); // (retired by evictLeaf)
     return info.victimFrame;
 }
 
-/* ===================================================================== */
-/*                      INTERNAL PAGE-TABLE WALKER                       */
-/* ===================================================================== */
 /**
- * this function is for walking func for the VMread/write, if we need to allocate new frame than we call it
- * with our allocateFrame func witch with our scan func decide how to allocate it.
- *
- * @param va        the virtual address
- * @param create    if false → stop + return false on first missing pointer
- *                  if true  → allocate frames/tables on demand
- * @param leafFrame_out (out) frame number that contains the data page
- * @return          true on success, false on unmapped page when create==false
+ * empties the cheapest aligned window of ctx.hugeFrames contiguous frames for a huge mapping:
+ * every resident page in it is evicted and every (empty) table in it unlinked.
+ * @return the first frame of the window, or UINT64_MAX if every window holds a live table.
  */
-static bool walk(uint64_t va, bool create, uint64_t &leafFrame_out)
+static uint64_t allocateRun(VMContext &ctx, uint64_t parentFrame)
 {
-    uint64_t frame = ZERO; // root
+    uint64_t start = ctx.frameTable.cheapestWindow(ctx.hugeFrames, parentFrame);
+    if (start == UINT64_MAX) return UINT64_MAX;
 
-    for(int level = 0; level < TABLES_DEPTH; ++level)
+    for (uint64_t frame = start; frame < start + ctx.hugeFrames; ++frame)
     {
-        uint64_t row;
-        word_t   child;
+        if (!ctx.frameTable.referenced(frame)) continue;
 
-        row = indexAtLevel(va,level);
-        PMread(phys(frame,row), &child);
-        if (child == 0) // page fault on this row
+        uint64_t run = ctx.frameTable.runOf(frame);
+        uint64_t parent = ctx.frameTable.parentOf(frame);
+        uint64_t row = ctx.frameTable.rowOf(frame);
+        if (ctx.frameTable.isLeaf(frame))
+        {
+            evictLeaf(ctx, frame);
+            VM_STAT_INC(ctx, allocEviction);
+            if (run != ZERO) frame += run - 1;
+        }
+        else
         {
-            if (!create) { return false; } // VMread without create
+            unlinkFrame(ctx, parent, row, frame);
+            ctx.tlb.invalidateFrame(frame);
+            ctx.walkCache.invalidateFrame(frame);
+        }
+    }
+    return start;
+}
+
+/* ===================================================================== */
+/*                      INTERNAL PAGE-TABLE WALKER                       */
+/* ===================================================================== */
+
+/* the outcome of one level of walk() */
+enum WalkStep
+{
+    WALK_DESCEND, // 'frame' is now the table (or data page) of the next level
+    WALK_MAPPED,  // a huge entry ended the walk: leafFrame_out is set
+    WALK_UNMAPPED // missing entry and create == false
+};
+
+/**
+ * maps the data page 'page' of the current address space into 'newFrame' and links it into row 'row'
+ * of its last-level table 'table': the page comes back from swap, or is touched for the first time.
+ **/
+static void mapLeaf(VMContext &ctx, uint64_t table, uint64_t row, uint64_t page, uint64_t newFrame)
+{
+    if (!ctx.prefetching)
+    {
+        ctx.pageFaults++;
+        if (ctx.analyzer) ctx.analyzer->fault();
+        if (ctx.prefetcher.enabled()) ctx.prefetcher.observe(ctx.spaceBase | page);
+    }
+    uint64_t source = swapSource(ctx, ctx.asid, page);
+    bool restored;
+    {
+        VM_STAT_TIMER(ctx, restoreTicks);
+        restored = ctx.memory->restore(newFrame, source == UINT64_MAX ? ctx.spaceBase | page : source);  // bring page from swap
+    }
+    if (restored) VM_STAT_INC(ctx, restoreHits);
+    else VM_STAT_INC(ctx, restoreMisses);
+    // an inherited copy is not this space's: evicting the page must write one of its own
+    if (restored && source != (ctx.spaceBase | page)) ctx.memory->markDirty(newFrame);
+
+    linkFrame(ctx, table, row, newFrame, true);//we link it to the parent.
+    if (!ctx.policies.empty()) policyFor(ctx, ctx.asid)->onMap(ctx.spaceBase | page, newFrame);
+}
 
-            /* allocate a usable frame according to the three priorities */
-            bool isLeaf = (level + 1 == TABLES_DEPTH); // CHANGED
-            uint64_t newFrame = allocateFrame(frame,row,va >> OFFSET_WIDTH,isLeaf); // CHANGED
+/**
+ * fills the missing row 'row' of table 'frame' (at depth 'level') with a newly allocated table or data
+ * page, or, inside a huge region, with a whole run.
+ * @return the new child frame, or UINT64_MAX when a huge run was mapped (leafFrame_out is then set)
+ */
+template <class G>
+static uint64_t fault(VMContext &ctx, const G &geo, uint64_t va, uint64_t level, bool isLeaf,
+                      uint64_t frame, uint64_t row, uint64_t &leafFrame_out)
+{
+    uint64_t page = va >> geo.offsetWidth;
+    VM_STAT_INC(ctx, faultsByLevel[level]);
 
-            if(isLeaf) // means that we are in the data_page level
+    if (level == ctx.hugeLevel && ctx.hugeFrames != ZERO &&
+        ctx.hugeRegions.count(page >> (geo.offsetWidth * ctx.config.hugeOrder)))
+    {
+        uint64_t head = allocateRun(ctx, frame);
+        if (head != UINT64_MAX)
+        {
+            uint64_t firstPage = page & ~(ctx.hugeFrames - 1); // (a single address space: keys are pages)
+            if (!ctx.prefetching)
             {
-                PMrestore(newFrame, va >> OFFSET_WIDTH);  // bring page from swap
+                ctx.pageFaults++;
+                if (ctx.analyzer) ctx.analyzer->fault();
             }
-            else // intermediate TABLE
+            uint64_t restored;
             {
-                clearFrame(newFrame, false); //empty the table
+                VM_STAT_TIMER(ctx, restoreTicks);
+                // with lazy reads the pages nobody wrote yet must keep reading as zeros
+                restored = ctx.memory->restoreRun(head, firstPage, ctx.hugeFrames, ctx.config.lazyReads);
             }
+            VM_STAT_ADD(ctx, restoreHits, restored);
+            VM_STAT_ADD(ctx, restoreMisses, ctx.hugeFrames - restored);
+            VM_STAT_INC(ctx, hugeMappings);
+            (void)restored;
 
-            PMwrite(phys(frame, row), newFrame);//we link it to the parent.
-            child = newFrame;
+            ctx.memory->write(phys(geo, frame, row), (word_t)head | HUGE_ENTRY_FLAG);
+            ctx.frameTable.linkRun(frame, row, head, ctx.hugeFrames);
+            leafFrame_out = head + (page - firstPage);
+            return UINT64_MAX;
         }
-        frame = child; //descend to the next_level.
+        VM_STAT_INC(ctx, hugeFallbacks);
     }
-    leafFrame_out = frame;  // reached the data page
-    return true;
+
+    /* allocate a usable frame according to the three priorities */
+    uint64_t newFrame = allocateFrame(ctx, frame,row,page,isLeaf); // CHANGED
+
+    if(isLeaf) // means that we are in the data_page level
+    {
+        mapLeaf(ctx, frame, row, page, newFrame);
+    }
+    else // intermediate TABLE
+    {
+        clearFrame(ctx, newFrame, false); //empty the table
+        linkFrame(ctx, frame, row, newFrame, false);//we link it to the parent.
+    }
+    return newFrame;
 }
 
-/* ===================================================================== */
-/*                      PUBLIC READ / WRITE API                          */
-/* ===================================================================== */
+/**
+ * one level of walk(): reads the row of 'va' in table 'frame' and moves 'frame' down to its child,
+ * faulting the child in when missing and 'create' is set.
+ * isLeaf (level + 1 == tablesDepth) is a constant wherever the level is.
+ */
+template <class G>
+static inline WalkStep walkLevel(VMContext &ctx, const G &geo, uint64_t va, bool create, uint64_t level,
+                                 bool isLeaf, uint64_t &frame, uint64_t &leafFrame_out)
+{
+    uint64_t row = indexAtLevel(geo,va,level);
+    word_t   child;
+
+    ctx.memory->read(phys(geo,frame,row), &child);
+    if (child == 0) // page fault on this row
+    {
+        if (!create) { return WALK_UNMAPPED; } // VMread without create
+        uint64_t newFrame = fault(ctx, geo, va, level, isLeaf, frame, row, leafFrame_out);
+        if (newFrame == UINT64_MAX) { return WALK_MAPPED; }
+        child = (word_t)newFrame;
+    }
+    else if (child & HUGE_ENTRY_FLAG) // a huge page ends the walk here
+    {
+        leafFrame_out = (uint64_t)(child & ~HUGE_ENTRY_FLAG) + ((va >> geo.offsetWidth) & (ctx.hugeFrames - 1));
+        return WALK_MAPPED;
+    }
+    frame = child; //descend to the next_level.
+    if (!isLeaf) ctx.walkCache.insert(level + 1, ctx.spaceBase | (va >> geo.offsetWidth), frame);
+    return WALK_DESCEND;
+}
 
 /**
- * We Initialize 0 in each row in the first frame of the PM.
- * that's for marking frame 0, and set that he not point to any other page or table.
- **/
-void VMinitialize()
+ * the levels Level.. of a FixedGeometry walk as straight-line code: one walkLevel per level, each
+ * with a constant shift, mask and isLeaf. levels above 'start' were resolved by the walk cache.
+ */
+template <class G, uint64_t Level>
+static inline WalkStep walkFixed(VMContext &ctx, const G &geo, uint64_t va, bool create, uint64_t start,
+                                 uint64_t &frame, uint64_t &leafFrame_out)
 {
-    clearFrame(0, false); // root lives in frame 0 forever
+    if constexpr (Level == G::tablesDepth)
+    {
+        return WALK_DESCEND; // reached the data page
+    }
+    else
+    {
+        if (Level >= start)
+        {
+            WalkStep step = walkLevel(ctx, geo, va, create, Level, Level + 1 == G::tablesDepth, frame, leafFrame_out);
+            if (step != WALK_DESCEND) { return step; }
+        }
+        return walkFixed<G, Level + 1>(ctx, geo, va, create, start, frame, leafFrame_out);
+    }
 }
 
 /**
- * reads a word from the given virtual address and puts its content in *value.
- * @param virtualAddress
- * @param value
- * @return 1 for success 0 for failure
+ * this function is for walking func for the VMread/write, if we need to allocate new frame than we call it
+ * with our allocateFrame func witch with our scan func decide how to allocate it.
+ * a FixedGeometry walk is unrolled at compile time (walkFixed), a runtime Geometry loops over its levels.
+ *
+ * @param va        the virtual address
+ * @param create    if false → stop + return false on first missing pointer
+ *                  if true  → allocate frames/tables on demand
+ * @param leafFrame_out (out) frame number that contains the data page
+ * @return          true on success, false on unmapped page when create==false
  */
-int VMread(uint64_t virtualAddress, word_t *value)
+template <class G>
+static bool walk(VMContext &ctx, const G &geo, uint64_t va, bool create, uint64_t &leafFrame_out)
 {
-    if (virtualAddress >= VIRTUAL_MEMORY_SIZE) { return ZERO; }
+    VM_STAT_INC(ctx, walks);
+    VM_STAT_TIMER(ctx, walkTicks);
+    uint64_t frame = ctx.asid; // root of the current address space
+    uint64_t level = ZERO;
 
-    uint64_t leafFrame;
+    /* skip the upper levels this page shares with earlier walks */
+    if (ctx.walkCache.enabled())
+    {
+        level = ctx.walkCache.deepest(ctx.spaceBase | (va >> geo.offsetWidth), frame);
+        if (level != ZERO) VM_STAT_INC(ctx, walkCacheHits);
+    }
 
-    walk(virtualAddress, true, leafFrame);
+    WalkStep step = WALK_DESCEND;
+    if constexpr (G::fixed)
+    {
+        step = walkFixed<G, ZERO>(ctx, geo, va, create, level, frame, leafFrame_out);
+    }
+    else
+    {
+        for(; level < geo.tablesDepth && step == WALK_DESCEND; ++level)
+            step = walkLevel(ctx, geo, va, create, level, level + 1 == geo.tablesDepth, frame, leafFrame_out);
+    }
 
-    PMread(phys(leafFrame, offsetOf(virtualAddress)), value);
-    return 1;
+    if (step == WALK_UNMAPPED) { return false; }
+    if (step == WALK_DESCEND) { leafFrame_out = frame; }  // reached the data page
+    return true;
 }
 
 /**
- * writes a word to the given virtual address
- * @param virtualAddress
- * @param value
- * @return 1 for success 0 for failure
- */
-int VMwrite(uint64_t virtualAddress, word_t value)
+ * gives the current address space a copy of its own of the data page 'frame', which it shares with
+ * other spaces since a VMfork, before it writes to it. the others keep the original frame.
+ * @return the frame of the copy
+ **/
+template <class G>
+static uint64_t breakShare(VMContext &ctx, const G &geo, uint64_t va, uint64_t frame)
 {
+    uint64_t page = va >> geo.offsetWidth;
+    uint64_t table = ctx.frameTable.ownerIn(frame, ctx.asid);
+    uint64_t row = ctx.frameTable.rowOf(frame);
+    VM_STAT_INC(ctx, cowBreaks);
+    uint64_t copy = allocateFrame(ctx, table, row, page, true);
 
-    if (virtualAddress >= VIRTUAL_MEMORY_SIZE) { return ZERO; }
-    /* (A) Translate the address and CREATE pages on demand */
-    uint64_t leafFrame;
-    walk(virtualAddress, true, leafFrame);
-    /* (B) Write the value into physical memory */
-    PMwrite( phys(leafFrame, offsetOf(virtualAddress)), value );
+    word_t entry;
+    ctx.memory->read(phys(geo, table, row), &entry);
+    if ((uint64_t)entry != frame) // the shared page itself was evicted to make room: fault it back in
+    {
+        mapLeaf(ctx, table, row, page, copy);
+        return copy;
+    }
 
-    return 1;
-}
\ No newline at end of file
+    ctx.memory->copyFrame(copy, frame);
+    dropOwner(ctx, table, frame);
+    linkFrame(ctx, table, row, copy, true);
+    if (!ctx.policies.empty()) policyFor(ctx, ctx.asid)->onMap(ctx.spaceBase | page, copy);
+    return copy;
+}
+
+/**
+ * translates va to the frame of its data page, creating the mapping on demand.
+ * a TLB hit skips the walk entirely; a miss walks and caches the result.
+ *
+ * with lazy reads, a read of a page that is neither mapped nor in swap creates nothing
+ * and returns false: the page was never written, so it reads as zeros.
+ * a write to a page shared since a VMfork translates to a fresh copy of it.
+ **/
+template <class G>
+static bool translate(VMContext &ctx, const G &geo, uint64_t va, bool forRead, uint64_t &leafFrame_out)
+{
+    uint64_t key = ctx.spaceBase | (va >> geo.offsetWidth);
+    if (ctx.tlb.lookup(key, leafFrame_out))
+    {
+        VM_STAT_INC(ctx, tlbHits);
+    }
+    else
+    {
+        VM_STAT_INC(ctx, tlbMisses);
+
+        if (forRead && ctx.config.lazyReads)
+        {
+            if (!walk(ctx, geo, va, false, leafFrame_out))
+            {
+                // never written: reads as zeros
+                if (swapSource(ctx, ctx.asid, va >> geo.offsetWidth) == UINT64_MAX) return false;
+                walk(ctx, geo, va, true, leafFrame_out); // evicted: fault it back in
+            }
+        }
+        else
+        {
+            walk(ctx, geo, va, true, leafFrame_out);
+        }
+        ctx.tlb.insert(key, leafFrame_out);
+    }
+
+    if (!forRead && ctx.forked && ctx.frameTable.isShared(leafFrame_out))
+    {
+        leafFrame_out = breakShare(ctx, geo, va, leafFrame_out);
+        ctx.tlb.insert(key, leafFrame_out);
+    }
+    return true;
+}
+
+/**
+ * reports an access to a resident page to the eviction policy and the read-ahead.
+ **/
+static inline void noteAccess(VMContext &ctx, uint64_t page, uint64_t leafFrame)
+{
+    if (ctx.trackAccesses)
+    {
+        // a page shared since a VMfork is known to the policies by the space of its primary owner
+        uint64_t space = ctx.forked ? ctx.frameTable.spaceOf(leafFrame) : ctx.asid;
+        policyFor(ctx, space)->onAccess(pageKey(ctx, space, page), leafFrame);
+    }
+    if (ctx.prefetcher.enabled() && ctx.prefetcher.used(leafFrame))
+    {
+        VM_STAT_INC(ctx, prefetchUsed);
+        ctx.prefetcher.observe(ctx.spaceBase | page); // the stream goes on: keep the window ahead of it
+    }
+}
+
+/**
+ * fetches the pages the read-ahead asked for. runs after the access that triggered it completed,
+ * so the frames it evicts can no longer be in use by that access.
+ * only pages with a copy in swap are fetched: a page never written has nothing to read ahead.
+ * @return true if anything was mapped (so translations held by the caller may be stale).
+ */
+template <class G>
+static bool readAhead(VMContext &ctx, const G &geo)
+{
+    bool mapped = false;
+    ctx.prefetching = true;
+    const std::vector<uint64_t> &keys = ctx.prefetcher.take();
+    if (ctx.memory->asyncSwap())
+    {
+        for (uint64_t key : keys)
+            if ((key >> ctx.pageBits) == ctx.asid) hintRestore(ctx, key & (geo.numPages - 1));
+    }
+    for (uint64_t key : keys)
+    {
+        // the stream may run past the end of the current address space into the next one
+        if ((key >> ctx.pageBits) != ctx.asid) continue;
+        uint64_t va = (key & (geo.numPages - 1)) << geo.offsetWidth;
+        uint64_t frame;
+        if (swapSource(ctx, ctx.asid, va >> geo.offsetWidth) == UINT64_MAX || walk(ctx, geo, va, false, frame)) continue;
+
+        walk(ctx, geo, va, true, frame);
+        ctx.prefetcher.prefetched(frame);
+        VM_STAT_INC(ctx, prefetchIssued);
+        mapped = true;
+    }
+    ctx.prefetching = false;
+    return mapped;
+}
+
+/* the outcome of sharedWalk() */
+enum SharedStep
+{
+    SHARED_RESIDENT, // the data page is announced
+    SHARED_MISSING,  // a row on the way is empty: a fault
+    SHARED_RACED     // a frame on the way went away: walk again
+};
+
+/**
+ * the lock-free walk of a concurrent context (see SharedAccess.h), one announced table at a time.
+ * resident: 'at' is the data page, which stays announced until the caller's leave().
+ * missing: 'at' is the table whose row at 'level' is empty, and the version it was walked at.
+ **/
+template <class G>
+static SharedStep sharedWalk(VMContext &ctx, const G &geo, const SharedAccess::View &view, uint64_t va,
+                             SharedAccess::Entry &at, uint64_t &level)
+{
+    SharedAccess &shared = *ctx.shared;
+    at.frame = ctx.asid; // the root, never retired
+    at.version = shared.version(at.frame);
+    for (level = ZERO; level < geo.tablesDepth; ++level)
+    {
+        uint64_t row = phys(geo, at.frame, indexAtLevel(geo, va, level));
+        uint64_t child = (uint64_t)ctx.memory->readEntryShared(row);
+        if (child == 0)
+        {
+            shared.leave(view);
+            return SHARED_MISSING;
+        }
+
+        /* the row still names the child after its version was read: it was linked there at that version */
+        uint64_t version = shared.version(child);
+        bool linked = (version & 1) == 0 && (uint64_t)ctx.memory->readEntryShared(row) == child;
+        shared.leave(view);
+        if (!linked || !shared.enter(view, child, version)) return SHARED_RACED;
+        at.frame = child;
+        at.version = version;
+    }
+    return SHARED_RESIDENT;
+}
+
+/**
+ * one access to a concurrent context: a hit through the thread's own cache, or through a lock-free
+ * walk. only a missing row takes the page's fault lock, then, once the walk still finds it missing,
+ * the allocator lock for the levels from that row down; the access is then retried as a hit.
+ * its fresh translation may go stale before that (another thread evicted the frame); then it is
+ * walked, or faulted, again.
+ **/
+template <class G>
+static int sharedWord(VMContext &ctx, const G &geo, uint64_t virtualAddress, bool forRead, word_t *value)
+{
+    if (virtualAddress >= geo.virtualMemorySize) { return ZERO; }
+
+    SharedAccess &shared = *ctx.shared;
+    SharedAccess::View &view = shared.view();
+    uint64_t page = virtualAddress >> geo.offsetWidth;
+    SharedAccess::Entry &entry = view.entry(page);
+    std::unique_lock<std::mutex> faultLock(shared.faultLock(page), std::defer_lock);
+    for (;;)
+    {
+        if (entry.page != page || !shared.enter(view, entry))
+        {
+            uint64_t level;
+            SharedStep step = sharedWalk(ctx, geo, view, virtualAddress, entry, level);
+            if (step == SHARED_RACED)
+            {
+                entry.page = UINT64_MAX;
+                std::this_thread::yield(); // until the allocator is done with the frame
+                continue;
+            }
+            if (step == SHARED_MISSING)
+            {
+                entry.page = UINT64_MAX;
+                if (!faultLock.owns_lock())
+                {
+                    faultLock.lock(); // and look again, another thread may have faulted it in meanwhile
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> allocatorLock(shared.allocatorLock());
+                if (shared.version(entry.frame) != entry.version) continue; // the table itself went away
+                if (forRead && ctx.config.lazyReads && swapSource(ctx, ctx.asid, page) == UINT64_MAX)
+                {
+                    *value = 0; // never written: reads as zeros
+                    return 1;
+                }
+                uint64_t frame = entry.frame;
+                uint64_t leafFrame = frame;
+                WalkStep walked = WALK_DESCEND;
+                for (; level < geo.tablesDepth && walked == WALK_DESCEND; ++level)
+                    walked = walkLevel(ctx, geo, virtualAddress, true, level, level + 1 == geo.tablesDepth, frame, leafFrame);
+                if (walked == WALK_DESCEND) leafFrame = frame;
+                entry.frame = leafFrame;
+                entry.version = shared.version(leafFrame);
+                entry.page = page;
+                continue;
+            }
+            entry.page = page;
+        }
+
+        uint64_t pa = phys(geo, entry.frame, offsetOf(geo, virtualAddress));
+        if (forRead) *value = ctx.memory->readShared(pa);
+        else ctx.memory->writeShared(pa, *value);
+        shared.leave(view);
+        return 1;
+    }
+}
+
+template <class G>
+static int readWord(VMContext &ctx, const G &geo, uint64_t virtualAddress, word_t *value)
+{
+    if (virtualAddress >= geo.virtualMemorySize) { return ZERO; }
+    if (ctx.shared) return sharedWord(ctx, geo, virtualAddress, true, value);
+    if (ctx.analyzer) ctx.analyzer->access(ctx.spaceBase | (virtualAddress >> geo.offsetWidth));
+
+    uint64_t leafFrame;
+
+    if (!translate(ctx, geo, virtualAddress, true, leafFrame)) { *value = 0; return 1; }
+    noteAccess(ctx, virtualAddress >> geo.offsetWidth, leafFrame);
+
+    ctx.memory->read(phys(geo, leafFrame, offsetOf(geo, virtualAddress)), value);
+    if (ctx.prefetcher.pending()) readAhead(ctx, geo);
+    return 1;
+}
+
+template <class G>
+static int writeWord(VMContext &ctx, const G &geo, uint64_t virtualAddress, word_t value)
+{
+    if (virtualAddress >= geo.virtualMemorySize) { return ZERO; }
+    if (ctx.shared) return sharedWord(ctx, geo, virtualAddress, false, &value);
+    if (ctx.analyzer) ctx.analyzer->access(ctx.spaceBase | (virtualAddress >> geo.offsetWidth));
+    /* (A) Translate the address and CREATE pages on demand */
+    uint64_t leafFrame;
+    translate(ctx, geo, virtualAddress, false, leafFrame);
+    noteAccess(ctx, virtualAddress >> geo.offsetWidth, leafFrame);
+    /* (B) Write the value into physical memory */
+    ctx.memory->write( phys(geo, leafFrame, offsetOf(geo, virtualAddress)), value );
+    if (ctx.prefetcher.pending()) readAhead(ctx, geo);
+
+    return 1;
+}
+
+/* ===================================================================== */
+/*                      BULK TRANSLATION                                 */
+/* ===================================================================== */
+
+/* handed to read callbacks instead of a physical address for pages that read as zeros (lazy reads) */
+#define NEVER_TOUCHED UINT64_MAX
+/* with swap workers, how many accesses ahead bulk calls announce the pages they will restore */
+#define SWAP_HINT_WINDOW 64
+
+/**
+ * scattered accesses: consecutive entries on the same page reuse the previous translation,
+ * which is exactly what translate() would return since nothing faults in between.
+ **/
+template <class G, class Access>
+static int bulkAccess(VMContext &ctx, const G &geo, const uint64_t *virtualAddresses, size_t n, bool forRead, Access access)
+{
+    int ok = 1;
+    uint64_t lastPage = UINT64_MAX;
+    uint64_t leafFrame = 0;
+    bool mapped = true;
+    size_t hinted = ctx.memory->asyncSwap() ? 0 : n;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i == hinted)
+        {
+            /* the faults of the next window then wait for reads already under way */
+            hinted = std::min(n, i + SWAP_HINT_WINDOW);
+            uint64_t previous = UINT64_MAX;
+            for (size_t j = i; j < hinted; ++j)
+            {
+                uint64_t ahead = virtualAddresses[j] >> geo.offsetWidth;
+                if (virtualAddresses[j] < geo.virtualMemorySize && ahead != previous) hintRestore(ctx, ahead);
+                previous = ahead;
+            }
+        }
+        uint64_t va = virtualAddresses[i];
+        if (va >= geo.virtualMemorySize) { ok = ZERO; continue; }
+
+        uint64_t page = va >> geo.offsetWidth;
+        if (ctx.analyzer) ctx.analyzer->access(ctx.spaceBase | page);
+        if (page != lastPage)
+        {
+            mapped = translate(ctx, geo, va, forRead, leafFrame);
+            lastPage = page;
+        }
+        if (mapped) noteAccess(ctx, page, leafFrame);
+        access(i, mapped ? phys(geo, leafFrame, offsetOf(geo, va)) : NEVER_TOUCHED);
+        if (ctx.prefetcher.pending() && readAhead(ctx, geo)) lastPage = UINT64_MAX;
+    }
+    return ok;
+}
+
+/**
+ * a contiguous range: one translation and one block copy per page it touches.
+ **/
+template <class G, class Copy>
+static int rangeAccess(VMContext &ctx, const G &geo, uint64_t virtualAddress, size_t length, bool forRead, Copy copy)
+{
+    if (virtualAddress >= geo.virtualMemorySize || length > geo.virtualMemorySize - virtualAddress)
+    {
+        return ZERO;
+    }
+
+    size_t done = 0;
+    uint64_t lastPage = (virtualAddress + length - 1) >> geo.offsetWidth;
+    uint64_t hinted = ctx.memory->asyncSwap() ? virtualAddress >> geo.offsetWidth : lastPage + 1;
+    while (done < length)
+    {
+        uint64_t va = virtualAddress + done;
+        uint64_t offset = offsetOf(geo, va);
+        uint64_t run = std::min<uint64_t>(geo.pageSize - offset, length - done);
+
+        if ((va >> geo.offsetWidth) == hinted)
+        {
+            uint64_t end = std::min<uint64_t>(lastPage + 1, hinted + SWAP_HINT_WINDOW);
+            for (; hinted < end; ++hinted) hintRestore(ctx, hinted);
+        }
+
+        if (ctx.analyzer) ctx.analyzer->access(ctx.spaceBase | (va >> geo.offsetWidth));
+        uint64_t leafFrame;
+        bool mapped = translate(ctx, geo, va, forRead, leafFrame);
+        if (mapped) noteAccess(ctx, va >> geo.offsetWidth, leafFrame);
+        if (ctx.prefetcher.pending())
+        {
+            /* read-ahead may evict this very page, so like the scalar calls it runs right after this word */
+            copy(mapped ? phys(geo, leafFrame, offset) : NEVER_TOUCHED, done, 1);
+            done += 1;
+            readAhead(ctx, geo);
+            continue;
+        }
+        if (mapped)
+        {
+            /* one report per word, so a range is seen exactly like the same words accessed one by one */
+            for (uint64_t i = 1; i < run; ++i) noteAccess(ctx, va >> geo.offsetWidth, leafFrame);
+        }
+        if (ctx.analyzer) ctx.analyzer->repeat(ctx.spaceBase | (va >> geo.offsetWidth), run - 1);
+        copy(mapped ? phys(geo, leafFrame, offset) : NEVER_TOUCHED, done, run);
+        done += run;
+    }
+    return 1;
+}
+
+template <class G>
+static int readBulk(VMContext &ctx, const G &geo, const uint64_t *virtualAddresses, word_t *values, size_t n)
+{
+    if (ctx.shared)
+    {
+        int ok = 1;
+        for (size_t i = 0; i < n; ++i)
+            if (!sharedWord(ctx, geo, virtualAddresses[i], true, &values[i])) ok = ZERO;
+        return ok;
+    }
+    return bulkAccess(ctx, geo, virtualAddresses, n, true, [&ctx, values](size_t i, uint64_t pa) {
+        if (pa == NEVER_TOUCHED) values[i] = 0;
+        else ctx.memory->read(pa, &values[i]);
+    });
+}
+
+template <class G>
+static int writeBulk(VMContext &ctx, const G &geo, const uint64_t *virtualAddresses, const word_t *values, size_t n)
+{
+    if (ctx.shared)
+    {
+        int ok = 1;
+        for (size_t i = 0; i < n; ++i)
+        {
+            word_t value = values[i];
+            if (!sharedWord(ctx, geo, virtualAddresses[i], false, &value)) ok = ZERO;
+        }
+        return ok;
+    }
+    return bulkAccess(ctx, geo, virtualAddresses, n, false,
+                      [&ctx, values](size_t i, uint64_t pa) { ctx.memory->write(pa, values[i]); });
+}
+
+template <class G>
+static int readRange(VMContext &ctx, const G &geo, uint64_t virtualAddress, word_t *values, size_t length)
+{
+    if (ctx.shared)
+    {
+        if (virtualAddress >= geo.virtualMemorySize || length > geo.virtualMemorySize - virtualAddress) return ZERO;
+        for (size_t i = 0; i < length; ++i) sharedWord(ctx, geo, virtualAddress + i, true, &values[i]);
+        return 1;
+    }
+    return rangeAccess(ctx, geo, virtualAddress, length, true, [&ctx, values](uint64_t pa, size_t at, uint64_t run) {
+        if (pa == NEVER_TOUCHED) std::fill(values + at, values + at + run, 0);
+        else ctx.memory->readRange(pa, values + at, run);
+    });
+}
+
+template <class G>
+static int writeRange(VMContext &ctx, const G &geo, uint64_t virtualAddress, const word_t *values, size_t length)
+{
+    if (ctx.shared)
+    {
+        if (virtualAddress >= geo.virtualMemorySize || length > geo.virtualMemorySize - virtualAddress) return ZERO;
+        for (size_t i = 0; i < length; ++i)
+        {
+            word_t value = values[i];
+            sharedWord(ctx, geo, virtualAddress + i, false, &value);
+        }
+        return 1;
+    }
+    return rangeAccess(ctx, geo, virtualAddress, length, false,
+                       [&ctx, values](uint64_t pa, size_t at, uint64_t run) { ctx.memory->writeRange(pa, values + at, run); });
+}
+
+/* ===================================================================== */
+/*                      PUBLIC READ / WRITE API                          */
+/* ===================================================================== */
+
+VMContext::VMContext() : ownedMemory(new PhysicalMemory()), memory(ownedMemory.get())
+{
+}
+
+VMContext::VMContext(PhysicalMemory &sharedMemory) : memory(&sharedMemory)
+{
+}
+
+/**
+ * the context behind the VM* functions that do not take one. it drives PMdefault(),
+ * so PMread/printRam keep showing the simulation driven by VMread/VMwrite.
+ **/
+VMContext &VMdefaultContext()
+{
+    static VMContext context(PMdefault());
+    return context;
+}
+
+/**
+ * We Initialize 0 in each row in the first frame of the PM.
+ * that's for marking frame 0, and set that he not point to any other page or table.
+ * (with several address spaces, frames 1.. are the roots of the others, and are cleared the same way)
+ **/
+void VMinitialize(VMContext &ctx, const Geometry &layout, const VMConfig &config)
+{
+    assert(config.addressSpaces >= 1 && config.addressSpaces < layout.numFrames);
+    ctx.memory->initialize(layout, config.swap, config.swapPath, config.addressSpaces, config.swapWorkers);
+    VMresetState(ctx, layout, config);
+
+    for (uint64_t root = ZERO; root < config.addressSpaces; ++root)
+        clearFrame(ctx, root, false); // root of space 'root' lives in frame 'root' forever
+}
+
+void VMresetState(VMContext &ctx, const Geometry &layout, const VMConfig &config)
+{
+    ctx.geometry = layout;
+    ctx.defaultGeometry = (layout == DefaultGeometry::runtime());
+    ctx.config = config;
+    assert(config.addressSpaces >= 1 && config.addressSpaces < layout.numFrames);
+    ctx.asid = ZERO;
+    ctx.spaceBase = ZERO;
+    ctx.pageBits = layout.virtualAddressWidth - layout.offsetWidth;
+    ctx.lineage.assign(config.addressSpaces, SwapLineage());
+    ctx.forked = false;
+    ctx.tlb.configure(config.tlbSets, config.tlbWays);
+    ctx.walkCache.configure(ctx.geometry.tablesDepth, ctx.geometry.offsetWidth, config.walkCacheEntries);
+    /* the DFS, the policies and the other address spaces know nothing about runs of frames */
+    assert(config.hugeOrder == 0 ||
+           (config.allocator == ALLOCATOR_INCREMENTAL && config.eviction == EVICT_CYCLIC && !config.customEviction &&
+            config.addressSpaces == 1));
+    assert(config.hugeOrder < ctx.geometry.tablesDepth);
+    ctx.hugeFrames = (config.hugeOrder == 0) ? 0 : 1ULL << (ctx.geometry.offsetWidth * config.hugeOrder);
+    assert(ctx.hugeFrames < ctx.geometry.numFrames);
+    ctx.hugeLevel = ctx.geometry.tablesDepth - 1 - config.hugeOrder;
+    ctx.hugeRegions.clear();
+
+    /* frames only become free outside the trees when a huge run or a whole address space (VMfork) goes */
+    ctx.frameTable.reset(ctx.geometry.numFrames, ctx.geometry.offsetWidth, ctx.geometry.tablesDepth,
+                         config.addressSpaces, config.allocator != ALLOCATOR_SCAN,
+                         config.hugeOrder != 0 || config.addressSpaces > 1);
+
+    /* a local scope gives every address space a policy of its own, that only sees its pages */
+    ctx.policies.clear();
+    uint64_t policies = (config.evictionScope == EVICT_LOCAL) ? config.addressSpaces : 1;
+    for (uint64_t i = ZERO; i < policies; ++i)
+    {
+        std::unique_ptr<EvictionPolicy> policy = config.customEviction ? config.customEviction()
+                                                                       : makeEvictionPolicy(config.eviction);
+        if (!policy) break; // the cyclic rule
+        policy->reset(ctx.geometry, ctx.frameTable);
+        ctx.policies.push_back(std::move(policy));
+    }
+    ctx.trackAccesses = !ctx.policies.empty() && ctx.policies[ZERO]->tracksAccesses();
+    ctx.prefetcher.reset(config.prefetchWindow, ctx.geometry.numFrames, config.addressSpaces << ctx.pageBits);
+    ctx.prefetching = false;
+
+    /* the hits skip the policies, the read-ahead and the copy-on-write checks of translate() */
+    assert(!config.concurrent || (config.eviction == EVICT_CYCLIC && !config.customEviction &&
+                                  config.addressSpaces == 1 && config.hugeOrder == 0 && config.prefetchWindow == 0));
+    ctx.shared.reset(config.concurrent ? new SharedAccess(ctx.geometry.numFrames) : nullptr);
+    ctx.pageFaults = 0;
+    ctx.stats = VMStats();
+}
+
+/**
+ * reads a word from the given virtual address and puts its content in *value.
+ * @param virtualAddress
+ * @param value
+ * @return 1 for success 0 for failure
+ */
+int VMread(VMContext &ctx, uint64_t virtualAddress, word_t *value)
+{
+    if (ctx.recorder) ctx.recorder->record(false, virtualAddress, 0);
+    if (ctx.defaultGeometry) { return readWord(ctx, DefaultGeometry(), virtualAddress, value); }
+    return readWord(ctx, ctx.geometry, virtualAddress, value);
+}
+
+/**
+ * writes a word to the given virtual address
+ * @param virtualAddress
+ * @param value
+ * @return 1 for success 0 for failure
+ */
+int VMwrite(VMContext &ctx, uint64_t virtualAddress, word_t value)
+{
+    if (ctx.recorder) ctx.recorder->record(true, virtualAddress, value);
+    if (ctx.defaultGeometry) { return writeWord(ctx, DefaultGeometry(), virtualAddress, value); }
+    return writeWord(ctx, ctx.geometry, virtualAddress, value);
+}
+
+int VMreadBulk(VMContext &ctx, const uint64_t *virtualAddresses, word_t *values, size_t n)
+{
+    if (ctx.recorder)
+        for (size_t i = 0; i < n; ++i) ctx.recorder->record(false, virtualAddresses[i], 0);
+    if (ctx.defaultGeometry) { return readBulk(ctx, DefaultGeometry(), virtualAddresses, values, n); }
+    return readBulk(ctx, ctx.geometry, virtualAddresses, values, n);
+}
+
+int VMwriteBulk(VMContext &ctx, const uint64_t *virtualAddresses, const word_t *values, size_t n)
+{
+    if (ctx.recorder)
+        for (size_t i = 0; i < n; ++i) ctx.recorder->record(true, virtualAddresses[i], values[i]);
+    if (ctx.defaultGeometry) { return writeBulk(ctx, DefaultGeometry(), virtualAddresses, values, n); }
+    return writeBulk(ctx, ctx.geometry, virtualAddresses, values, n);
+}
+
+int VMreadRange(VMContext &ctx, uint64_t virtualAddress, word_t *values, size_t length)
+{
+    if (ctx.recorder)
+        for (size_t i = 0; i < length; ++i) ctx.recorder->record(false, virtualAddress + i, 0);
+    if (ctx.defaultGeometry) { return readRange(ctx, DefaultGeometry(), virtualAddress, values, length); }
+    return readRange(ctx, ctx.geometry, virtualAddress, values, length);
+}
+
+int VMwriteRange(VMContext &ctx, uint64_t virtualAddress, const word_t *values, size_t length)
+{
+    if (ctx.recorder)
+        for (size_t i = 0; i < length; ++i) ctx.recorder->record(true, virtualAddress + i, values[i]);
+    if (ctx.defaultGeometry) { return writeRange(ctx, DefaultGeometry(), virtualAddress, values, length); }
+    return writeRange(ctx, ctx.geometry, virtualAddress, values, length);
+}
+
+void VMswitch(VMContext &ctx, uint64_t asid)
+{
+    assert(asid < ctx.config.addressSpaces);
+    ctx.asid = asid;
+    ctx.spaceBase = asid << ctx.pageBits;
+}
+
+/* ===================================================================== */
+/*                        COPY-ON-WRITE FORK                             */
+/* ===================================================================== */
+
+/**
+ * drops everything below table 'table' (at depth 'depth') without writing anything back: tables and
+ * data pages of its own are unlinked (their frames become free), shared pages lose this owner.
+ **/
+static void dropTable(VMContext &ctx, uint64_t table, uint64_t depth)
+{
+    for (uint64_t row = 0; row < ctx.geometry.pageSize; ++row)
+    {
+        word_t entry;
+        ctx.memory->read(phys(ctx.geometry, table, row), &entry);
+        if (entry == ZERO) continue;
+        uint64_t child = (uint64_t)entry;
+
+        if (depth + 1 < ctx.geometry.tablesDepth)
+        {
+            dropTable(ctx, child, depth + 1);
+            unlinkFrame(ctx, table, row, child);
+            ctx.walkCache.invalidateFrame(child);
+        }
+        else if (ctx.frameTable.isShared(child))
+        {
+            dropOwner(ctx, table, child);
+        }
+        else
+        {
+            uint64_t key = pageKey(ctx, ctx.frameTable.spaceOf(child), ctx.frameTable.pageOf(child));
+            unlinkFrame(ctx, table, row, child);
+            ctx.tlb.invalidatePage(key);
+            if (EvictionPolicy *policy = policyFor(ctx, ctx.frameTable.spaceOf(table))) policy->onUnmap(key, child);
+            if (ctx.prefetcher.enabled()) ctx.prefetcher.evicted(child);
+        }
+    }
+}
+
+/**
+ * empties address space 'space': its pages and tables, and its swap copies. the spaces forked from it
+ * first take their own copies of the pages they still inherit from it, and inherit the rest from its
+ * origin instead.
+ **/
+static void discardSpace(VMContext &ctx, uint64_t space)
+{
+    SwapLineage &dead = ctx.lineage[space];
+    for (uint64_t heir = ZERO; heir < ctx.config.addressSpaces; ++heir)
+    {
+        SwapLineage &lineage = ctx.lineage[heir];
+        if (lineage.origin != space) continue;
+        for (uint64_t page : dead.own)
+        {
+            if (!lineage.own.insert(page).second) continue;
+            uint64_t key = pageKey(ctx, space, page);
+            if (ctx.memory->inSwap(key)) ctx.memory->copySwap(key, pageKey(ctx, heir, page));
+        }
+        lineage.origin = dead.origin;
+    }
+
+    dropTable(ctx, space, ZERO);
+    for (uint64_t page : dead.own) ctx.memory->discard(pageKey(ctx, space, page));
+    dead.own.clear();
+    dead.origin = UINT64_MAX;
+}
+
+/**
+ * the last-level table of the current address space on the path to 'page', creating the missing
+ * tables (but not the page).
+ **/
+static uint64_t forkPath(VMContext &ctx, uint64_t page)
+{
+    const Geometry &geo = ctx.geometry;
+    uint64_t va = page << geo.offsetWidth;
+    uint64_t frame = ctx.asid;
+    uint64_t unused;
+    for (uint64_t level = ZERO; level + 1 < geo.tablesDepth; ++level)
+        walkLevel(ctx, geo, va, true, level, false, frame, unused);
+    return frame;
+}
+
+void VMfork(VMContext &ctx, uint64_t parent, uint64_t child)
+{
+    assert(parent < ctx.config.addressSpaces && child < ctx.config.addressSpaces && parent != child);
+    uint64_t current = ctx.asid;
+    ctx.forked = true;
+    discardSpace(ctx, child);
+
+    /* the tables the child gets may evict pages of the parent: take the list first, and skip the
+     * pages that are gone by the time their turn comes (they are in the parent's swap by then) */
+    std::vector<std::pair<uint64_t, uint64_t>> resident; // (frame, page)
+    for (uint64_t frame = ctx.config.addressSpaces; frame < ctx.geometry.numFrames; ++frame)
+    {
+        if (ctx.frameTable.referenced(frame) && ctx.frameTable.isLeaf(frame) &&
+            ctx.frameTable.ownerIn(frame, parent) != UINT64_MAX)
+            resident.emplace_back(frame, ctx.frameTable.pageOf(frame));
+    }
+
+    VMswitch(ctx, child);
+    SwapLineage &lineage = ctx.lineage[child];
+    for (const auto &leaf : resident)
+    {
+        uint64_t table = forkPath(ctx, leaf.second);
+        uint64_t frame = leaf.first;
+        if (!ctx.frameTable.referenced(frame) || !ctx.frameTable.isLeaf(frame) ||
+            ctx.frameTable.pageOf(frame) != leaf.second || ctx.frameTable.ownerIn(frame, parent) == UINT64_MAX)
+            continue;
+
+        uint64_t row = ctx.frameTable.rowOf(frame);
+        ctx.memory->write(phys(ctx.geometry, table, row), (word_t)frame);
+        ctx.frameTable.share(table, row, frame);
+        /* its swap copy (if any) is the parent's, and may be older than the frame */
+        ctx.memory->markDirty(frame);
+        lineage.own.insert(leaf.second);
+    }
+
+    /* from now on the parent's swap copies are the child's too, until either side writes one back */
+    lineage.origin = parent;
+    VMswitch(ctx, current);
+}
+
+void VMadviseHuge(VMContext &ctx, uint64_t virtualAddress, uint64_t length)
+{
+    if (ctx.hugeFrames == ZERO || virtualAddress >= ctx.geometry.virtualMemorySize) return;
+    length = std::min(length, ctx.geometry.virtualMemorySize - virtualAddress);
+
+    uint64_t shift = ctx.geometry.offsetWidth * (ctx.config.hugeOrder + 1); // words per region
+    uint64_t first = (virtualAddress + (1ULL << shift) - 1) >> shift;
+    uint64_t end = (virtualAddress + length) >> shift;
+    for (uint64_t region = first; region < end; ++region) ctx.hugeRegions.insert(region);
+}
+
+/* ===================================================================== */
+/*                 INTEGRITY CHECK (tree vs. frame table)                */
+/* ===================================================================== */
+
+/**
+ * checks the table held by 'frame' (at depth 'depth', serving page-number prefix 'prefix') and
+ * everything below it against the frame table. every frame reached is marked in 'seen' and counted
+ * in 'reached'; the rows that reach a shared page again are counted in 'sharedRows'.
+ **/
+static bool checkTable(const VMContext &ctx, uint64_t frame, uint64_t depth, uint64_t prefix,
+                       std::vector<bool> &seen, uint64_t &reached, uint64_t &sharedRows)
+{
+    const Geometry &geo = ctx.geometry;
+    const FrameTable &table = ctx.frameTable;
+    uint64_t children = ZERO;
+
+    for (uint64_t row = 0; row < geo.pageSize; ++row)
+    {
+        word_t entry;
+        ctx.memory->read(phys(geo, frame, row), &entry);
+        if (entry == ZERO) continue;
+        children++;
+
+        bool huge = entry & HUGE_ENTRY_FLAG;
+        uint64_t child = (uint64_t)(entry & ~HUGE_ENTRY_FLAG);
+        uint64_t childPrefix = (prefix << geo.offsetWidth) | row;
+
+        /* the record of the frame must name exactly this row as its owner (for a page shared since a
+         * VMfork, as the owner in this table's space) */
+        if (child == ZERO || child >= geo.numFrames) return false;
+        bool shared = !huge && table.isShared(child);
+        if (seen[child] && !shared) return false;
+        uint64_t owner = shared ? table.ownerIn(child, table.spaceOf(frame)) : table.parentOf(child);
+        if (owner != frame || table.rowOf(child) != row || table.prefixOf(child) != childPrefix ||
+            table.depthOf(child) != depth + 1 || (!shared && table.spaceOf(child) != table.spaceOf(frame))) return false;
+        if (seen[child])
+        {
+            sharedRows++;
+            continue;
+        }
+        seen[child] = true;
+        reached++;
+
+        if (huge) // a run: its first frame is the leaf, the others point back to it
+        {
+            uint64_t run = table.runOf(child);
+            if (ctx.hugeFrames == ZERO || depth != ctx.hugeLevel || run != ctx.hugeFrames ||
+                child + run > geo.numFrames) return false;
+            for (uint64_t i = 1; i < run; ++i)
+            {
+                uint64_t tail = child + i;
+                if (seen[tail] || !table.isTail(tail) || table.parentOf(tail) != child || table.rowOf(tail) != i)
+                    return false;
+                seen[tail] = true;
+                reached++;
+            }
+        }
+        else if (depth + 1 == geo.tablesDepth) // data page
+        {
+            if (!table.isLeaf(child) || table.runOf(child) != ZERO) return false;
+        }
+        else // table
+        {
+            if (table.isLeaf(child) || !checkTable(ctx, child, depth + 1, childPrefix, seen, reached, sharedRows))
+                return false;
+        }
+    }
+    return table.childrenOf(frame) == children;
+}
+
+bool VMcheckIntegrity(const VMContext &ctx)
+{
+    std::vector<bool> seen(ctx.geometry.numFrames, false);
+    uint64_t reached = ZERO;
+    uint64_t sharedRows = ZERO;
+    for (uint64_t root = ZERO; root < ctx.config.addressSpaces; ++root)
+    {
+        if (ctx.frameTable.parentOf(root) != root || ctx.frameTable.spaceOf(root) != root) return false;
+        seen[root] = true;
+    }
+    for (uint64_t root = ZERO; root < ctx.config.addressSpaces; ++root)
+    {
+        if (!checkTable(ctx, root, ZERO, ZERO, seen, reached, sharedRows)) return false;
+    }
+
+    /* and no frame outside the trees may look referenced, nor a shared page have an owner the trees lack */
+    uint64_t referenced = ZERO;
+    uint64_t sharers = ZERO;
+    for (uint64_t frame = ctx.config.addressSpaces; frame < ctx.geometry.numFrames; ++frame)
+    {
+        if (!ctx.frameTable.referenced(frame)) continue;
+        if (!seen[frame] || frame > ctx.frameTable.maxFrame()) return false;
+        referenced++;
+        sharers += ctx.frameTable.ownerCount(frame) - 1;
+    }
+    return referenced == reached && sharers == sharedRows;
+}
+
+/* ===================================================================== */
+/*                 DEFAULT-CONTEXT WRAPPERS (original API)               */
+/* ===================================================================== */
+
+void VMinitialize()
+{
+    VMinitialize(VMdefaultContext(), Geometry(), VMConfig());
+}
+
+void VMinitialize(const VMConfig &config)
+{
+    VMinitialize(VMdefaultContext(), Geometry(), config);
+}
+
+void VMinitialize(const Geometry &layout, const VMConfig &config)
+{
+    VMinitialize(VMdefaultContext(), layout, config);
+}
+
+int VMread(uint64_t virtualAddress, word_t *value)
+{
+    return VMread(VMdefaultContext(), virtualAddress, value);
+}
+
+int VMwrite(uint64_t virtualAddress, word_t value)
+{
+    return VMwrite(VMdefaultContext(), virtualAddress, value);
+}
+
+int VMreadBulk(const uint64_t *virtualAddresses, word_t *values, size_t n)
+{
+    return VMreadBulk(VMdefaultContext(), virtualAddresses, values, n);
+}
+
+int VMwriteBulk(const uint64_t *virtualAddresses, const word_t *values, size_t n)
+{
+    return VMwriteBulk(VMdefaultContext(), virtualAddresses, values, n);
+}
+
+int VMreadRange(uint64_t virtualAddress, word_t *values, size_t length)
+{
+    return VMreadRange(VMdefaultContext(), virtualAddress, values, length);
+}
+
+int VMwriteRange(uint64_t virtualAddress, const word_t *values, size_t length)
+{
+    return VMwriteRange(VMdefaultContext(), virtualAddress, values, length);
+}
+
+void VMadviseHuge(uint64_t virtualAddress, uint64_t length)
+{
+    VMadviseHuge(VMdefaultContext(), virtualAddress, length);
+}
+
+void VMswitch(uint64_t asid)
+{
+    VMswitch(VMdefaultContext(), asid);
+}
+
+void VMfork(uint64_t parent, uint64_t child)
+{
+    VMfork(VMdefaultContext(), parent, child);
+}
+
+bool VMcheckIntegrity()
+{
+    return VMcheckIntegrity(VMdefaultContext());
+}
@@ -1,12 +1,111 @@
 #pragma once
 
 #include "MemoryConstants.h"
+#include "Geometry.h"
+#include "SwapStore.h"
+#include "EvictionPolicy.h"
+#include <cstddef>
+
+/*
+ * How allocateFrame() learns which frames are empty, free or evictable.
+ */
+enum AllocatorMode
+{
+    ALLOCATOR_SCAN,        // full DFS over the page-table tree on every fault (reference behavior)
+    ALLOCATOR_INCREMENTAL, // bookkeeping updated on every link/unlink, no DFS
+    ALLOCATOR_CHECKED      // incremental, but every decision is asserted against the DFS (and
+                           // the frame table against the tree, see VMcheckIntegrity)
+};
+
+/*
+ * Which resident pages priority #3 may evict when several address spaces share the frames.
+ */
+enum EvictionScope
+{
+    EVICT_GLOBAL, // any address space's pages
+    EVICT_LOCAL   // only the faulting space's own pages (any space's, if it has none resident)
+};
+
+/*
+ * Tunables of the simulator. The TLB, allocator mode and swap backend only change how much work
+ * is spent producing the results of VMread/VMwrite; lazyReads and the eviction policy change
+ * which pages get evicted (and so the results), and default to the original behavior.
+ */
+struct VMConfig
+{
+    // software TLB geometry: number of sets (power of 2) and entries per set (0 disables it)
+    uint64_t tlbSets = TLB_SETS;
+    uint64_t tlbWays = TLB_WAYS;
+
+    // paging-structure cache: cached table frames per level (power of 2, 0 disables it)
+    uint64_t walkCacheEntries = WALK_CACHE_ENTRIES;
+
+    AllocatorMode allocator = ALLOCATOR_SCAN;
+
+    // reads of pages that were never written (neither mapped nor in swap) return 0 without
+    // allocating tables or frames, so they cannot cause evictions. changes what such reads
+    // return (0 instead of whatever the frame held), so it is opt-in.
+    bool lazyReads = false;
+
+    // where PMevict puts evicted pages, and the backing file of SWAP_MAPPED (empty = anonymous)
+    SwapBackend swap = SWAP_POOLED;
+    std::string swapPath;
+
+    // which resident page priority #3 evicts. policies find the victim's parent and row in the
+    // frame table, which is kept in every allocator mode. a non-empty customEviction overrides the kind.
+    EvictionPolicyKind eviction = EVICT_CYCLIC;
+    EvictionPolicyFactory customEviction;
+
+    // huge pages: a fault in a region given to VMadviseHuge maps PAGE_SIZE^hugeOrder pages at once,
+    // held by as many contiguous frames and linked hugeOrder levels above the leaves (0 disables).
+    // needs ALLOCATOR_INCREMENTAL and EVICT_CYCLIC.
+    uint64_t hugeOrder = 0;
+
+    // simulated processes: address space s has its own page-table tree rooted in frame s, and all of
+    // them share the remaining frames and one swap. VMswitch picks the space later accesses go to.
+    // the TLB and the paging-structure cache tag their entries with the space, so switching flushes
+    // nothing. VMfork copies one space into another, sharing their data pages until they are written.
+    // huge pages need a single address space.
+    uint64_t addressSpaces = 1;
+    EvictionScope evictionScope = EVICT_GLOBAL;
+
+    // read-ahead: after a demand fault that continues a sequential or strided stream, fetch up to
+    // this many of its next pages from swap (0 disables it). the window adapts below this limit.
+    uint64_t prefetchWindow = 0;
+
+    // swap I/O on this many worker threads (at most SWAP_MAX_WORKERS, 0 keeps it synchronous):
+    // write-backs of evicted pages are queued and coalesced per page, a restore of a page still queued
+    // is served from the queue, and bulk accesses, huge faults and read-ahead announce the pages they
+    // will restore so the reads overlap. results are exactly those of synchronous swap. it pays off
+    // only when swap I/O is slow (SWAP_MAPPED on a cold file); an in-memory swap copy is cheaper
+    // than handing it to a thread (see BM_SwapWorkers).
+    uint64_t swapWorkers = 0;
+
+    // several threads may call VMread/VMwrite (and the bulk and range forms) on the context at once.
+    // accesses to resident pages take no lock; faults are serialized per page, then run the allocator
+    // under a lock of its own (see SharedAccess.h). the order of the faults, and so which pages get evicted,
+    // depends on the scheduling. needs EVICT_CYCLIC, a single address space, no huge pages and no
+    // read-ahead; VMrecord and everything but the accesses need the other threads to be done.
+    // at most SHARED_MAX_THREADS threads may access it at the same time (any number over its life).
+    bool concurrent = false;
+};
 
 /*
  * Initialize the virtual memory
  */
 void VMinitialize();
 
+/*
+ * Initialize the virtual memory with the given tunables
+ */
+void VMinitialize(const VMConfig &config);
+
+/*
+ * Initialize the virtual memory with a layout chosen at runtime instead of MemoryConstants.h.
+ * RAM and swap are recreated with that layout.
+ */
+void VMinitialize(const Geometry &layout, const VMConfig &config = VMConfig());
+
 /* reads a word from the given virtual address
  * and puts its content in *value.
  *
@@ -25,4 +124,84 @@ int VMread(uint64_t virtualAddress, word_t* value);
 
 int VMwrite(uint64_t virtualAddress, word_t value);
 
+/* reads the words at the n given virtual addresses, in order, into values[0..n-1].
+ * behaves exactly like n calls to VMread (same faults, same evictions), but translates
+ * each page once per run of consecutive accesses to it.
+ *
+ * returns 1 if every address was read.
+ * returns 0 if any address could not be mapped; its value is left untouched and the rest are still read.
+ */
+int VMreadBulk(const uint64_t* virtualAddresses, word_t* values, size_t n);
+
+/* writes values[i] to virtualAddresses[i] for i = 0..n-1, in order.
+ * same contract as VMreadBulk.
+ */
+int VMwriteBulk(const uint64_t* virtualAddresses, const word_t* values, size_t n);
+
+/* reads 'length' consecutive words starting at virtualAddress into values,
+ * translating once per page and copying whole in-page runs.
+ *
+ * returns 1 on success.
+ * returns 0 without touching memory if the range exceeds the virtual memory.
+ */
+int VMreadRange(uint64_t virtualAddress, word_t* values, size_t length);
+
+/* writes 'length' consecutive words from values starting at virtualAddress.
+ * same contract as VMreadRange.
+ */
+int VMwriteRange(uint64_t virtualAddress, const word_t* values, size_t length);
+
+/* marks the huge-page regions (PAGE_SIZE^(hugeOrder+1) aligned words) that lie entirely inside
+ * [virtualAddress, virtualAddress + length) as eligible for huge mappings. takes effect on the next
+ * fault at the huge level of each region: parts already mapped with small pages stay small, and a
+ * fault that finds no window of contiguous frames to empty falls back to small pages.
+ * has no effect unless VMConfig::hugeOrder is set. VMinitialize forgets every region.
+ */
+void VMadviseHuge(uint64_t virtualAddress, uint64_t length);
+
+/* switches to address space 'asid' (< VMConfig::addressSpaces): every later access translates
+ * through its page tables. VMinitialize starts in space 0. switches are not recorded by VMrecord.
+ */
+void VMswitch(uint64_t asid);
+
+/* makes address space 'child' a copy of address space 'parent' (two different spaces < addressSpaces).
+ * whatever 'child' held is dropped first. it then gets page tables of its own whose leaves share the
+ * frames of every resident page of 'parent', and reads the swapped-out pages of 'parent' through its
+ * swap copies: no data page is copied. the first VMwrite to a shared page, from either space, gives the
+ * writer a copy of its own (copy on write). costs one table walk per resident page of 'parent'.
+ * the current space does not change. forks are not recorded by VMrecord.
+ */
+void VMfork(uint64_t parent, uint64_t child);
+
+/* checks the page-table trees against the frame table (the inverted page table): every non-zero
+ * row must point to a frame whose record names that table and row, with the matching prefix and
+ * kind, no frame may be reachable twice (a page shared since a VMfork: once from each of its
+ * owners), and every referenced record must be reachable.
+ *
+ * returns true if they agree. O(NUM_FRAMES * PAGE_SIZE).
+ */
+bool VMcheckIntegrity();
+
+/* ===================================================================== */
+/*         independent simulations (the functions above use the default) */
+/* ===================================================================== */
+
+struct VMContext; // VMContext.h
+
+/*
+ * the context used by the functions that do not take one
+ */
+VMContext& VMdefaultContext();
 
+/* same contracts as above, on the given simulation */
+void VMinitialize(VMContext& context, const Geometry& layout = Geometry(), const VMConfig& config = VMConfig());
+int VMread(VMContext& context, uint64_t virtualAddress, word_t* value);
+int VMwrite(VMContext& context, uint64_t virtualAddress, word_t value);
+int VMreadBulk(VMContext& context, const uint64_t* virtualAddresses, word_t* values, size_t n);
+int VMwriteBulk(VMContext& context, const uint64_t* virtualAddresses, const word_t* values, size_t n);
+int VMreadRange(VMContext& context, uint64_t virtualAddress, word_t* values, size_t length);
+int VMwriteRange(VMContext& context, uint64_t virtualAddress, const word_t* values, size_t length);
+void VMadviseHuge(VMContext& context, uint64_t virtualAddress, uint64_t length);
+void VMswitch(VMContext& context, uint64_t asid);
+void VMfork(VMContext& context, uint64_t parent, uint64_t child);
+bool VMcheckIntegrity(const VMContext& context);
@@ -0,0 +1,213 @@
+/*
+ * Stress test of concurrent contexts (VMConfig::concurrent): many threads on one address space that is
+ * much larger than the RAM, so that pages are evicted while other threads use them.
+ *   - read-your-writes: every thread writes words of pages of its own and reads them back, word by
+ *     word, in bulk and as ranges, checking each against what it wrote last.
+ *   - no torn or misplaced reads: pages every thread reads, whose words only ever hold values
+ *     tagged with their own address.
+ *   - thread turnover: far more than SHARED_MAX_THREADS short-lived threads access the context over
+ *     its life, a few dozen at a time.
+ * each run goes through both allocator modes, with and without lazy reads, and ends with the
+ * integrity and consistency checks. exits with 1 on the first failed run.
+ * usage: shared_stress [accesses per thread]. `make stress SANITIZE=thread` runs it under TSan.
+ */
+#include "VirtualMemory.h"
+#include "VMContext.h"
+#include "Inspect.h"
+#include "SharedAccess.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+// the layout: 64 frames of 16 words
+#define STRESS_OFFSET_WIDTH 4
+#define STRESS_PHYSICAL_WIDTH 10
+#define STRESS_VIRTUAL_WIDTH 20
+// threads of the read-your-writes run, and pages each of them owns
+#define STRESS_THREADS 8
+#define STRESS_OWN_PAGES 16
+// pages every thread reads, after the owned ones
+#define STRESS_COMMON_PAGES 32
+// threads started over the turnover run, and how many run at once
+#define STRESS_TURNOVER_THREADS (4 * SHARED_MAX_THREADS)
+#define STRESS_TURNOVER_WAVE 32
+// accesses per thread by default
+#define STRESS_ACCESSES 20000
+
+// the low bits of a common word hold a sequence number, the others its own address
+#define STRESS_SEQUENCE_BITS (WORD_WIDTH - 1 - STRESS_VIRTUAL_WIDTH)
+
+/* what a word of a common page may hold: its own address above a sequence number */
+static word_t tagged(uint64_t va, uint64_t sequence)
+{
+    return (word_t)((va << STRESS_SEQUENCE_BITS) | (sequence & ((1ULL << STRESS_SEQUENCE_BITS) - 1)));
+}
+
+static bool taggedBy(word_t value, uint64_t va)
+{
+    return value >= 0 && ((uint64_t)value >> STRESS_SEQUENCE_BITS) == va;
+}
+
+struct Stress
+{
+    VMContext context;
+    Geometry geo;
+    uint64_t accesses;
+    std::atomic<uint64_t> failures{0};
+
+    void fail(const char *what, uint64_t va, word_t got, word_t expected)
+    {
+        if (failures.fetch_add(1) < 8)
+            std::printf("  %s at %llu: read %lld, expected %lld\n", what, (unsigned long long)va, (long long)got,
+                        (long long)expected);
+    }
+
+    uint64_t ownBase(uint64_t thread) const { return thread * STRESS_OWN_PAGES * geo.pageSize; }
+    uint64_t commonBase() const { return STRESS_THREADS * STRESS_OWN_PAGES * geo.pageSize; }
+    uint64_t commonWords() const { return STRESS_COMMON_PAGES * geo.pageSize; }
+
+    /**
+     * thread 'thread' owns its pages, and the words of the common pages whose address is thread mod
+     * STRESS_THREADS; it reads everything.
+     **/
+    void work(uint64_t thread)
+    {
+        std::mt19937_64 random(thread);
+        uint64_t ownWords = STRESS_OWN_PAGES * geo.pageSize;
+        std::vector<word_t> shadow(ownWords);
+        for (uint64_t i = 0; i < ownWords; ++i)
+        {
+            shadow[i] = (word_t)random();
+            VMwrite(context, ownBase(thread) + i, shadow[i]);
+        }
+
+        for (uint64_t n = 0; n < accesses; ++n)
+        {
+            uint64_t i = random() % ownWords;
+            uint64_t va = ownBase(thread) + i;
+            word_t value;
+            switch (random() % 8)
+            {
+                case 0:
+                case 1:
+                case 2:
+                    shadow[i] = (word_t)random();
+                    VMwrite(context, va, shadow[i]);
+                    break;
+                case 3:
+                {
+                    /* a range over the rest of the page */
+                    uint64_t length = geo.pageSize - (i & (geo.pageSize - 1));
+                    std::vector<word_t> values(length);
+                    VMreadRange(context, va, values.data(), length);
+                    for (uint64_t k = 0; k < length; ++k)
+                        if (values[k] != shadow[i + k]) fail("own range", va + k, values[k], shadow[i + k]);
+                    break;
+                }
+                case 4:
+                {
+                    uint64_t addresses[4];
+                    word_t values[4];
+                    for (uint64_t &address : addresses) address = ownBase(thread) + random() % ownWords;
+                    VMreadBulk(context, addresses, values, 4);
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        word_t expected = shadow[addresses[k] - ownBase(thread)];
+                        if (values[k] != expected) fail("own bulk", addresses[k], values[k], expected);
+                    }
+                    break;
+                }
+                case 5:
+                {
+                    uint64_t common = commonBase() + (random() % (commonWords() / STRESS_THREADS)) * STRESS_THREADS +
+                                      thread;
+                    VMwrite(context, common, tagged(common, n));
+                    break;
+                }
+                case 6:
+                {
+                    uint64_t common = commonBase() + random() % commonWords();
+                    VMread(context, common, &value);
+                    if (!taggedBy(value, common)) fail("common read", common, value, tagged(common, 0));
+                    break;
+                }
+                default:
+                    VMread(context, va, &value);
+                    if (value != shadow[i]) fail("own read", va, value, shadow[i]);
+                    break;
+            }
+        }
+
+        for (uint64_t i = 0; i < ownWords; ++i)
+        {
+            word_t value;
+            VMread(context, ownBase(thread) + i, &value);
+            if (value != shadow[i]) fail("own final read", ownBase(thread) + i, value, shadow[i]);
+        }
+    }
+
+    /**
+     * one short-lived thread: a few reads of the common pages, which take and give back a hazard slot.
+     **/
+    void visit(uint64_t thread)
+    {
+        std::mt19937_64 random(thread);
+        for (int n = 0; n < 16; ++n)
+        {
+            uint64_t common = commonBase() + random() % commonWords();
+            word_t value;
+            VMread(context, common, &value);
+            if (!taggedBy(value, common)) fail("turnover read", common, value, tagged(common, 0));
+        }
+    }
+};
+
+static bool run(AllocatorMode allocator, bool lazyReads, uint64_t accesses)
+{
+    Stress stress;
+    stress.geo = Geometry(STRESS_OFFSET_WIDTH, STRESS_PHYSICAL_WIDTH, STRESS_VIRTUAL_WIDTH);
+    stress.accesses = accesses;
+    VMConfig config;
+    config.allocator = allocator;
+    config.lazyReads = lazyReads;
+    config.concurrent = true;
+    VMinitialize(stress.context, stress.geo, config);
+    for (uint64_t va = stress.commonBase(); va < stress.commonBase() + stress.commonWords(); ++va)
+        VMwrite(stress.context, va, tagged(va, 0));
+
+    std::vector<std::thread> threads;
+    for (uint64_t thread = 0; thread < STRESS_THREADS; ++thread)
+        threads.emplace_back([&stress, thread] { stress.work(thread); });
+    for (std::thread &thread : threads) thread.join();
+
+    for (uint64_t first = 0; first < STRESS_TURNOVER_THREADS; first += STRESS_TURNOVER_WAVE)
+    {
+        threads.clear();
+        for (uint64_t thread = first; thread < first + STRESS_TURNOVER_WAVE; ++thread)
+            threads.emplace_back([&stress, thread] { stress.visit(thread); });
+        for (std::thread &thread : threads) thread.join();
+    }
+
+    ConsistencyReport report = VMcheckConsistency(stress.context);
+    bool integrity = VMcheckIntegrity(stress.context);
+    bool passed = stress.failures == 0 && integrity && report.consistent;
+    std::printf("%s %s%s: %llu faults, %llu failures%s%s%s\n", passed ? "ok  " : "FAIL",
+                allocator == ALLOCATOR_SCAN ? "scan" : "incremental", lazyReads ? " lazy" : "",
+                (unsigned long long)stress.context.pageFaults, (unsigned long long)stress.failures.load(),
+                integrity ? "" : ", integrity check failed", report.consistent ? "" : ", inconsistent: ",
+                report.error.c_str());
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t accesses = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : STRESS_ACCESSES;
+    bool passed = true;
+    for (AllocatorMode allocator : {ALLOCATOR_SCAN, ALLOCATOR_INCREMENTAL})
+        for (bool lazyReads : {false, true}) passed = run(allocator, lazyReads, accesses) && passed;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,649 @@
+/*
+ * Microbenchmarks of VMread/VMwrite over canonical access patterns and several layouts.
+ * One benchmark iteration is one access, so the reported time is ns/access; the faults,
+ * evictions and write_backs counters are per access too. BM_Fork times snapshots (VMfork) instead,
+ * BM_Restore restores of a warmed-up image (VMrestore), BM_SwapWorkers bulk reads that thrash a
+ * file-backed swap with and without swap worker threads, BM_SwapBackend thrashing writes per swap store,
+ * BM_PageKernels one page kernel call per iteration, for each kernel version, BM_SharedAccess
+ * accesses of 1 to 8 threads to one concurrent context, BM_SharedWalk the same on resident pages
+ * that always miss the threads' private caches, BM_Analyze accesses fed to an AccessAnalyzer,
+ * and BM_Inspect one dump or check of a warmed-up simulation per iteration.
+ * --benchmark_format=json (or --benchmark_out=<file> --benchmark_out_format=json) gives a
+ * machine-readable report to diff between releases.
+ */
+#include "VirtualMemory.h"
+#include "VMContext.h"
+#include "Checkpoint.h"
+#include "VMStats.h"
+#include "PageKernels.h"
+#include "Analytics.h"
+#include "Inspect.h"
+#include "SharedAccess.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// addresses are precomputed into a ring of this many entries so the timed loop only simulates
+#define BENCH_ADDRESSES (1 << 16)
+// the skew of the Zipfian pattern
+#define BENCH_ZIPF_S 0.99
+// the working set of the "thrash" pattern, in multiples of the number of frames
+#define BENCH_THRASH_FACTOR 4
+// accesses to the parent between two snapshots of BM_Fork
+#define BENCH_FORK_ACCESSES 64
+// accesses per VMreadBulk call of BM_SwapWorkers
+#define BENCH_BULK_ACCESSES 256
+// the layout of BM_SharedAccess (index into layouts)
+#define BENCH_SHARED_LAYOUT 2
+
+enum Pattern
+{
+    PATTERN_SEQUENTIAL, // every word in order
+    PATTERN_STRIDED,    // one word per page, pages in order
+    PATTERN_RANDOM,     // uniform over the whole virtual memory
+    PATTERN_ZIPF,       // Zipfian over pages, uniform within a page
+    PATTERN_THRASH,     // uniform over a working set larger than the RAM
+    PATTERNS
+};
+
+static const char *const patternNames[PATTERNS] = {"sequential", "strided", "random", "zipf", "thrash"};
+
+/* (offset, physical, virtual) widths; the first one is the MemoryConstants.h layout */
+static const uint64_t layouts[][3] = {
+    {OFFSET_WIDTH, PHYSICAL_ADDRESS_WIDTH, VIRTUAL_ADDRESS_WIDTH},
+    {4, 12, 24},
+    {5, 14, 30},
+    {3, 9, 18},
+};
+#define LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+static std::vector<uint64_t> makeAddresses(Pattern pattern, const Geometry &geo)
+{
+    std::vector<uint64_t> addresses(BENCH_ADDRESSES);
+    std::mt19937_64 random(42);
+
+    switch (pattern)
+    {
+        case PATTERN_SEQUENTIAL:
+            for (uint64_t i = 0; i < addresses.size(); ++i) addresses[i] = i % geo.virtualMemorySize;
+            break;
+        case PATTERN_STRIDED:
+            for (uint64_t i = 0; i < addresses.size(); ++i) addresses[i] = (i * geo.pageSize) % geo.virtualMemorySize;
+            break;
+        case PATTERN_RANDOM:
+            for (uint64_t &va : addresses) va = random() % geo.virtualMemorySize;
+            break;
+        case PATTERN_ZIPF:
+        {
+            /* inverse CDF over a bounded number of ranks, each rank a random page */
+            uint64_t ranks = std::min<uint64_t>(geo.numPages, 1 << 16);
+            std::vector<double> cdf(ranks);
+            double sum = 0;
+            for (uint64_t k = 0; k < ranks; ++k) cdf[k] = (sum += 1.0 / std::pow((double)(k + 1), BENCH_ZIPF_S));
+            std::vector<uint64_t> pageOfRank(ranks);
+            for (uint64_t &page : pageOfRank) page = random() % geo.numPages;
+
+            std::uniform_real_distribution<double> uniform(0, sum);
+            for (uint64_t &va : addresses)
+            {
+                uint64_t rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(random)) - cdf.begin();
+                rank = std::min(rank, ranks - 1);
+                va = pageOfRank[rank] * geo.pageSize + random() % geo.pageSize;
+            }
+            break;
+        }
+        case PATTERN_THRASH:
+        {
+            uint64_t pages = std::min<uint64_t>(geo.numPages, BENCH_THRASH_FACTOR * geo.numFrames);
+            for (uint64_t &va : addresses) va = (random() % pages) * geo.pageSize + random() % geo.pageSize;
+            break;
+        }
+        case PATTERNS:
+            break;
+    }
+    return addresses;
+}
+
+/*
+ * arguments: pattern, layout index, allocator mode, 0 = read / 1 = write
+ */
+static void BM_Access(benchmark::State &state)
+{
+    Pattern pattern = (Pattern)state.range(0);
+    const uint64_t *widths = layouts[state.range(1)];
+    Geometry geo(widths[0], widths[1], widths[2]);
+    VMConfig config;
+    config.allocator = (AllocatorMode)state.range(2);
+    bool writes = state.range(3) != 0;
+
+    std::vector<uint64_t> addresses = makeAddresses(pattern, geo);
+    VMContext context;
+    VMinitialize(context, geo, config);
+
+    uint64_t faults = context.pageFaults;
+    uint64_t evictions = context.memory->evictions();
+    uint64_t writeBacks = context.memory->writeBacks();
+    size_t next = 0;
+    word_t value = 0;
+
+    for (auto _ : state)
+    {
+        uint64_t va = addresses[next];
+        next = (next + 1) & (BENCH_ADDRESSES - 1);
+        if (writes) VMwrite(context, va, value++);
+        else VMread(context, va, &value);
+        benchmark::DoNotOptimize(value);
+    }
+
+    state.counters["faults"] = benchmark::Counter((double)(context.pageFaults - faults), benchmark::Counter::kAvgIterations);
+    state.counters["evictions"] = benchmark::Counter((double)(context.memory->evictions() - evictions),
+                                                     benchmark::Counter::kAvgIterations);
+    state.counters["write_backs"] = benchmark::Counter((double)(context.memory->writeBacks() - writeBacks),
+                                                       benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(std::string(patternNames[pattern]) + " " + std::to_string(widths[0]) + "/" +
+                   std::to_string(widths[1]) + "/" + std::to_string(widths[2]) +
+                   (config.allocator == ALLOCATOR_SCAN ? " scan" : " incremental") + (writes ? " write" : " read"));
+}
+
+BENCHMARK(BM_Access)
+    ->ArgNames({"pattern", "layout", "allocator", "write"})
+    ->ArgsProduct({
+        {PATTERN_SEQUENTIAL, PATTERN_STRIDED, PATTERN_RANDOM, PATTERN_ZIPF, PATTERN_THRASH},
+        benchmark::CreateDenseRange(0, LAYOUTS - 1, 1),
+        {ALLOCATOR_SCAN, ALLOCATOR_INCREMENTAL},
+        {0, 1},
+    });
+
+/*
+ * snapshots: one iteration forks address space 0 into space 1 (dropping the previous snapshot), then
+ * makes BENCH_FORK_ACCESSES accesses of the pattern to space 0, so the time is per snapshot.
+ * arguments: pattern, layout index, 0 = read / 1 = write
+ */
+static void BM_Fork(benchmark::State &state)
+{
+    Pattern pattern = (Pattern)state.range(0);
+    const uint64_t *widths = layouts[state.range(1)];
+    Geometry geo(widths[0], widths[1], widths[2]);
+    VMConfig config;
+    config.allocator = ALLOCATOR_INCREMENTAL;
+    config.addressSpaces = 2;
+    bool writes = state.range(2) != 0;
+
+    std::vector<uint64_t> addresses = makeAddresses(pattern, geo);
+    VMContext context;
+    VMinitialize(context, geo, config);
+    for (uint64_t va : addresses) VMwrite(context, va, 1); // something to share
+
+    uint64_t evictions = context.memory->evictions();
+    size_t next = 0;
+    word_t value = 0;
+
+    for (auto _ : state)
+    {
+        VMfork(context, 0, 1);
+        for (int i = 0; i < BENCH_FORK_ACCESSES; ++i)
+        {
+            uint64_t va = addresses[next];
+            next = (next + 1) & (BENCH_ADDRESSES - 1);
+            if (writes) VMwrite(context, va, value++);
+            else VMread(context, va, &value);
+        }
+        benchmark::DoNotOptimize(value);
+    }
+
+    state.counters["evictions"] = benchmark::Counter((double)(context.memory->evictions() - evictions),
+                                                     benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(std::string(patternNames[pattern]) + " " + std::to_string(widths[0]) + "/" +
+                   std::to_string(widths[1]) + "/" + std::to_string(widths[2]) + (writes ? " write" : " read"));
+}
+
+BENCHMARK(BM_Fork)
+    ->ArgNames({"pattern", "layout", "write"})
+    ->ArgsProduct({
+        {PATTERN_SEQUENTIAL, PATTERN_ZIPF, PATTERN_THRASH},
+        benchmark::CreateDenseRange(0, LAYOUTS - 1, 1),
+        {0, 1},
+    });
+
+/*
+ * checkpoints: the pattern's accesses (as writes) warm up a simulation once, which is saved to an image;
+ * one iteration restores it, so the time is per restore, against warmup_ns for replaying the warm-up.
+ * arguments: pattern, layout index
+ */
+static void BM_Restore(benchmark::State &state)
+{
+    Pattern pattern = (Pattern)state.range(0);
+    const uint64_t *widths = layouts[state.range(1)];
+    Geometry geo(widths[0], widths[1], widths[2]);
+    VMConfig config;
+    config.allocator = ALLOCATOR_INCREMENTAL;
+
+    std::vector<uint64_t> addresses = makeAddresses(pattern, geo);
+    VMContext context;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    VMinitialize(context, geo, config);
+    for (uint64_t va : addresses) VMwrite(context, va, (word_t)va);
+    double warmup = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    const char *dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/vm_bench_" + std::to_string(state.range(0)) + "_" +
+                       std::to_string(state.range(1)) + ".img";
+    if (!VMcheckpoint(context, path))
+    {
+        state.SkipWithError("cannot write the image");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        bool restored = VMrestore(context, path);
+        benchmark::DoNotOptimize(restored);
+    }
+    std::remove(path.c_str());
+
+    state.counters["warmup_ns"] = warmup;
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(std::string(patternNames[pattern]) + " " + std::to_string(widths[0]) + "/" +
+                   std::to_string(widths[1]) + "/" + std::to_string(widths[2]));
+}
+
+BENCHMARK(BM_Restore)
+    ->ArgNames({"pattern", "layout"})
+    ->ArgsProduct({
+        {PATTERN_RANDOM, PATTERN_THRASH},
+        benchmark::CreateDenseRange(0, LAYOUTS - 1, 1),
+    });
+
+/*
+ * swap I/O: one iteration is a VMreadBulk of BENCH_BULK_ACCESSES accesses of the thrash pattern over a
+ * SWAP_MAPPED swap, so nearly every access restores a page; the time is per bulk call.
+ * arguments: layout index, swap worker threads
+ */
+static void BM_SwapWorkers(benchmark::State &state)
+{
+    const uint64_t *widths = layouts[state.range(0)];
+    Geometry geo(widths[0], widths[1], widths[2]);
+    VMConfig config;
+    config.allocator = ALLOCATOR_INCREMENTAL;
+    config.swap = SWAP_MAPPED;
+    config.swapWorkers = (uint64_t)state.range(1);
+
+    std::vector<uint64_t> addresses = makeAddresses(PATTERN_THRASH, geo);
+    VMContext context;
+    VMinitialize(context, geo, config);
+    for (uint64_t va : addresses) VMwrite(context, va, (word_t)va); // every page of the working set in swap
+
+    uint64_t faults = context.pageFaults;
+    std::vector<word_t> values(BENCH_BULK_ACCESSES);
+    size_t next = 0;
+
+    for (auto _ : state)
+    {
+        VMreadBulk(context, &addresses[next], values.data(), BENCH_BULK_ACCESSES);
+        next = (next + BENCH_BULK_ACCESSES) & (BENCH_ADDRESSES - 1);
+        benchmark::DoNotOptimize(values.data());
+    }
+
+    state.counters["faults"] = benchmark::Counter((double)(context.pageFaults - faults), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations() * BENCH_BULK_ACCESSES);
+    state.SetLabel(std::to_string(widths[0]) + "/" + std::to_string(widths[1]) + "/" + std::to_string(widths[2]) +
+                   " " + std::to_string(config.swapWorkers) + " workers");
+}
+
+BENCHMARK(BM_SwapWorkers)
+    ->ArgNames({"layout", "workers"})
+    ->ArgsProduct({
+        benchmark::CreateDenseRange(0, LAYOUTS - 1, 1),
+        {0, 1, 2, 4},
+    });
+
+static const char *const backendNames[] = {"map", "pooled", "mapped", "compressed"};
+
+/*
+ * swap stores: writes of the thrash pattern, so nearly every access evicts a page and restores one.
+ * the values written are small (va modulo 16), the kind of content a compressed swap shrinks; its
+ * compression ratio is reported as "ratio".
+ * arguments: layout index, swap backend
+ */
+static void BM_SwapBackend(benchmark::State &state)
+{
+    const uint64_t *widths = layouts[state.range(0)];
+    Geometry geo(widths[0], widths[1], widths[2]);
+    VMConfig config;
+    config.allocator = ALLOCATOR_INCREMENTAL;
+    config.swap = (SwapBackend)state.range(1);
+
+    std::vector<uint64_t> addresses = makeAddresses(PATTERN_THRASH, geo);
+    VMContext context;
+    VMinitialize(context, geo, config);
+    size_t next = 0;
+
+    for (auto _ : state)
+    {
+        uint64_t va = addresses[next];
+        next = (next + 1) & (BENCH_ADDRESSES - 1);
+        VMwrite(context, va, (word_t)(va % 16));
+    }
+
+    VMStats stats = VMstatsSnapshot(context);
+    if (stats.swapBytesOut != 0) state.counters["ratio"] = (double)stats.swapBytesIn / (double)stats.swapBytesOut;
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(std::to_string(widths[0]) + "/" + std::to_string(widths[1]) + "/" + std::to_string(widths[2]) +
+                   " " + backendNames[config.swap]);
+}
+
+BENCHMARK(BM_SwapBackend)
+    ->ArgNames({"layout", "backend"})
+    ->ArgsProduct({
+        benchmark::CreateDenseRange(0, LAYOUTS - 1, 1),
+        {SWAP_POOLED, SWAP_MAPPED, SWAP_COMPRESSED},
+    });
+
+enum KernelOp
+{
+    KERNEL_CLEAR,
+    KERNEL_COPY,
+    KERNEL_ALL_ZERO,
+    KERNEL_SAME_VALUE,
+    KERNEL_NON_ZERO_ROWS, // the bitmaps of a whole table, 64 rows per call
+    KERNEL_OPS
+};
+
+static const char *const kernelOpNames[KERNEL_OPS] = {"clear", "copy", "all_zero", "same_value", "non_zero_rows"};
+static const char *const kernelNames[] = {"scalar", "sse2", "avx2", "neon"};
+
+/*
+ * page kernels: one iteration runs the kernel over a page of 2^offsetWidth words. the all-zero and
+ * same-value pages are uniform (the worst case: every word is read); the table has one row in eight set.
+ * arguments: kernel, kernel version, offset width
+ */
+static void BM_PageKernels(benchmark::State &state)
+{
+    KernelOp op = (KernelOp)state.range(0);
+    const char *version = kernelNames[state.range(1)];
+    uint64_t words = 1ULL << state.range(2);
+    const PageKernels &previous = pageKernels();
+    if (!usePageKernels(version))
+    {
+        state.SkipWithError("kernel version not supported here");
+        return;
+    }
+    const PageKernels &kernels = pageKernels();
+
+    std::vector<word_t> page(words, op == KERNEL_SAME_VALUE ? 7 : 0), other(words);
+    if (op == KERNEL_NON_ZERO_ROWS)
+        for (uint64_t i = 0; i < words; i += 8) page[i] = (word_t)(i + 1);
+    word_t value;
+    uint64_t sink = 0;
+
+    for (auto _ : state)
+    {
+        switch (op)
+        {
+            case KERNEL_CLEAR: kernels.clear(other.data(), words); break;
+            case KERNEL_COPY: kernels.copy(other.data(), page.data(), words); break;
+            case KERNEL_ALL_ZERO: sink += kernels.allZero(page.data(), words); break;
+            case KERNEL_SAME_VALUE: sink += kernels.sameValue(page.data(), words, value); break;
+            case KERNEL_NON_ZERO_ROWS:
+                for (uint64_t first = 0; first < words; first += 64)
+                    sink += kernels.nonZeroMask(&page[first], std::min<uint64_t>(64, words - first));
+                break;
+            case KERNEL_OPS: break;
+        }
+        benchmark::DoNotOptimize(sink);
+        benchmark::ClobberMemory();
+    }
+    usePageKernels(previous.name);
+
+    state.SetBytesProcessed(state.iterations() * words * sizeof(word_t));
+    state.SetLabel(std::string(kernelOpNames[op]) + " " + version + " " + std::to_string(words) + " words");
+}
+
+BENCHMARK(BM_PageKernels)
+    ->ArgNames({"kernel", "version", "offset"})
+    ->ArgsProduct({
+        benchmark::CreateDenseRange(0, KERNEL_OPS - 1, 1),
+        benchmark::CreateDenseRange(0, 3, 1),
+        {4, 10},
+    });
+
+/* the context the threads of one BM_SharedAccess run share, made by its Setup */
+static std::unique_ptr<VMContext> sharedContext;
+static std::vector<uint64_t> sharedAddresses;
+
+static void setupShared(const benchmark::State &state)
+{
+    const uint64_t *widths = layouts[BENCH_SHARED_LAYOUT];
+    Geometry geo(widths[0], widths[1], widths[2]);
+    VMConfig config;
+    config.allocator = ALLOCATOR_INCREMENTAL;
+    config.concurrent = true;
+
+    /* resident: uniform over half as many pages as there are frames, so that once warm every access hits */
+    bool resident = state.range(0) != 0;
+    sharedAddresses = makeAddresses(resident ? PATTERN_RANDOM : PATTERN_THRASH, geo);
+    if (resident)
+        for (uint64_t &va : sharedAddresses) va %= geo.numFrames / 2 * geo.pageSize;
+    sharedContext.reset(new VMContext());
+    VMinitialize(*sharedContext, geo, config);
+    for (uint64_t va : sharedAddresses) VMwrite(*sharedContext, va, (word_t)va);
+}
+
+static void teardownShared(const benchmark::State &)
+{
+    sharedContext.reset();
+    sharedAddresses.clear();
+}
+
+/*
+ * concurrent accesses: every thread walks the address ring from its own starting point, on one
+ * concurrent context (VMConfig::concurrent). items_per_second is the throughput of all the threads.
+ * arguments: 1 = resident working set / 0 = thrash pattern, 0 = read / 1 = write
+ */
+static void BM_SharedAccess(benchmark::State &state)
+{
+    VMContext &context = *sharedContext;
+    bool writes = state.range(1) != 0;
+    size_t next = (size_t)state.thread_index() * BENCH_ADDRESSES / state.threads();
+    uint64_t faults = context.pageFaults;
+    word_t value = 0;
+
+    for (auto _ : state)
+    {
+        uint64_t va = sharedAddresses[next];
+        next = (next + 1) & (BENCH_ADDRESSES - 1);
+        if (writes) VMwrite(context, va, value++);
+        else VMread(context, va, &value);
+        benchmark::DoNotOptimize(value);
+    }
+
+    /* the counters of the threads are summed: the faults of all of them are counted once */
+    if (state.thread_index() == 0)
+    {
+        state.counters["faults"] = benchmark::Counter((double)(context.pageFaults - faults),
+                                                      benchmark::Counter::kAvgIterations);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(std::string(state.range(0) != 0 ? "resident" : "thrash") + (writes ? " write" : " read"));
+}
+
+BENCHMARK(BM_SharedAccess)
+    ->ArgNames({"resident", "write"})
+    ->ArgsProduct({
+        {1, 0},
+        {0, 1},
+    })
+    ->Setup(setupShared)
+    ->Teardown(teardownShared)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+/* pages of the BM_SharedWalk ring, SHARED_CACHE_ENTRIES pages apart */
+#define BENCH_WALK_PAGES 128
+
+/* resident pages that all share one entry of a thread's private cache, so every access walks */
+static void setupSharedWalk(const benchmark::State &)
+{
+    const uint64_t *widths = layouts[BENCH_SHARED_LAYOUT];
+    Geometry geo(widths[0], widths[1], widths[2]);
+    VMConfig config;
+    config.allocator = ALLOCATOR_INCREMENTAL;
+    config.concurrent = true;
+
+    sharedAddresses.resize(BENCH_ADDRESSES);
+    for (uint64_t i = 0; i < BENCH_ADDRESSES; ++i)
+        sharedAddresses[i] = (i % BENCH_WALK_PAGES) * SHARED_CACHE_ENTRIES * geo.pageSize + i % geo.pageSize;
+    sharedContext.reset(new VMContext());
+    VMinitialize(*sharedContext, geo, config);
+    for (uint64_t va : sharedAddresses) VMwrite(*sharedContext, va, (word_t)va);
+}
+
+/*
+ * concurrent walks: the accesses of BM_SharedAccess to resident pages that miss the private cache of
+ * the thread every time, so each one walks the page tables. walks take no lock: the throughput grows
+ * with the threads, as far as there are cores to run them.
+ * arguments: 0 = read / 1 = write
+ */
+static void BM_SharedWalk(benchmark::State &state)
+{
+    VMContext &context = *sharedContext;
+    bool writes = state.range(0) != 0;
+    size_t next = (size_t)state.thread_index() * BENCH_ADDRESSES / state.threads();
+    uint64_t faults = context.pageFaults;
+    word_t value = 0;
+
+    for (auto _ : state)
+    {
+        uint64_t va = sharedAddresses[next];
+        next = (next + 1) & (BENCH_ADDRESSES - 1);
+        if (writes) VMwrite(context, va, value++);
+        else VMread(context, va, &value);
+        benchmark::DoNotOptimize(value);
+    }
+
+    if (state.thread_index() == 0)
+    {
+        state.counters["faults"] = benchmark::Counter((double)(context.pageFaults - faults),
+                                                      benchmark::Counter::kAvgIterations);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(writes ? "walk write" : "walk read");
+}
+
+BENCHMARK(BM_SharedWalk)
+    ->ArgNames({"write"})
+    ->DenseRange(0, 1)
+    ->Setup(setupSharedWalk)
+    ->Teardown(teardownShared)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+/*
+ * analytics: the accesses of BM_Access (incremental allocator, reads) with an AccessAnalyzer attached.
+ * arguments: pattern, sampling rate in thousandths (0 = no analyzer)
+ */
+static void BM_Analyze(benchmark::State &state)
+{
+    Pattern pattern = (Pattern)state.range(0);
+    Geometry geo;
+    VMConfig config;
+    config.allocator = ALLOCATOR_INCREMENTAL;
+    AnalyticsConfig analytics;
+    analytics.samplingRate = state.range(1) / 1000.0;
+
+    std::vector<uint64_t> addresses = makeAddresses(pattern, geo);
+    VMContext context;
+    VMinitialize(context, geo, config);
+    std::unique_ptr<AccessAnalyzer> analyzer(state.range(1) != 0 ? new AccessAnalyzer(analytics) : nullptr);
+    VManalyze(context, analyzer.get());
+    size_t next = 0;
+    word_t value = 0;
+
+    for (auto _ : state)
+    {
+        VMread(context, addresses[next], &value);
+        next = (next + 1) & (BENCH_ADDRESSES - 1);
+        benchmark::DoNotOptimize(value);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(std::string(patternNames[pattern]) + " rate " + std::to_string(analytics.samplingRate));
+}
+
+BENCHMARK(BM_Analyze)
+    ->ArgNames({"pattern", "rate"})
+    ->ArgsProduct({
+        {PATTERN_ZIPF, PATTERN_THRASH},
+        {0, 10, 100, 1000},
+    });
+
+enum InspectTool
+{
+    INSPECT_DUMP_TEXT,
+    INSPECT_DUMP_JSON,
+    INSPECT_CONSISTENCY,
+    INSPECT_INTEGRITY,
+    INSPECT_TOOLS
+};
+
+static const char *const inspectToolNames[INSPECT_TOOLS] = {"dump", "json", "consistency", "integrity"};
+
+/*
+ * inspection: the trees left by the random pattern, dumped (into memory) or checked once per iteration.
+ * arguments: tool, layout index
+ */
+static void BM_Inspect(benchmark::State &state)
+{
+    InspectTool tool = (InspectTool)state.range(0);
+    const uint64_t *widths = layouts[state.range(1)];
+    Geometry geo(widths[0], widths[1], widths[2]);
+    VMConfig config;
+    config.allocator = ALLOCATOR_INCREMENTAL;
+
+    VMContext context;
+    VMinitialize(context, geo, config);
+    for (uint64_t va : makeAddresses(PATTERN_RANDOM, geo)) VMwrite(context, va, (word_t)va);
+    size_t bytes = 0;
+
+    for (auto _ : state)
+    {
+        switch (tool)
+        {
+            case INSPECT_DUMP_TEXT:
+            case INSPECT_DUMP_JSON:
+            {
+                std::ostringstream out;
+                VMdump(context, out, tool == INSPECT_DUMP_JSON ? DUMP_JSON : DUMP_TEXT);
+                bytes = out.str().size();
+                break;
+            }
+            case INSPECT_CONSISTENCY: benchmark::DoNotOptimize(VMcheckConsistency(context).consistent); break;
+            case INSPECT_INTEGRITY: benchmark::DoNotOptimize(VMcheckIntegrity(context)); break;
+            case INSPECT_TOOLS: break;
+        }
+    }
+
+    if (bytes != 0) state.counters["bytes"] = (double)bytes;
+    state.SetLabel(std::string(inspectToolNames[tool]) + " " + std::to_string(widths[0]) + "/" +
+                   std::to_string(widths[1]) + "/" + std::to_string(widths[2]));
+}
+
+BENCHMARK(BM_Inspect)
+    ->ArgNames({"tool", "layout"})
+    ->ArgsProduct({
+        benchmark::CreateDenseRange(0, INSPECT_TOOLS - 1, 1),
+        benchmark::CreateDenseRange(0, LAYOUTS - 1, 1),
+    });
+
+BENCHMARK_MAIN();